@@ -0,0 +1,164 @@
+#include "picoredis.h"
+
+static const size_t loop_count = 10000000;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *desc, size_t count, double elapsed)
+{
+    fprintf(stderr, "%-32s %8.2f ns/op %12.0f ops/s\n", desc, elapsed * 1e9 / count, count / elapsed);
+}
+
+// the snprintf based encoder picoredis used before the command header table
+static char *legacy_command_create(const char *name, size_t nargs, const size_t *lengths, const char **values)
+{
+    size_t command_size = 64 + strlen(name);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        command_size += lengths[i] + 32;
+    }
+    char *command = (char *)malloc(command_size);
+    size_t offset = snprintf(command, command_size, "*%zu\r\n$%zu\r\n%s", nargs + 1, strlen(name), name);
+    for (i = 0; i < nargs; ++i) {
+        offset += snprintf(command + offset, command_size - offset, "\r\n$%zu\r\n%s", lengths[i], values[i]);
+    }
+    snprintf(command + offset, command_size - offset, "\r\n");
+    return command;
+}
+
+static void bench_legacy_encode(const char *desc, const char *name, size_t nargs, const char **values)
+{
+    size_t lengths[4];
+    size_t i = 0;
+    volatile size_t total = 0;
+    double start = now();
+    for (; i < loop_count; ++i) {
+        size_t j = 0;
+        for (; j < nargs; ++j) {
+            lengths[j] = strlen(values[j]);
+        }
+        char *command = legacy_command_create(name, nargs, lengths, values);
+        total += strlen(command);
+        free(command);
+    }
+    report(desc, loop_count, now() - start);
+}
+
+static void bench_encode(const char *desc, picoredis_command_type type, size_t nargs, const char **values)
+{
+    picoredis_t *ctx = picoredis_alloc();
+    size_t lengths[4];
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        lengths[i] = strlen(values[i]);
+    }
+    double start = now();
+    for (i = 0; i < loop_count; ++i) {
+        ctx->send_length     = 0;
+        ctx->pending_replies = 0;
+        picoredis_append_command_argv(ctx, type, nargs, values, lengths);
+    }
+    report(desc, loop_count, now() - start);
+    picoredis_free(ctx);
+}
+
+static void bench_format_double(const char *desc, int use_snprintf)
+{
+    char buf[PICOREDIS_DOUBLE_BUFFER_SIZE];
+    volatile size_t total = 0;
+    size_t i = 0;
+    double start = now();
+    for (; i < loop_count; ++i) {
+        double score = (i % 100000) * 0.25;
+        total += use_snprintf ? (size_t)snprintf(buf, sizeof(buf), "%.17g", score) : picoredis_format_double(buf, score);
+    }
+    report(desc, loop_count, now() - start);
+}
+
+// a corpus shaped like recorded traffic: status and integer replies, a long
+// status line, and LRANGE / MGET style multi bulk replies
+static size_t build_reply_corpus(char *buf, size_t size)
+{
+    size_t length = 0;
+    size_t i      = 0;
+    for (; i < 64; ++i) {
+        length += snprintf(buf + length, size - length, "+OK\r\n:%zu\r\n", i * 7919);
+    }
+    length += snprintf(buf + length, size - length, "+");
+    for (i = 0; i < 256; ++i) {
+        length += snprintf(buf + length, size - length, "id=%zu addr=127.0.0.1:%zu fd=%zu name= age=0 idle=0 ", i, 40000 + i, i);
+    }
+    length += snprintf(buf + length, size - length, "\r\n*1000\r\n");
+    for (i = 0; i < 1000; ++i) {
+        length += snprintf(buf + length, size - length, "$32\r\n%032zu\r\n", i);
+    }
+    length += snprintf(buf + length, size - length, "*100\r\n");
+    for (i = 0; i < 100; ++i) {
+        length += snprintf(buf + length, size - length, "$1024\r\n%01024zu\r\n", i);
+    }
+    return length;
+}
+
+// HGETALL / SMEMBERS style traffic: short multi bulk replies mixed with
+// status, integer and error replies, so headers dominate over payload
+static size_t build_multi_bulk_corpus(char *buf, size_t size)
+{
+    size_t length = 0;
+    while (length + 1024 < size) {
+        length += snprintf(buf + length, size - length, "*20\r\n");
+        size_t i = 0;
+        for (; i < 20; i += 2) {
+            length += snprintf(buf + length, size - length, "$14\r\nfield:%08zu\r\n$8\r\n%08zu\r\n", i, length);
+        }
+        length += snprintf(buf + length, size - length, "+OK\r\n:%zu\r\n-ERR wrong type\r\n", length);
+    }
+    return length;
+}
+
+static void bench_parse(const char *desc, const char *corpus, size_t length)
+{
+    static const size_t parse_loop_count = 20000;
+    picoredis_t *ctx = picoredis_alloc();
+    ctx->receive_buf      = (char *)realloc(ctx->receive_buf, length);
+    ctx->receive_buf_size = length;
+    memcpy(ctx->receive_buf, corpus, length);
+
+    size_t replies = 0;
+    size_t i       = 0;
+    double start   = now();
+    for (; i < parse_loop_count; ++i) {
+        ctx->receive_end = length;
+        while (picoredis_reader_parse(ctx) > 0) {
+            picoredis_reader_consume(ctx);
+            replies++;
+        }
+    }
+    double elapsed = now() - start;
+    fprintf(stderr, "%-32s %8.2f GB/s %12.0f replies/s\n", desc, length * parse_loop_count / elapsed / 1e9, replies / elapsed);
+    picoredis_free(ctx);
+}
+
+int main(int argc, char **argv)
+{
+    const char *set_args[] = { "user:1000:session", "0123456789abcdef0123456789abcdef" };
+    const char *get_args[] = { "user:1000:session" };
+
+    bench_legacy_encode("encode SET (snprintf)", "SET", 2, set_args);
+    bench_encode("encode SET", PICOREDIS_SET, 2, set_args);
+    bench_legacy_encode("encode GET (snprintf)", "GET", 1, get_args);
+    bench_encode("encode GET", PICOREDIS_GET, 1, get_args);
+    bench_format_double("format score (snprintf)", 1);
+    bench_format_double("format score", 0);
+
+    static char corpus[256 * 1024];
+    size_t corpus_length = build_reply_corpus(corpus, sizeof(corpus));
+    bench_parse("parse corpus", corpus, corpus_length);
+    corpus_length = build_multi_bulk_corpus(corpus, sizeof(corpus));
+    bench_parse("parse multi bulk corpus", corpus, corpus_length);
+    return 0;
+}
@@ -10,37 +10,342 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <float.h>
 #include <time.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
-#include <math.h>
 #include <netdb.h>
 #include <signal.h>
 #include <poll.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#ifdef SYS_splice
+#define PICOREDIS_HAS_SPLICE
+#endif
+#if !defined(PICOREDIS_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#ifdef IORING_RECV_MULTISHOT
+#define PICOREDIS_HAS_IO_URING
+#endif
+#endif
+#endif
+#endif
+
+#ifdef IOV_MAX
+#define PICOREDIS_IOV_MAX IOV_MAX
+#else
+#define PICOREDIS_IOV_MAX 1024
+#endif
+
+#define PICOREDIS_RECEIVE_BUFFER_SIZE (16 * 1024)
+#define PICOREDIS_SEND_BUFFER_SIZE    (16 * 1024)
+#define PICOREDIS_READER_MAX_DEPTH    8
+#define PICOREDIS_MAX_BULK_LENGTH     (512LL * 1024 * 1024) // proto-max-bulk-len of the server
+#define PICOREDIS_MAX_MULTI_BULK_LENGTH INT_MAX             // the server rejects longer arrays as well
+#define PICOREDIS_ARENA_CHUNK_SIZE    (16 * 1024)
+#define PICOREDIS_EVENT_LOOP_MAX_EVENTS 256
+#define PICOREDIS_CLUSTER_SLOTS       16384
+#define PICOREDIS_CLUSTER_MAX_REDIRECTS 5
+#define PICOREDIS_SHARD_POINTS_PER_WEIGHT 160
+#define PICOREDIS_BATCH_CHUNK_SIZE    1024 // keys per command sent by the *_batch functions
+#define PICOREDIS_DOUBLE_BUFFER_SIZE  32 // longest formatted double plus '\0'
+#define PICOREDIS_BULK_CHUNK_BYTES    (256 * 1024) // argument bytes per command sent by the *_bulk functions
+#define PICOREDIS_STREAM_CHUNK_SIZE   (64 * 1024)
+#define PICOREDIS_WATCH_BACKOFF_USEC  1000  // first wait of picoredis_transaction_watch, doubled per retry
+#define PICOREDIS_WATCH_BACKOFF_MAX_USEC (100 * 1000)
+#define PICOREDIS_ZERO_COPY_THRESHOLD (64 * 1024) // values from this size on are not copied into send_buf
+#define PICOREDIS_URING_ENTRIES       8
+#define PICOREDIS_URING_BUFFER_NUM    16 // must be a power of 2
+#define PICOREDIS_URING_BUFFER_SIZE   (16 * 1024)
+
+typedef enum {
+    PICOREDIS_REPLY_SINGLE_LINE,
+    PICOREDIS_REPLY_ERROR,
+    PICOREDIS_REPLY_NUM,
+    PICOREDIS_REPLY_BULK,
+    PICOREDIS_REPLY_MULTI_BULK,
+} picoredis_reply_type;
+
+typedef enum {
+    PICOREDIS_READER_TYPE,
+    PICOREDIS_READER_LINE,
+    PICOREDIS_READER_NUMBER,
+    PICOREDIS_READER_LF,
+    PICOREDIS_READER_BULK,
+} picoredis_reader_state;
+
+// one token per RESP value, stored in pre-order.
+// offset is relative to the head of the reply in receive_buf.
+typedef struct {
+    picoredis_reply_type type;
+    size_t offset;
+    long long length;
+    long long integer;
+} picoredis_token_t;
+
+typedef struct {
+    picoredis_reader_state state;
+    size_t pos;
+    int sign;
+    unsigned long long number; // magnitude, sign holds the '-'
+    size_t bulk_remaining;
+    size_t depth;
+    long long remaining[PICOREDIS_READER_MAX_DEPTH];
+    picoredis_token_t *tokens;
+    size_t token_num;
+    size_t token_capacity;
+} picoredis_reader_t;
+
+// borrowed slice of receive_buf. it stays valid until the next read on the context.
+typedef struct {
+    const char *ptr;
+    size_t length;
+} picoredis_view_t;
+
+typedef struct {
+    picoredis_reply_type type;
+    int is_nil;
+    long long integer;
+    picoredis_view_t value;
+    size_t num;
+    picoredis_view_t *elements;
+} picoredis_reply_view_t;
+
+// a whole reply including nested arrays, e.g. the reply of EXEC. the tree,
+// its elements and strings share one allocation released by picoredis_reply_tree_free.
+typedef struct picoredis_reply_tree_t {
+    picoredis_reply_type type;
+    int is_nil;
+    long long integer;
+    picoredis_view_t value; // NUL terminated
+    size_t num;
+    struct picoredis_reply_tree_t *elements;
+} picoredis_reply_tree_t;
+
+typedef struct picoredis_arena_chunk_t {
+    struct picoredis_arena_chunk_t *next;
+    size_t size;
+    size_t used;
+} picoredis_arena_chunk_t;
+
+// bump allocator backing the replies returned by picoredis_get_reply.
+// it is rewound as soon as the last live reply is freed.
+typedef struct {
+    picoredis_arena_chunk_t *chunk;
+    size_t live_replies;
+} picoredis_arena_t;
+
+struct picoredis_t;
+struct picoredis_event_loop_t;
+struct picoredis_uring_t;
+
+typedef enum {
+    PICOREDIS_TRANSPORT_BLOCKING,
+    PICOREDIS_TRANSPORT_IO_URING,
+} picoredis_transport_type;
+
+// reply is NULL when the connection failed before the reply arrived.
+// it borrows receive_buf and is only valid while the callback runs.
+typedef void (*picoredis_callback_t)(struct picoredis_t *ctx, picoredis_reply_view_t *reply, void *privdata);
 
 typedef struct {
+    picoredis_callback_t callback;
+    void *privdata;
+} picoredis_callback_entry_t;
+
+// receives a streamed value piece by piece. returning non-zero stops the delivery
+// of the remaining pieces, which are then read and dropped.
+typedef int (*picoredis_stream_callback_t)(const char *data, size_t length, size_t value_length, void *privdata);
+
+typedef struct picoredis_t {
     const char *host;
     int port;
     const char *error;
     int sock;
     char *receive_buf;
+    size_t receive_buf_size;
+    size_t receive_begin;
+    size_t receive_end;
+    picoredis_reader_t reader;
+    char *send_buf;
+    size_t send_buf_size;
+    size_t send_length;
+    size_t pending_replies;
+    picoredis_view_t *views;
+    size_t view_capacity;
+    picoredis_reply_view_t reply_view;
+    picoredis_arena_t arena;
+    int async;
+    int connecting;
+    picoredis_callback_entry_t *callbacks; // ring of pending_replies entries starting at callback_head
+    size_t callback_capacity;
+    size_t callback_head;
+    struct picoredis_event_loop_t *event_loop;
+    int watched_events;
+    int in_callback;                 // picoredis_free only marks free_deferred while a callback runs
+    int free_deferred;
+    struct picoredis_uring_t *uring; // NULL when send() / recv() are used
+    size_t db;                       // last database chosen by picoredis_exec_select
+    int authenticated;
+    size_t pool_slot;
+    char (*scripts)[41];             // SHA1 of the scripts known to be loaded on the server
+    size_t script_num;
+    size_t script_capacity;
+    int variadic;                    // 0 unknown, 1 multi-member SADD/ZADD/RPUSH/LPUSH work, -1 redis < 2.4
 } picoredis_t;
 
+// a Lua script with its SHA1, computed once on the client
+typedef struct {
+    const char *body;
+    size_t length;
+    char sha1[41];
+} picoredis_script_t;
+
+// pulls the elements of a multi bulk reply off the socket one at a time.
+// nested arrays are walked depth first: the nested array itself is returned
+// as an element with its num set, followed by its members.
+typedef struct {
+    picoredis_t *ctx;
+    size_t depth;
+    long long remaining[PICOREDIS_READER_MAX_DEPTH];
+} picoredis_iterator_t;
+
+// connections are created lazily up to max_size and handed out through a
+// lock-free stack of slot indexes. the head packs a tag (upper 32 bits) with
+// slot + 1 (lower 32 bits, 0 means empty) so that a recycled head cannot ABA.
+typedef struct {
+    const char *host;
+    int port;
+    size_t min_size;
+    size_t max_size;
+    const char *password;
+    size_t db;
+    picoredis_t **connections;
+    unsigned *next;
+    unsigned long long free_head;
+    size_t size;
+    size_t waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+} picoredis_pool_t;
+
+typedef struct {
+    char *host;
+    int port;
+    picoredis_t *ctx; // connected on first use
+    size_t generation; // bumped whenever ctx is dropped
+} picoredis_cluster_node_t;
+
+// slots maps every hash slot to an index of nodes (-1 while unknown).
+// it is loaded from CLUSTER NODES and patched slot by slot on MOVED.
+typedef struct {
+    picoredis_cluster_node_t *nodes;
+    size_t node_num;
+    size_t node_capacity;
+    short slots[PICOREDIS_CLUSTER_SLOTS];
+    const char *error;
+} picoredis_cluster_t;
+
+typedef struct {
+    unsigned slot;
+    size_t index;
+} picoredis_cluster_key_t;
+
+typedef struct {
+    char *name; // hashed onto the ring, so a node keeps its keys when its address changes
+    char *host;
+    int port;
+    size_t weight;
+    int removed;
+    picoredis_t *ctx; // connected on first use
+} picoredis_shard_node_t;
+
+typedef struct {
+    unsigned hash;
+    size_t node;
+} picoredis_shard_point_t;
+
+// ketama style consistent hashing: every node owns weight * PICOREDIS_SHARD_POINTS_PER_WEIGHT
+// points on a 32-bit ring and a key belongs to the first point at or after its hash.
+typedef struct {
+    picoredis_shard_node_t *nodes;
+    size_t node_num;
+    size_t node_capacity;
+    picoredis_shard_point_t *points;
+    size_t point_num;
+    const char *error;
+} picoredis_shard_t;
+
+#ifdef PICOREDIS_HAS_IO_URING
+typedef struct picoredis_uring_t {
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_entries;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;
+    // provided buffer ring registered with the kernel, followed by the buffers themselves
+    struct io_uring_buf_ring *buf_ring;
+    char *buffers;
+    size_t buf_region_size;
+    unsigned short buf_tail;
+    int recv_armed;
+    int closed;
+    int send_inflight;
+    int send_result;
+    size_t enter_count;
+} picoredis_uring_t;
+#endif
+
+#ifdef __linux__
+typedef struct picoredis_event_loop_t {
+    int epfd;
+    size_t num;
+    int ready_num; // events of the batch picoredis_event_loop_run_once is dispatching
+    struct epoll_event events[PICOREDIS_EVENT_LOOP_MAX_EVENTS];
+} picoredis_event_loop_t;
+#endif
+
 typedef struct {
     int num;
     const char **values;
+    size_t *lengths;
 } picoredis_array_t;
 
-typedef enum {
-    PICOREDIS_REPLY_SINGLE_LINE,
-    PICOREDIS_REPLY_ERROR,
-    PICOREDIS_REPLY_NUM,
-    PICOREDIS_REPLY_BULK,
-    PICOREDIS_REPLY_MULTI_BULK,
-} picoredis_reply_type;
+// HGETALL decoded into one block: the fields and values point into the data
+// at its end and are looked up through an open addressing table of
+// indexes + 1 (0 is empty).
+typedef struct {
+    size_t num;
+    picoredis_view_t *fields;
+    picoredis_view_t *values;
+    size_t table_size; // power of 2, at least twice num
+    size_t *table;
+} picoredis_hash_t;
 
 typedef struct {
     picoredis_reply_type type;
@@ -50,6 +355,7 @@ typedef struct {
         int ivalue;
         picoredis_array_t *avalue;
     } v;
+    picoredis_arena_t *arena;
 } picoredis_reply_t;
 
 #define COMMAND_TYPE_DEF(type) PICOREDIS_ ## type
@@ -170,6 +476,19 @@ typedef enum {
     COMMAND_TYPE_DEF(SLAVEOF),
     COMMAND_TYPE_DEF(CONFIG),
 
+    COMMAND_TYPE_DEF(CLUSTER),
+    COMMAND_TYPE_DEF(ASKING),
+    COMMAND_TYPE_DEF(SCAN),
+    COMMAND_TYPE_DEF(SSCAN),
+    COMMAND_TYPE_DEF(HSCAN),
+    COMMAND_TYPE_DEF(ZSCAN),
+    COMMAND_TYPE_DEF(EVAL),
+    COMMAND_TYPE_DEF(EVALSHA),
+    COMMAND_TYPE_DEF(SCRIPT),
+    COMMAND_TYPE_DEF(PSUBSCRIBE),
+    COMMAND_TYPE_DEF(PUNSUBSCRIBE),
+    COMMAND_TYPE_DEF(BRPOPLPUSH),
+
     COMMAND_TYPE_DEF(NONE),
 } picoredis_command_type;
 
@@ -177,14 +496,122 @@ typedef struct {
     picoredis_command_type type;
     const char *name;
     size_t name_length;
+    const char *header;
+    size_t header_length;
 } picoredis_command_type_t;
 
+// one command submitted to a picoredis_mux_t. it lives on the stack of the
+// submitting thread, which blocks until done is set. the reply fields are
+// copies owned by the caller, see picoredis_mux_request_release.
+typedef struct picoredis_mux_request_t {
+    struct picoredis_mux_request_t *next;
+    picoredis_command_type type;
+    size_t nargs;
+    const char **values;
+    const size_t *lengths;
+    int done;
+    const char *error;
+    picoredis_reply_type reply_type;
+    int is_nil;
+    long long integer;
+    char *value; // also set for simple string and error replies
+    size_t length;
+    picoredis_array_t *array;
+} picoredis_mux_request_t;
+
+// shares one connection between threads. submitters push onto a lock-free
+// stack; whichever thread takes the flusher role writes everything queued
+// with one send and completes replies in FIFO order.
+typedef struct {
+    picoredis_t *ctx;
+    picoredis_mux_request_t *queue; // newest first
+    int flushing;
+    picoredis_mux_request_t *inflight_head; // only touched by the flusher
+    picoredis_mux_request_t *inflight_tail;
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+} picoredis_mux_t;
+
+// receives a published message. the views borrow the receive buffer and are
+// only valid during the call. pattern is NULL for channel subscriptions.
+typedef void (*picoredis_message_callback_t)(const picoredis_view_t *channel, const picoredis_view_t *message, const picoredis_view_t *pattern, void *privdata);
+
+typedef struct {
+    char *name;
+    size_t length;
+    int is_pattern;
+    picoredis_message_callback_t callback;
+    void *privdata;
+} picoredis_subscription_t;
+
+// a connection in subscribed mode. subscriptions are found through an open
+// addressing table of indexes + 1 (0 is empty) so that dispatching a message
+// neither allocates nor compares every channel name.
+typedef struct {
+    picoredis_t *ctx;
+    picoredis_subscription_t *subscriptions;
+    size_t num;
+    size_t capacity;
+    size_t *table;
+    size_t table_size; // power of 2, at least twice num
+    long long server_count; // subscriptions the server reported last
+} picoredis_subscriber_t;
+
+// handles one queue item. the views are only valid during the call.
+// returning 0 acknowledges the item, anything else leaves it in the
+// processing list of a reliable queue.
+typedef int (*picoredis_queue_callback_t)(const picoredis_view_t *list, const picoredis_view_t *item, void *privdata);
+
+// a work queue consumer on its own connection. producers LPUSH and the
+// consumer pops the tail, so items are handled in FIFO order.
+typedef struct {
+    picoredis_t *ctx;
+    char **lists;
+    size_t list_num;
+    char *processing; // reliable queues only: RPOPLPUSH destination
+    size_t batch_size;
+    int timeout;      // seconds, 0 blocks for ever
+} picoredis_queue_t;
+
+// MULTI, the queued commands and EXEC are buffered and written in one flush
+typedef struct {
+    picoredis_t *ctx;
+    size_t command_num;
+    size_t send_start;    // send_length before MULTI, used to discard
+    size_t pending_start;
+    int failed;
+} picoredis_transaction_t;
+
+// queues the commands of a transaction after reading the watched keys.
+// returning non-zero gives up without executing it.
+typedef int (*picoredis_transaction_fn_t)(picoredis_t *ctx, picoredis_transaction_t *tx, void *privdata);
+
+// cursor of a SCAN / SSCAN / HSCAN / ZSCAN iteration. the request for the next
+// batch is sent as soon as the cursor of the current one is known, so the
+// server works on it while the current elements are consumed.
+typedef struct {
+    picoredis_t *ctx;
+    picoredis_command_type type;
+    const char *key;   // NULL for SCAN
+    const char *match; // NULL for no MATCH
+    size_t count;      // 0 for no COUNT
+    char cursor[24];
+    int started;
+    int requested;     // a request for the next batch is in flight
+    picoredis_iterator_t iter;
+} picoredis_scan_t;
+
+// receives one element of a scan. returning non-zero stops the scan.
+typedef int (*picoredis_scan_callback_t)(picoredis_t *ctx, const picoredis_view_t *element, void *privdata);
+
 #define PICOREDIS_PUBLIC_API  static
 #define PICOREDIS_PRIVATE_API static
 
 PICOREDIS_PUBLIC_API picoredis_t *picoredis_alloc(void);
 PICOREDIS_PUBLIC_API picoredis_t *picoredis_connect_with_address(const char *address);
 PICOREDIS_PUBLIC_API picoredis_t *picoredis_connect(const char *host, int port);
+PICOREDIS_PUBLIC_API picoredis_t *picoredis_connect_with_transport(const char *host, int port, picoredis_transport_type transport);
+PICOREDIS_PUBLIC_API picoredis_transport_type picoredis_get_transport(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API void picoredis_free(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API void picoredis_error(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_has_error(picoredis_t *ctx);
@@ -193,6 +620,95 @@ PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_array_alloc(int num);
 PICOREDIS_PUBLIC_API void picoredis_array_free(picoredis_array_t *array);
 PICOREDIS_PUBLIC_API size_t picoredis_array_num(picoredis_array_t *array);
 PICOREDIS_PUBLIC_API const char *picoredis_array_get(picoredis_array_t *array, int idx);
+PICOREDIS_PUBLIC_API size_t picoredis_array_get_length(picoredis_array_t *array, int idx);
+PICOREDIS_PUBLIC_API size_t picoredis_hash_num(const picoredis_hash_t *hash);
+PICOREDIS_PUBLIC_API const picoredis_view_t *picoredis_hash_get(const picoredis_hash_t *hash, const char *field);
+PICOREDIS_PUBLIC_API const picoredis_view_t *picoredis_hash_get_binary(const picoredis_hash_t *hash, const void *field, size_t field_length);
+PICOREDIS_PUBLIC_API void picoredis_hash_free(picoredis_hash_t *hash);
+PICOREDIS_PUBLIC_API void picoredis_reply_free(picoredis_reply_t *reply);
+PICOREDIS_PUBLIC_API void picoredis_reply_reset(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API void picoredis_reply_tree_free(picoredis_reply_tree_t *tree);
+
+PICOREDIS_PUBLIC_API int picoredis_append_command(picoredis_t *ctx, picoredis_command_type type, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_append_command_argv(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PUBLIC_API int picoredis_flush(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API picoredis_reply_t *picoredis_get_reply(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API size_t picoredis_pending_replies(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_get_reply_view(picoredis_t *ctx, picoredis_reply_view_t *view);
+PICOREDIS_PUBLIC_API picoredis_reply_tree_t *picoredis_get_reply_tree(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API picoredis_reply_tree_t *picoredis_exec_argv_tree(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PUBLIC_API int picoredis_exec_argv_view(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_reply_view_t *view);
+PICOREDIS_PUBLIC_API int picoredis_exec_argv_iter(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_iterator_t *iter);
+PICOREDIS_PUBLIC_API int picoredis_iterator_begin(picoredis_t *ctx, picoredis_iterator_t *iter);
+PICOREDIS_PUBLIC_API int picoredis_iterator_next(picoredis_iterator_t *iter, picoredis_reply_view_t *element);
+PICOREDIS_PUBLIC_API void picoredis_iterator_close(picoredis_iterator_t *iter);
+
+PICOREDIS_PUBLIC_API picoredis_t *picoredis_async_connect(const char *host, int port);
+PICOREDIS_PUBLIC_API int picoredis_async_command(picoredis_t *ctx, picoredis_callback_t callback, void *privdata, picoredis_command_type type, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_async_command_argv(picoredis_t *ctx, picoredis_callback_t callback, void *privdata, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PUBLIC_API int picoredis_async_fd(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_async_events(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_async_handle_events(picoredis_t *ctx, int revents);
+#ifdef __linux__
+PICOREDIS_PUBLIC_API picoredis_event_loop_t *picoredis_event_loop_create(void);
+PICOREDIS_PUBLIC_API void picoredis_event_loop_free(picoredis_event_loop_t *loop);
+PICOREDIS_PUBLIC_API int picoredis_event_loop_add(picoredis_event_loop_t *loop, picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_event_loop_remove(picoredis_event_loop_t *loop, picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_event_loop_run_once(picoredis_event_loop_t *loop, int timeout_ms);
+#endif
+
+PICOREDIS_PUBLIC_API picoredis_pool_t *picoredis_pool_create(const char *host, int port, size_t min_size, size_t max_size);
+PICOREDIS_PUBLIC_API void picoredis_pool_free(picoredis_pool_t *pool);
+PICOREDIS_PUBLIC_API void picoredis_pool_set_auth(picoredis_pool_t *pool, const char *password);
+PICOREDIS_PUBLIC_API void picoredis_pool_set_db(picoredis_pool_t *pool, size_t db);
+PICOREDIS_PUBLIC_API picoredis_t *picoredis_pool_checkout(picoredis_pool_t *pool);
+PICOREDIS_PUBLIC_API void picoredis_pool_checkin(picoredis_pool_t *pool, picoredis_t *ctx);
+PICOREDIS_PUBLIC_API size_t picoredis_pool_size(picoredis_pool_t *pool);
+PICOREDIS_PUBLIC_API int picoredis_exec_with_pool(picoredis_pool_t *pool, int (*fn)(picoredis_t *ctx, void *arg), void *arg);
+PICOREDIS_PUBLIC_API void picoredis_pool_exec_set(picoredis_pool_t *pool, const char *key, const char *value);
+PICOREDIS_PUBLIC_API char *picoredis_pool_exec_get(picoredis_pool_t *pool, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_pool_exec_incr(picoredis_pool_t *pool, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_pool_exec_del(picoredis_pool_t *pool, const char *key);
+
+PICOREDIS_PUBLIC_API picoredis_mux_t *picoredis_mux_connect(const char *host, int port);
+PICOREDIS_PUBLIC_API void picoredis_mux_free(picoredis_mux_t *mux);
+PICOREDIS_PUBLIC_API int picoredis_mux_exec_argv(picoredis_mux_t *mux, picoredis_mux_request_t *request, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PUBLIC_API void picoredis_mux_request_release(picoredis_mux_request_t *request);
+PICOREDIS_PUBLIC_API int picoredis_mux_exec_set(picoredis_mux_t *mux, const char *key, const char *value);
+PICOREDIS_PUBLIC_API char *picoredis_mux_exec_get(picoredis_mux_t *mux, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_mux_exec_incr(picoredis_mux_t *mux, const char *key);
+
+PICOREDIS_PUBLIC_API unsigned picoredis_cluster_keyslot(const void *key, size_t length);
+PICOREDIS_PUBLIC_API picoredis_cluster_t *picoredis_cluster_connect(const char *host, int port);
+PICOREDIS_PUBLIC_API void picoredis_cluster_free(picoredis_cluster_t *cluster);
+PICOREDIS_PUBLIC_API int picoredis_cluster_has_error(picoredis_cluster_t *cluster);
+PICOREDIS_PUBLIC_API int picoredis_cluster_refresh(picoredis_cluster_t *cluster);
+PICOREDIS_PUBLIC_API int picoredis_cluster_exec_argv_view(picoredis_cluster_t *cluster, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_reply_view_t *view);
+PICOREDIS_PUBLIC_API void picoredis_cluster_exec_set(picoredis_cluster_t *cluster, const char *key, const char *value);
+PICOREDIS_PUBLIC_API char *picoredis_cluster_exec_get(picoredis_cluster_t *cluster, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_cluster_exec_incr(picoredis_cluster_t *cluster, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_cluster_exec_del(picoredis_cluster_t *cluster, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_cluster_exec_mset(picoredis_cluster_t *cluster, size_t nargs, ...);
+
+PICOREDIS_PUBLIC_API picoredis_shard_t *picoredis_shard_create(void);
+PICOREDIS_PUBLIC_API void picoredis_shard_free(picoredis_shard_t *shard);
+PICOREDIS_PUBLIC_API int picoredis_shard_add_node(picoredis_shard_t *shard, const char *name, const char *host, int port, size_t weight);
+PICOREDIS_PUBLIC_API int picoredis_shard_remove_node(picoredis_shard_t *shard, const char *name);
+PICOREDIS_PUBLIC_API int picoredis_shard_get_node(picoredis_shard_t *shard, const void *key, size_t length);
+PICOREDIS_PUBLIC_API picoredis_t *picoredis_shard_get_ctx(picoredis_shard_t *shard, const char *key);
+PICOREDIS_PUBLIC_API void picoredis_shard_exec_set(picoredis_shard_t *shard, const char *key, const char *value);
+PICOREDIS_PUBLIC_API char *picoredis_shard_exec_get(picoredis_shard_t *shard, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_shard_exec_del(picoredis_shard_t *shard, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_shard_exec_mset(picoredis_shard_t *shard, size_t nargs, ...);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_shard_exec_mget(picoredis_shard_t *shard, size_t nargs, ...);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_shard_exec_mget_argv(picoredis_shard_t *shard, size_t nargs, const char **keys);
+PICOREDIS_PUBLIC_API int picoredis_shard_scan(picoredis_shard_t *shard, const char *match, size_t count, picoredis_scan_callback_t callback, void *privdata);
+
+PICOREDIS_PUBLIC_API void picoredis_scan_init(picoredis_scan_t *scan, picoredis_t *ctx, picoredis_command_type type, const char *key, const char *match, size_t count);
+PICOREDIS_PUBLIC_API int picoredis_scan_next(picoredis_scan_t *scan, picoredis_reply_view_t *element);
+PICOREDIS_PUBLIC_API int picoredis_scan_batch(picoredis_scan_t *scan, picoredis_scan_callback_t callback, void *privdata);
+PICOREDIS_PUBLIC_API void picoredis_scan_close(picoredis_scan_t *scan);
+PICOREDIS_PUBLIC_API int picoredis_scan_parallel(picoredis_t **ctxs, size_t ctx_num, const char *match, size_t count, picoredis_scan_callback_t callback, void *privdata);
 
 PICOREDIS_PUBLIC_API void picoredis_exec_quit(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_auth(picoredis_t *ctx, const char *password);
@@ -200,6 +716,7 @@ PICOREDIS_PUBLIC_API int picoredis_exec_exists(picoredis_t *ctx, const char *key
 PICOREDIS_PUBLIC_API int picoredis_exec_del(picoredis_t *ctx, size_t nargs, ...);
 PICOREDIS_PUBLIC_API char *picoredis_exec_type(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_keys(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_exec_keys_iter(picoredis_t *ctx, const char *key, picoredis_iterator_t *iter);
 PICOREDIS_PUBLIC_API char *picoredis_exec_randomkey(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_rename(picoredis_t *ctx, const char *oldkey, const char *newkey);
 PICOREDIS_PUBLIC_API int picoredis_exec_renamenx(picoredis_t *ctx, const char *oldkey, const char *newkey);
@@ -217,7 +734,33 @@ PICOREDIS_PUBLIC_API int picoredis_exec_unwatch(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_multi(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_exec(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_discard(picoredis_t *ctx);
+PICOREDIS_PUBLIC_API void picoredis_transaction_begin(picoredis_transaction_t *tx, picoredis_t *ctx);
+PICOREDIS_PUBLIC_API int picoredis_transaction_append(picoredis_transaction_t *tx, picoredis_command_type type, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_transaction_append_argv(picoredis_transaction_t *tx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PUBLIC_API int picoredis_transaction_exec(picoredis_transaction_t *tx, picoredis_reply_tree_t **replies);
+PICOREDIS_PUBLIC_API void picoredis_transaction_discard(picoredis_transaction_t *tx);
+PICOREDIS_PUBLIC_API int picoredis_transaction_watch(picoredis_t *ctx, size_t key_num, const char **keys, size_t max_attempts, picoredis_transaction_fn_t fn, void *privdata, picoredis_reply_tree_t **replies);
+PICOREDIS_PUBLIC_API long long picoredis_exec_publish(picoredis_t *ctx, const char *channel, const char *message);
+PICOREDIS_PUBLIC_API long long picoredis_exec_publish_batch(picoredis_t *ctx, size_t num, const picoredis_view_t *channels, const picoredis_view_t *messages);
+PICOREDIS_PUBLIC_API picoredis_subscriber_t *picoredis_subscriber_connect(const char *host, int port);
+PICOREDIS_PUBLIC_API void picoredis_subscriber_free(picoredis_subscriber_t *sub);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_subscribe(picoredis_subscriber_t *sub, const char *channel, picoredis_message_callback_t callback, void *privdata);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_psubscribe(picoredis_subscriber_t *sub, const char *pattern, picoredis_message_callback_t callback, void *privdata);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_unsubscribe(picoredis_subscriber_t *sub, const char *channel);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_punsubscribe(picoredis_subscriber_t *sub, const char *pattern);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_dispatch(picoredis_subscriber_t *sub, int timeout_ms);
+PICOREDIS_PUBLIC_API int picoredis_subscriber_run(picoredis_subscriber_t *sub);
+PICOREDIS_PUBLIC_API picoredis_queue_t *picoredis_queue_connect(const char *host, int port, size_t list_num, const char **lists, size_t batch_size, int timeout);
+PICOREDIS_PUBLIC_API int picoredis_queue_set_processing(picoredis_queue_t *queue, const char *processing);
+PICOREDIS_PUBLIC_API void picoredis_queue_free(picoredis_queue_t *queue);
+PICOREDIS_PUBLIC_API int picoredis_queue_poll(picoredis_queue_t *queue, picoredis_queue_callback_t callback, void *privdata);
+PICOREDIS_PUBLIC_API long long picoredis_queue_requeue(picoredis_queue_t *queue);
+PICOREDIS_PUBLIC_API void picoredis_script_init(picoredis_script_t *script, const char *body);
+PICOREDIS_PUBLIC_API int picoredis_script_load(picoredis_t *ctx, picoredis_script_t *script);
+PICOREDIS_PUBLIC_API picoredis_reply_tree_t *picoredis_exec_script(picoredis_t *ctx, picoredis_script_t *script, size_t key_num, const char **keys, size_t arg_num, const char **args);
+PICOREDIS_PUBLIC_API int picoredis_exec_script_flush(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_sort(picoredis_t *ctx, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_exec_sort_iter(picoredis_t *ctx, picoredis_iterator_t *iter, size_t nargs, ...);
 PICOREDIS_PUBLIC_API void picoredis_exec_set(picoredis_t *ctx, const char *key, const char *value);
 PICOREDIS_PUBLIC_API char *picoredis_exec_get(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API char *picoredis_exec_getset(picoredis_t *ctx, const char *key, const char *value);
@@ -225,16 +768,33 @@ PICOREDIS_PUBLIC_API int picoredis_exec_setnx(picoredis_t *ctx, const char *key,
 PICOREDIS_PUBLIC_API int picoredis_exec_setex(picoredis_t *ctx, const char *key, time_t time, const char *value);
 PICOREDIS_PUBLIC_API int picoredis_exec_mset(picoredis_t *ctx, size_t nargs, ...);
 PICOREDIS_PUBLIC_API int picoredis_exec_msetnx(picoredis_t *ctx, size_t nargs, ...);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_mget(picoredis_t *ctx, size_t nargs, ...);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_mget_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys);
+PICOREDIS_PUBLIC_API int picoredis_exec_mset_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys, const picoredis_view_t *values);
+PICOREDIS_PUBLIC_API long long picoredis_exec_del_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys);
+PICOREDIS_PUBLIC_API long long picoredis_exec_exists_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys);
+PICOREDIS_PUBLIC_API long long picoredis_exec_sadd_bulk(picoredis_t *ctx, const char *key, size_t member_num, const picoredis_view_t *members);
+PICOREDIS_PUBLIC_API long long picoredis_exec_zadd_bulk(picoredis_t *ctx, const char *key, size_t member_num, const double *scores, const picoredis_view_t *members);
+PICOREDIS_PUBLIC_API long long picoredis_exec_rpush_bulk(picoredis_t *ctx, const char *key, size_t value_num, const picoredis_view_t *values);
+PICOREDIS_PUBLIC_API long long picoredis_exec_lpush_bulk(picoredis_t *ctx, const char *key, size_t value_num, const picoredis_view_t *values);
+PICOREDIS_PUBLIC_API int picoredis_exec_hset_bulk(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values);
 PICOREDIS_PUBLIC_API int picoredis_exec_incr(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API int picoredis_exec_incrby(picoredis_t *ctx, const char *key, int value);
 PICOREDIS_PUBLIC_API int picoredis_exec_decr(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API int picoredis_exec_decrby(picoredis_t *ctx, const char *key, int value);
+PICOREDIS_PUBLIC_API int64_t picoredis_exec_incr_int64(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API int64_t picoredis_exec_incrby_int64(picoredis_t *ctx, const char *key, int64_t value);
+PICOREDIS_PUBLIC_API int64_t picoredis_exec_decr_int64(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API int64_t picoredis_exec_decrby_int64(picoredis_t *ctx, const char *key, int64_t value);
+PICOREDIS_PUBLIC_API int picoredis_exec_get_int64(picoredis_t *ctx, const char *key, int64_t *value);
+PICOREDIS_PUBLIC_API int picoredis_exec_get_double(picoredis_t *ctx, const char *key, double *value);
 PICOREDIS_PUBLIC_API int picoredis_exec_append(picoredis_t *ctx, const char *key, const char *value);
 PICOREDIS_PUBLIC_API char *picoredis_exec_substr(picoredis_t *ctx, const char *key, int start, int end);
 PICOREDIS_PUBLIC_API int picoredis_exec_lpush(picoredis_t *ctx, const char *key, const char *value);
 PICOREDIS_PUBLIC_API int picoredis_exec_rpush(picoredis_t *ctx, const char *key, const char *value);
 PICOREDIS_PUBLIC_API int picoredis_exec_llen(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_lrange(picoredis_t *ctx, const char *key, int start, int end);
+PICOREDIS_PUBLIC_API int picoredis_exec_lrange_iter(picoredis_t *ctx, const char *key, int start, int end, picoredis_iterator_t *iter);
 PICOREDIS_PUBLIC_API int picoredis_exec_ltrim(picoredis_t *ctx, const char *key, int start, int end);
 PICOREDIS_PUBLIC_API char *picoredis_exec_lindex(picoredis_t *ctx, const char *key, int index);
 PICOREDIS_PUBLIC_API int picoredis_exec_lset(picoredis_t *ctx, const char *key, int index, const char *value);
@@ -255,13 +815,16 @@ PICOREDIS_PUBLIC_API int picoredis_exec_sunionstore(picoredis_t *ctx, size_t nar
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_sdiff(picoredis_t *ctx, size_t nargs, ...);
 PICOREDIS_PUBLIC_API int picoredis_exec_sdiffstore(picoredis_t *ctx, size_t nargs, ...);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_smembers(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API int picoredis_exec_smembers_iter(picoredis_t *ctx, const char *key, picoredis_iterator_t *iter);
 PICOREDIS_PUBLIC_API char *picoredis_exec_srandmember(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API int picoredis_exec_zadd(picoredis_t *ctx, const char *key, double score, const char *member);
 PICOREDIS_PUBLIC_API int picoredis_exec_zrem(picoredis_t *ctx, const char *key, const char *member);
 PICOREDIS_PUBLIC_API char *picoredis_exec_zincrby(picoredis_t *ctx, const char *key, double incr, const char *member);
+PICOREDIS_PUBLIC_API int picoredis_exec_zincrby_double(picoredis_t *ctx, const char *key, double incr, const char *member, double *score);
 PICOREDIS_PUBLIC_API int picoredis_exec_zrank(picoredis_t *ctx, const char *key, const char *member);
 PICOREDIS_PUBLIC_API int picoredis_exec_zrevrank(picoredis_t *ctx, const char *key, const char *member);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_zrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score);
+PICOREDIS_PUBLIC_API int picoredis_exec_zrange_iter(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score, picoredis_iterator_t *iter);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_zrevrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score);
 PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_zrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max, int is_with_score);
 PICOREDIS_PUBLIC_API int picoredis_exec_zcount(picoredis_t *ctx, const char *key, const char *min, const char *max);
@@ -269,8 +832,23 @@ PICOREDIS_PUBLIC_API int picoredis_exec_zremrangebyrank(picoredis_t *ctx, const
 PICOREDIS_PUBLIC_API int picoredis_exec_zremrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max);
 PICOREDIS_PUBLIC_API int picoredis_exec_zcard(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API char *picoredis_exec_zscore(picoredis_t *ctx, const char *key, const char *member);
+PICOREDIS_PUBLIC_API int picoredis_exec_zscore_double(picoredis_t *ctx, const char *key, const char *member, double *score);
 PICOREDIS_PUBLIC_API int picoredis_exec_zunionstore(picoredis_t *ctx, size_t nargs, ...);
 PICOREDIS_PUBLIC_API int picoredis_exec_zinterstore(picoredis_t *ctx, size_t nargs, ...);
+PICOREDIS_PUBLIC_API int picoredis_exec_hset(picoredis_t *ctx, const char *key, const char *field, const char *value);
+PICOREDIS_PUBLIC_API int picoredis_exec_hset_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *field, size_t field_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API char *picoredis_exec_hget(picoredis_t *ctx, const char *key, const char *field);
+PICOREDIS_PUBLIC_API char *picoredis_exec_hget_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *field, size_t field_length, size_t *value_length);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_hmget(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields);
+PICOREDIS_PUBLIC_API int picoredis_exec_hmset(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values);
+PICOREDIS_PUBLIC_API int picoredis_exec_hincrby(picoredis_t *ctx, const char *key, const char *field, int value);
+PICOREDIS_PUBLIC_API int64_t picoredis_exec_hincrby_int64(picoredis_t *ctx, const char *key, const char *field, int64_t value);
+PICOREDIS_PUBLIC_API int picoredis_exec_hexists(picoredis_t *ctx, const char *key, const char *field);
+PICOREDIS_PUBLIC_API int picoredis_exec_hdel(picoredis_t *ctx, const char *key, const char *field);
+PICOREDIS_PUBLIC_API int picoredis_exec_hlen(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_hkeys(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API picoredis_array_t *picoredis_exec_hvals(picoredis_t *ctx, const char *key);
+PICOREDIS_PUBLIC_API picoredis_hash_t *picoredis_exec_hgetall(picoredis_t *ctx, const char *key);
 PICOREDIS_PUBLIC_API int picoredis_exec_save(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_bgsave(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API int picoredis_exec_bgrewriteaof(picoredis_t *ctx);
@@ -278,21 +856,148 @@ PICOREDIS_PUBLIC_API int picoredis_exec_lastsave(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API void picoredis_exec_shutdown(picoredis_t *ctx);
 PICOREDIS_PUBLIC_API char *picoredis_exec_info(picoredis_t *ctx);
 
-
+PICOREDIS_PUBLIC_API void picoredis_exec_set_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_set_iov(picoredis_t *ctx, const void *key, size_t key_length, const struct iovec *value, size_t value_iovcnt);
+PICOREDIS_PUBLIC_API int picoredis_exec_set_file(picoredis_t *ctx, const void *key, size_t key_length, int fd, off_t offset, size_t length);
+PICOREDIS_PUBLIC_API char *picoredis_exec_get_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length);
+PICOREDIS_PUBLIC_API char *picoredis_exec_getset_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length, size_t *old_value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_setnx_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_setex_binary(picoredis_t *ctx, const void *key, size_t key_length, time_t time, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_append_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_lpush_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_rpush_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length);
+PICOREDIS_PUBLIC_API char *picoredis_exec_lpop_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length);
+PICOREDIS_PUBLIC_API char *picoredis_exec_rpop_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_sadd_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_srem_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_sismember_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length);
+
+PICOREDIS_PUBLIC_API int picoredis_exec_get_view(picoredis_t *ctx, const void *key, size_t key_length, picoredis_view_t *value);
+PICOREDIS_PUBLIC_API ssize_t picoredis_exec_get_into(picoredis_t *ctx, const void *key, size_t key_length, void *buf, size_t bufsize);
+PICOREDIS_PUBLIC_API int picoredis_exec_get_stream(picoredis_t *ctx, const void *key, size_t key_length, picoredis_stream_callback_t callback, void *privdata);
+PICOREDIS_PUBLIC_API int picoredis_exec_get_to_fd(picoredis_t *ctx, const void *key, size_t key_length, int fd, size_t *value_length);
+PICOREDIS_PUBLIC_API int picoredis_exec_smembers_view(picoredis_t *ctx, const void *key, size_t key_length, picoredis_reply_view_t *view);
+PICOREDIS_PUBLIC_API int picoredis_exec_lrange_view(picoredis_t *ctx, const void *key, size_t key_length, int start, int end, picoredis_reply_view_t *view);
+
+
+PICOREDIS_PRIVATE_API picoredis_array_t *picoredis_array_create(size_t num, size_t data_size);
+PICOREDIS_PRIVATE_API void *picoredis_arena_alloc(picoredis_arena_t *arena, size_t size);
+PICOREDIS_PRIVATE_API void picoredis_arena_reset(picoredis_arena_t *arena);
+PICOREDIS_PRIVATE_API void picoredis_arena_free(picoredis_arena_t *arena);
 PICOREDIS_PRIVATE_API int picoredis_connect_with_ctx(picoredis_t *ctx, const char *host, int port);
-PICOREDIS_PRIVATE_API size_t picoredis_total_args_length(int nargs, size_t *lengths);
-PICOREDIS_PRIVATE_API char *picoredis_parse_command_args(int nargs, size_t *lengths, const char **values);
-PICOREDIS_PRIVATE_API picoredis_command_type_t picoredis_get_command_type(picoredis_command_type type);
-PICOREDIS_PRIVATE_API size_t picoredis_command_header_size(size_t nargs, picoredis_command_type_t *type);
-PICOREDIS_PRIVATE_API char *picoredis_command_create(picoredis_command_type type, size_t nargs, size_t *lengths, const char **values);
-PICOREDIS_PRIVATE_API int picoredis_send_command(picoredis_t *ctx, char *command);
+PICOREDIS_PRIVATE_API size_t picoredis_count_digits(unsigned long long value);
+PICOREDIS_PRIVATE_API size_t picoredis_format_uint(char *dst, unsigned long long value);
+PICOREDIS_PRIVATE_API size_t picoredis_format_int(char *dst, long long value);
+PICOREDIS_PRIVATE_API size_t picoredis_format_double(char *dst, double value);
+PICOREDIS_PRIVATE_API int picoredis_parse_int64(const char *ptr, size_t length, int64_t *value);
+PICOREDIS_PRIVATE_API int picoredis_parse_header_number(char type, const char *ptr, size_t length, long long *number);
+PICOREDIS_PRIVATE_API int picoredis_parse_double(const char *ptr, size_t length, double *value);
+PICOREDIS_PRIVATE_API int picoredis_reply_view_int64(picoredis_t *ctx, picoredis_reply_view_t *view, int64_t *value);
+PICOREDIS_PRIVATE_API int picoredis_reply_view_double(picoredis_t *ctx, picoredis_reply_view_t *view, double *value);
+PICOREDIS_PRIVATE_API const picoredis_command_type_t *picoredis_get_command_type(picoredis_command_type type);
+PICOREDIS_PRIVATE_API int picoredis_command_encode(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PRIVATE_API int picoredis_command_encode_head(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, size_t last_length);
+PICOREDIS_PRIVATE_API int picoredis_send_iov(picoredis_t *ctx, struct iovec *iov, size_t iovcnt);
+PICOREDIS_PRIVATE_API int picoredis_send_file(picoredis_t *ctx, int fd, off_t offset, size_t length);
+PICOREDIS_PRIVATE_API int picoredis_exec_set_finish(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_reserve_send_buf(picoredis_t *ctx, size_t size);
+PICOREDIS_PRIVATE_API int picoredis_reserve_receive_buf(picoredis_t *ctx, size_t size);
+PICOREDIS_PRIVATE_API int picoredis_receive_more(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_disconnect(picoredis_t *ctx, const char *error);
+#ifdef PICOREDIS_HAS_IO_URING
+PICOREDIS_PRIVATE_API picoredis_uring_t *picoredis_uring_create(void);
+PICOREDIS_PRIVATE_API void picoredis_uring_free(picoredis_uring_t *uring);
+PICOREDIS_PRIVATE_API int picoredis_uring_queue(picoredis_uring_t *uring, int opcode, int fd, const void *addr, size_t length, int flags, int ioprio, unsigned long long user_data);
+PICOREDIS_PRIVATE_API int picoredis_uring_enter(picoredis_t *ctx, unsigned wait);
+PICOREDIS_PRIVATE_API void picoredis_uring_recycle(picoredis_uring_t *uring, unsigned short bid);
+PICOREDIS_PRIVATE_API int picoredis_uring_reap(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_uring_arm_recv(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_uring_flush(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_uring_receive(picoredis_t *ctx);
+#endif
+PICOREDIS_PRIVATE_API int picoredis_async_push_callback(picoredis_t *ctx, picoredis_callback_t callback, void *privdata);
+PICOREDIS_PRIVATE_API int picoredis_async_write(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_async_invoke(picoredis_t *ctx, picoredis_callback_entry_t entry, picoredis_reply_view_t *reply);
+PICOREDIS_PRIVATE_API int picoredis_async_read(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_async_fail(picoredis_t *ctx, const char *error);
+PICOREDIS_PRIVATE_API void picoredis_async_update_events(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_pool_push(picoredis_pool_t *pool, size_t slot);
+PICOREDIS_PRIVATE_API int picoredis_pool_pop(picoredis_pool_t *pool, size_t *slot);
+PICOREDIS_PRIVATE_API int picoredis_pool_prepare(picoredis_pool_t *pool, picoredis_t *ctx);
+PICOREDIS_PRIVATE_API picoredis_t *picoredis_pool_grow(picoredis_pool_t *pool);
+PICOREDIS_PRIVATE_API void picoredis_mux_complete(picoredis_mux_t *mux, const char *error);
+PICOREDIS_PRIVATE_API void picoredis_mux_fail(picoredis_mux_t *mux, const char *error);
+PICOREDIS_PRIVATE_API void picoredis_mux_drive(picoredis_mux_t *mux, picoredis_mux_request_t *request);
+PICOREDIS_PRIVATE_API unsigned short picoredis_crc16(const char *buf, size_t length);
+PICOREDIS_PRIVATE_API int picoredis_cluster_node_add(picoredis_cluster_t *cluster, const char *host, size_t host_length, int port);
+PICOREDIS_PRIVATE_API picoredis_t *picoredis_cluster_node_ctx(picoredis_cluster_t *cluster, int node);
+PICOREDIS_PRIVATE_API void picoredis_cluster_node_drop(picoredis_cluster_t *cluster, int node);
+PICOREDIS_PRIVATE_API int picoredis_cluster_parse_nodes(picoredis_cluster_t *cluster, int queried, const char *text, size_t length);
+PICOREDIS_PRIVATE_API int picoredis_cluster_redirect(picoredis_cluster_t *cluster, picoredis_reply_view_t *view, unsigned *slot, int *node);
+PICOREDIS_PRIVATE_API int picoredis_cluster_key_compare(const void *a, const void *b);
+PICOREDIS_PRIVATE_API int picoredis_cluster_exec_multi(picoredis_cluster_t *cluster, picoredis_command_type type, size_t nargs, const char **values, size_t step, long long *sum);
+PICOREDIS_PRIVATE_API unsigned picoredis_murmur3_32(const void *key, size_t length, unsigned seed);
+PICOREDIS_PRIVATE_API int picoredis_shard_point_compare(const void *a, const void *b);
+PICOREDIS_PRIVATE_API int picoredis_shard_build_ring(picoredis_shard_t *shard);
+PICOREDIS_PRIVATE_API picoredis_t *picoredis_shard_node_ctx(picoredis_shard_t *shard, size_t node);
+PICOREDIS_PRIVATE_API int picoredis_scan_request(picoredis_scan_t *scan);
+PICOREDIS_PRIVATE_API int picoredis_scan_open(picoredis_scan_t *scan);
+PICOREDIS_PRIVATE_API int picoredis_scan_start(picoredis_scan_t *scan);
+PICOREDIS_PRIVATE_API int picoredis_shard_fanout(picoredis_shard_t *shard, picoredis_command_type type, size_t nargs, const char **values, size_t step, size_t *order, size_t *node_start, picoredis_reply_view_t *replies);
+PICOREDIS_PRIVATE_API int picoredis_receive_at_least(picoredis_t *ctx, size_t size);
+PICOREDIS_PRIVATE_API int picoredis_iterator_read(picoredis_t *ctx, picoredis_reply_view_t *element);
+PICOREDIS_PRIVATE_API void picoredis_iterator_finish(picoredis_iterator_t *iter);
+PICOREDIS_PRIVATE_API int picoredis_stream_begin(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length);
+PICOREDIS_PRIVATE_API int picoredis_stream_fill(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_stream_finish(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_write_all(int fd, const char *data, size_t length);
+#ifdef PICOREDIS_HAS_SPLICE
+PICOREDIS_PRIVATE_API int picoredis_stream_splice(picoredis_t *ctx, int fd, size_t *remaining, const char **write_error);
+#endif
+PICOREDIS_PRIVATE_API int picoredis_batch_send(picoredis_t *ctx, picoredis_command_type type, size_t key_num, const picoredis_view_t *keys, const picoredis_view_t *values, size_t *chunk_num);
+PICOREDIS_PRIVATE_API long long picoredis_batch_sum(picoredis_t *ctx, picoredis_command_type type, size_t key_num, const picoredis_view_t *keys);
+PICOREDIS_PRIVATE_API size_t picoredis_bulk_chunk(const picoredis_view_t *args, size_t step, size_t start, size_t num);
+PICOREDIS_PRIVATE_API int picoredis_bulk_range(picoredis_t *ctx, picoredis_command_type type, const char *key, const picoredis_view_t *args, size_t step, size_t start, size_t end, int variadic, long long *sum, long long *last);
+PICOREDIS_PRIVATE_API long long picoredis_bulk_write(picoredis_t *ctx, picoredis_command_type type, const char *key, size_t num, const picoredis_view_t *args, size_t step, long long *last);
+PICOREDIS_PRIVATE_API picoredis_token_t *picoredis_reader_push_token(picoredis_reader_t *reader, picoredis_reply_type type, size_t offset);
+PICOREDIS_PRIVATE_API int picoredis_reader_value_done(picoredis_reader_t *reader);
+PICOREDIS_PRIVATE_API int picoredis_reader_parse(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_reader_consume(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API size_t picoredis_reader_next_sibling(picoredis_reader_t *reader, size_t idx);
+PICOREDIS_PRIVATE_API char *picoredis_reply_copy_string(const char *src, size_t length);
+PICOREDIS_PRIVATE_API char *picoredis_arena_copy_string(picoredis_arena_t *arena, const char *src, size_t length);
+PICOREDIS_PRIVATE_API char *picoredis_reply_view_string(picoredis_reply_view_t *view, size_t *length);
+PICOREDIS_PRIVATE_API picoredis_array_t *picoredis_reply_view_array(picoredis_reply_view_t *view);
+PICOREDIS_PRIVATE_API picoredis_hash_t *picoredis_reply_view_hash(picoredis_reply_view_t *view);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply_fields(picoredis_t *ctx, picoredis_command_type type, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values);
+PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_reply_create(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API int picoredis_reply_view_create(picoredis_t *ctx, picoredis_reply_view_t *view);
+PICOREDIS_PRIVATE_API int picoredis_receive_reply(picoredis_t *ctx);
 PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_receive_command(picoredis_t *ctx);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_reply0(picoredis_t *ctx, picoredis_command_type type);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_reply1(picoredis_t *ctx, picoredis_command_type type, const char *arg);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_reply2(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_reply3(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_reply4(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3, const char *arg4);
-PICOREDIS_PRIVATE_API picoredis_reply_t *picoredis_send_and_replyn(picoredis_t *ctx, picoredis_command_type type, size_t nargs, va_list list);
+PICOREDIS_PRIVATE_API int picoredis_receive_view(picoredis_t *ctx, picoredis_reply_view_t *view);
+PICOREDIS_PRIVATE_API size_t picoredis_reply_tree_fill(picoredis_t *ctx, size_t idx, picoredis_reply_tree_t *node, picoredis_reply_tree_t **next_node, char **data);
+PICOREDIS_PRIVATE_API picoredis_reply_tree_t *picoredis_reply_tree_create(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API void picoredis_backoff(size_t attempt);
+PICOREDIS_PRIVATE_API size_t picoredis_subscriber_find(picoredis_subscriber_t *sub, const char *name, size_t length, int is_pattern);
+PICOREDIS_PRIVATE_API int picoredis_subscriber_rebuild(picoredis_subscriber_t *sub, size_t table_size);
+PICOREDIS_PRIVATE_API int picoredis_subscriber_add(picoredis_subscriber_t *sub, picoredis_command_type type, const char *name, picoredis_message_callback_t callback, void *privdata);
+PICOREDIS_PRIVATE_API int picoredis_subscriber_remove(picoredis_subscriber_t *sub, picoredis_command_type type, const char *name);
+PICOREDIS_PRIVATE_API int picoredis_subscriber_handle(picoredis_subscriber_t *sub);
+PICOREDIS_PRIVATE_API int picoredis_queue_handle(picoredis_queue_t *queue, const picoredis_view_t *list, const picoredis_view_t *item, picoredis_queue_callback_t callback, void *privdata);
+PICOREDIS_PRIVATE_API void picoredis_sha1(const void *data, size_t length, unsigned char digest[20]);
+PICOREDIS_PRIVATE_API int picoredis_script_is_loaded(picoredis_t *ctx, const char *sha1);
+PICOREDIS_PRIVATE_API void picoredis_script_set_loaded(picoredis_t *ctx, const char *sha1, int loaded);
+PICOREDIS_PRIVATE_API int picoredis_prepare_reply(picoredis_t *ctx);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply_argv(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply_binary1(picoredis_t *ctx, picoredis_command_type type, const void *arg, size_t length);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply_binary2(picoredis_t *ctx, picoredis_command_type type, const void *arg1, size_t length1, const void *arg2, size_t length2);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply_binary3(picoredis_t *ctx, picoredis_command_type type, const void *arg1, size_t length1, const void *arg2, size_t length2, const void *arg3, size_t length3);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply0(picoredis_t *ctx, picoredis_command_type type);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply1(picoredis_t *ctx, picoredis_command_type type, const char *arg);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply2(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply3(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_reply4(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3, const char *arg4);
+PICOREDIS_PRIVATE_API picoredis_reply_view_t *picoredis_send_and_replyn(picoredis_t *ctx, picoredis_command_type type, size_t nargs, va_list list);
 
 
 
@@ -300,16 +1005,40 @@ static picoredis_t *picoredis_alloc(void)
 {
     picoredis_t *ret = (picoredis_t *)malloc(sizeof(picoredis_t));
     memset(ret, 0, sizeof(picoredis_t));
-    ret->receive_buf = (char *)malloc(BUFSIZ);
-    memset(ret->receive_buf, 0, BUFSIZ);
+    ret->sock             = -1;
+    ret->receive_buf      = (char *)malloc(PICOREDIS_RECEIVE_BUFFER_SIZE);
+    ret->receive_buf_size = PICOREDIS_RECEIVE_BUFFER_SIZE;
+    ret->send_buf         = (char *)malloc(PICOREDIS_SEND_BUFFER_SIZE);
+    ret->send_buf_size    = PICOREDIS_SEND_BUFFER_SIZE;
     return ret;
 }
 
+// called from a reply callback, the context is released once the callback returns
 static void picoredis_free(picoredis_t *ctx)
 {
     if (!ctx) return;
-
+    if (ctx->in_callback) {
+        ctx->free_deferred = 1;
+        return;
+    }
+#ifdef __linux__
+    if (ctx->event_loop) {
+        picoredis_event_loop_remove(ctx->event_loop, ctx);
+    }
+#endif
     free(ctx->receive_buf);
+    free(ctx->reader.tokens);
+    free(ctx->send_buf);
+    free(ctx->views);
+    free(ctx->callbacks);
+    free(ctx->scripts);
+    picoredis_arena_free(&ctx->arena);
+#ifdef PICOREDIS_HAS_IO_URING
+    picoredis_uring_free(ctx->uring);
+#endif
+    if (ctx->sock >= 0) {
+        close(ctx->sock);
+    }
     free(ctx);
     ctx = NULL;
 }
@@ -319,20 +1048,29 @@ static int picoredis_has_error(picoredis_t *ctx)
     return ctx->error != NULL;
 }
 
-static picoredis_array_t *picoredis_array_alloc(int num)
+// the array, its values/lengths and data_size bytes for the elements share one allocation
+static picoredis_array_t *picoredis_array_create(size_t num, size_t data_size)
 {
-    picoredis_array_t *ret = (picoredis_array_t *)malloc(sizeof(picoredis_array_t));
-    memset(ret, 0, sizeof(picoredis_array_t));
-    ret->num = num;
-    ret->values = (const char **)malloc(sizeof(const char *) * num);
+    size_t header_size = sizeof(picoredis_array_t) + (sizeof(const char *) + sizeof(size_t)) * num;
+    char *block = (char *)malloc(header_size + data_size);
+    if (!block) return NULL;
+
+    picoredis_array_t *ret = (picoredis_array_t *)block;
+    ret->num     = num;
+    ret->values  = (const char **)(block + sizeof(picoredis_array_t));
+    ret->lengths = (size_t *)(ret->values + num);
     return ret;
 }
 
+static picoredis_array_t *picoredis_array_alloc(int num)
+{
+    return picoredis_array_create(num, 0);
+}
+
 static void picoredis_array_free(picoredis_array_t *array)
 {
     if (!array) return;
 
-    free(array->values);
     free(array);
     array = NULL;
 }
@@ -348,6 +1086,113 @@ static const char *picoredis_array_get(picoredis_array_t *array, int idx)
     return array->values[idx];
 }
 
+static size_t picoredis_array_get_length(picoredis_array_t *array, int idx)
+{
+    assert(0 <= idx && idx < array->num);
+    return array->lengths[idx];
+}
+
+static size_t picoredis_hash_num(const picoredis_hash_t *hash)
+{
+    return hash->num;
+}
+
+static const picoredis_view_t *picoredis_hash_get(const picoredis_hash_t *hash, const char *field)
+{
+    return picoredis_hash_get_binary(hash, field, strlen(field));
+}
+
+// returns the value of field or NULL when the hash does not have it
+static const picoredis_view_t *picoredis_hash_get_binary(const picoredis_hash_t *hash, const void *field, size_t field_length)
+{
+    if (hash->num == 0) return NULL;
+
+    size_t mask = hash->table_size - 1;
+    size_t pos  = picoredis_murmur3_32(field, field_length, 0) & mask;
+    for (; hash->table[pos] != 0; pos = (pos + 1) & mask) {
+        const picoredis_view_t *entry = &hash->fields[hash->table[pos] - 1];
+        if (entry->length == field_length && memcmp(entry->ptr, field, field_length) == 0) {
+            return &hash->values[hash->table[pos] - 1];
+        }
+    }
+    return NULL;
+}
+
+static void picoredis_hash_free(picoredis_hash_t *hash)
+{
+    free(hash);
+}
+
+static void *picoredis_arena_alloc(picoredis_arena_t *arena, size_t size)
+{
+    static const size_t alignment = 16;
+    static const size_t header    = (sizeof(picoredis_arena_chunk_t) + alignment - 1) & ~(alignment - 1);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    picoredis_arena_chunk_t *chunk = arena->chunk;
+    if (!chunk || chunk->used + size > chunk->size) {
+        size_t chunk_size = size > PICOREDIS_ARENA_CHUNK_SIZE ? size : PICOREDIS_ARENA_CHUNK_SIZE;
+        chunk = (picoredis_arena_chunk_t *)malloc(header + chunk_size);
+        if (!chunk) return NULL;
+        chunk->next  = arena->chunk;
+        chunk->size  = chunk_size;
+        chunk->used  = 0;
+        arena->chunk = chunk;
+    }
+    void *ret    = (char *)chunk + header + chunk->used;
+    chunk->used += size;
+    return ret;
+}
+
+// keeps only the largest chunk so that a steady workload reuses one block
+static void picoredis_arena_reset(picoredis_arena_t *arena)
+{
+    picoredis_arena_chunk_t *largest = arena->chunk;
+    picoredis_arena_chunk_t *chunk   = arena->chunk;
+    for (; chunk; chunk = chunk->next) {
+        if (chunk->size > largest->size) {
+            largest = chunk;
+        }
+    }
+    chunk = arena->chunk;
+    while (chunk) {
+        picoredis_arena_chunk_t *next = chunk->next;
+        if (chunk != largest) {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    if (largest) {
+        largest->next = NULL;
+        largest->used = 0;
+    }
+    arena->chunk        = largest;
+    arena->live_replies = 0;
+}
+
+static void picoredis_arena_free(picoredis_arena_t *arena)
+{
+    picoredis_arena_reset(arena);
+    free(arena->chunk);
+    arena->chunk = NULL;
+}
+
+static void picoredis_reply_free(picoredis_reply_t *reply)
+{
+    if (!reply) return;
+
+    picoredis_arena_t *arena = reply->arena;
+    if (arena->live_replies > 0 && --arena->live_replies == 0) {
+        picoredis_arena_reset(arena);
+    }
+}
+
+// releases every reply returned by picoredis_get_reply at once
+static void picoredis_reply_reset(picoredis_t *ctx)
+{
+    picoredis_arena_reset(&ctx->arena);
+}
+
 static int picoredis_connect_with_ctx(picoredis_t *ctx, const char *host, int port)
 {
     ctx->host = host;
@@ -364,6 +1209,9 @@ static int picoredis_connect_with_ctx(picoredis_t *ctx, const char *host, int po
     if (flag < 0) {
         return -1;
     }
+    if (ctx->async) {
+        flag |= O_NONBLOCK;
+    }
     if (fcntl(sd, F_SETFL, flag) < 0) {
         return -1;
     }
@@ -377,8 +1225,13 @@ static int picoredis_connect_with_ctx(picoredis_t *ctx, const char *host, int po
     addr.sin_addr.s_addr = inet_addr(ctx->host);
 
     int connect_result = connect(sd, (struct sockaddr *)&addr, sizeof(addr));
-    if (connect_result < 0) {
+    if (connect_result < 0 && ctx->async && errno == EINPROGRESS) {
+        // completion is reported as writability, see picoredis_async_write
+        ctx->connecting = 1;
+    } else if (connect_result < 0) {
+        int error = errno;
         close(sd);
+        errno = error;
         return -1;
     }
 
@@ -408,1017 +1261,5946 @@ static picoredis_t *picoredis_connect(const char *host, int port)
     return ctx;
 }
 
-static size_t picoredis_total_args_length(int nargs, size_t *lengths)
+// falls back to the blocking send() / recv() transport when io_uring is not
+// available (old kernel, seccomp, non-Linux build). see picoredis_get_transport.
+static picoredis_t *picoredis_connect_with_transport(const char *host, int port, picoredis_transport_type transport)
 {
-    size_t total_length = 0;
-    size_t i = 0;
-    for (; i < nargs; ++i) {
-        size_t length   = lengths[i];
-        size_t num_size = (size_t)log10(length) + 1;
-        total_length += (num_size + length);
+    picoredis_t *ctx = picoredis_connect(host, port);
+#ifdef PICOREDIS_HAS_IO_URING
+    if (transport == PICOREDIS_TRANSPORT_IO_URING && ctx->sock >= 0) {
+        ctx->uring = picoredis_uring_create();
     }
-    return total_length;
+#else
+    (void)transport;
+#endif
+    return ctx;
 }
 
-static char *picoredis_parse_command_args(int nargs, size_t *lengths, const char **values)
+static picoredis_transport_type picoredis_get_transport(picoredis_t *ctx)
 {
-    static const size_t protocol_char   = 5; // '\r', '\n', '$', '\r', '\n'
-    static const size_t protocol_length = 9; // '\', 'r', '\', 'n', '$', '\', 'r', '\', 'n'
-
-    size_t total_length = nargs * protocol_length + picoredis_total_args_length(nargs, lengths);
-    char *args_buffer   = (char *)malloc(total_length);
-    memset(args_buffer, 0, total_length);
-    char *args_set_ptr  = args_buffer;
-    size_t i = 0;
-    for (; i < nargs; ++i) {
-        size_t length     = lengths[i];
-        size_t num_size   = (size_t)log10(length) + 1;
-        const char *value = values[i];
-        size_t bufsize    = protocol_length + num_size + length;
-        snprintf(args_set_ptr, bufsize, "\r\n$%zu\r\n%s", length, value);
-        if (i + 1 != nargs) {
-            size_t diff   = protocol_length - protocol_char;
-            args_set_ptr += bufsize - diff;
-        }
-    }
-    return args_buffer;
-}
-
-#define COMMAND_DEF(type) { PICOREDIS_ ## type, #type, strlen(#type) }
-
-static picoredis_command_type_t picoredis_get_command_type(picoredis_command_type type)
-{
-    static picoredis_command_type_t all_command_types[] = {
-        COMMAND_DEF(QUIT),
-        COMMAND_DEF(AUTH),
-
-        COMMAND_DEF(EXISTS),
-        COMMAND_DEF(DEL),
-        COMMAND_DEF(TYPE),
-        COMMAND_DEF(KEYS),
-        COMMAND_DEF(RANDOMKEY),
-        COMMAND_DEF(RENAME),
-        COMMAND_DEF(RENAMENX),
-        COMMAND_DEF(DBSIZE),
-        COMMAND_DEF(EXPIRE),
-        COMMAND_DEF(EXPIREAT),
-        COMMAND_DEF(PERSIST),
-        COMMAND_DEF(TTL),
-        COMMAND_DEF(SELECT),
-        COMMAND_DEF(MOVE),
-        COMMAND_DEF(FLUSHDB),
-        COMMAND_DEF(FLUSHALL),
-
-        COMMAND_DEF(SET),
-        COMMAND_DEF(GET),
-        COMMAND_DEF(GETSET),
-        COMMAND_DEF(MGET),
-        COMMAND_DEF(SETNX),
-        COMMAND_DEF(SETEX),
-        COMMAND_DEF(MSET),
-        COMMAND_DEF(MSETNX),
-        COMMAND_DEF(INCR),
-        COMMAND_DEF(INCRBY),
-        COMMAND_DEF(DECR),
-        COMMAND_DEF(DECRBY),
-        COMMAND_DEF(APPEND),
-        COMMAND_DEF(SUBSTR),
-
-        COMMAND_DEF(RPUSH),
-        COMMAND_DEF(LPUSH),
-        COMMAND_DEF(LLEN),
-        COMMAND_DEF(LRANGE),
-        COMMAND_DEF(LTRIM),
-        COMMAND_DEF(LINDEX),
-        COMMAND_DEF(LSET),
-        COMMAND_DEF(LREM),
-        COMMAND_DEF(LPOP),
-        COMMAND_DEF(RPOP),
-        COMMAND_DEF(BLPOP),
-        COMMAND_DEF(BRPOP),
-        COMMAND_DEF(RPOPLPUSH),
-
-        COMMAND_DEF(SADD),
-        COMMAND_DEF(SREM),
-        COMMAND_DEF(SPOP),
-        COMMAND_DEF(SMOVE),
-        COMMAND_DEF(SCARD),
-        COMMAND_DEF(SISMEMBER),
-        COMMAND_DEF(SINTER),
-        COMMAND_DEF(SINTERSTORE),
-        COMMAND_DEF(SUNION),
-        COMMAND_DEF(SUNIONSTORE),
-        COMMAND_DEF(SDIFF),
-        COMMAND_DEF(SDIFFSTORE),
-        COMMAND_DEF(SMEMBERS),
-        COMMAND_DEF(SRANDMEMBER),
-
-        COMMAND_DEF(ZADD),
-        COMMAND_DEF(ZREM),
-        COMMAND_DEF(ZINCRBY),
-        COMMAND_DEF(ZRANK),
-        COMMAND_DEF(ZREVRANK),
-        COMMAND_DEF(ZRANGE),
-        COMMAND_DEF(ZREVRANGE),
-        COMMAND_DEF(ZRANGEBYSCORE),
-        COMMAND_DEF(ZCOUNT),
-        COMMAND_DEF(ZCARD),
-        COMMAND_DEF(ZSCORE),
-        COMMAND_DEF(ZREMRANGEBYRANK),
-        COMMAND_DEF(ZREMRANGEBYSCORE),
-        COMMAND_DEF(ZUNIONSTORE),
-        COMMAND_DEF(ZINTERSTORE),
-
-        COMMAND_DEF(HSET),
-        COMMAND_DEF(HGET),
-        COMMAND_DEF(HMGET),
-        COMMAND_DEF(HMSET),
-        COMMAND_DEF(HINCRBY),
-        COMMAND_DEF(HEXISTS),
-        COMMAND_DEF(HDEL),
-        COMMAND_DEF(HLEN),
-        COMMAND_DEF(HKEYS),
-        COMMAND_DEF(HVALS),
-        COMMAND_DEF(HGETALL),
-
-        COMMAND_DEF(SORT),
-
-        COMMAND_DEF(MULTI),
-        COMMAND_DEF(EXEC),
-        COMMAND_DEF(DISCARD),
-        COMMAND_DEF(WATCH),
-        COMMAND_DEF(UNWATCH),
-
-        COMMAND_DEF(SUBSCRIBE),
-        COMMAND_DEF(UNSUBSCRIBE),
-        COMMAND_DEF(PUBLISH),
-
-        COMMAND_DEF(SAVE),
-        COMMAND_DEF(BGSAVE),
-        COMMAND_DEF(LASTSAVE),
-        COMMAND_DEF(SHUTDOWN),
-        COMMAND_DEF(BGREWRITEAOF),
-
-        COMMAND_DEF(INFO),
-        COMMAND_DEF(MONITOR),
-        COMMAND_DEF(SLAVEOF),
-        COMMAND_DEF(CONFIG),
-
-        COMMAND_DEF(NONE),
-    };
-
-    size_t i = 0;
-    for (; all_command_types[i].type != COMMAND_TYPE_DEF(NONE); ++i) {
-        if (all_command_types[i].type == type) {
-            return all_command_types[i];
-        }
-    }
-    return all_command_types[i];
+    return ctx->uring ? PICOREDIS_TRANSPORT_IO_URING : PICOREDIS_TRANSPORT_BLOCKING;
 }
 
-static size_t picoredis_command_header_size(size_t nargs, picoredis_command_type_t *type)
+static const char picoredis_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static size_t picoredis_count_digits(unsigned long long value)
 {
-    size_t total_args_num                 = nargs + 1;
-    size_t total_args_num_digit           = (size_t)log10(total_args_num) + 1;
-    static const size_t protocol_char     = 8;  // '*', '\r', '\n', '$', '\r', '\n', '\r', '\n'
-    size_t name_length_num_digit          = (size_t)log10(type->name_length + 1) + 1;
-    return protocol_char + total_args_num_digit + name_length_num_digit + type->name_length;
+    size_t digits = 1;
+    for (;;) {
+        if (value < 10)    return digits;
+        if (value < 100)   return digits + 1;
+        if (value < 1000)  return digits + 2;
+        if (value < 10000) return digits + 3;
+        value  /= 10000;
+        digits += 4;
+    }
 }
 
-static char *picoredis_command_create(picoredis_command_type type, size_t nargs, size_t *lengths, const char **values)
+// writes the decimal digits of value (without '\0') and returns the written length
+static size_t picoredis_format_uint(char *dst, unsigned long long value)
 {
-    picoredis_command_type_t command_type = picoredis_get_command_type(type);
-    char *args          = picoredis_parse_command_args(nargs, lengths, values);
-    size_t header_size  = picoredis_command_header_size(nargs, &command_type);
-    size_t command_size = header_size + strlen(args) + 1;
-    char *command       = (char *)malloc(command_size);
-    memset(command, 0, command_size);
-    snprintf(command, command_size, "*%zu\r\n$%zu\r\n%s%s\r\n", nargs + 1, command_type.name_length, command_type.name, args);
-    return command;
+    size_t length = picoredis_count_digits(value);
+    char *ptr     = dst + length;
+    while (value >= 100) {
+        size_t idx = (value % 100) * 2;
+        value /= 100;
+        *--ptr = picoredis_digit_pairs[idx + 1];
+        *--ptr = picoredis_digit_pairs[idx];
+    }
+    if (value >= 10) {
+        size_t idx = value * 2;
+        *--ptr = picoredis_digit_pairs[idx + 1];
+        *--ptr = picoredis_digit_pairs[idx];
+    } else {
+        *--ptr = (char)('0' + value);
+    }
+    return length;
 }
 
-static int picoredis_send_command(picoredis_t *ctx, char *command)
+static size_t picoredis_format_int(char *dst, long long value)
 {
-    int ret = send(ctx->sock, command, strlen(command), 0);
-    if (ret <= 0) {
-        ctx->error = strerror(errno);
-    }
-    return ret;
+    if (value >= 0) return picoredis_format_uint(dst, value);
+
+    *dst = '-';
+    return 1 + picoredis_format_uint(dst + 1, 0ULL - (unsigned long long)value);
 }
 
-static picoredis_reply_t *picoredis_receive_command(picoredis_t *ctx)
+// powers of ten that are exact in a double
+static const double picoredis_exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// writes the shortest decimal that parses back to exactly value and returns
+// its length. dst needs PICOREDIS_DOUBLE_BUFFER_SIZE bytes. integers and
+// values with a few decimals are formatted without libc.
+static size_t picoredis_format_double(char *dst, double value)
 {
-    memset(ctx->receive_buf, 0, BUFSIZ);
-    int recv_result = recv(ctx->sock, ctx->receive_buf, BUFSIZ, 0);
-    if (recv_result <= 0) {
-        ctx->error = strerror(errno);
-        return NULL;
+    static const double max_exact = 9007199254740992.0; // 2^53
+    if (value != value) {
+        memcpy(dst, "nan", 4);
+        return 3;
     }
-    char *buf = ctx->receive_buf;
-    //fprintf(stderr, "buf = [%s]\n", buf);
-    char *all_lines[BUFSIZ] = {0};
-    size_t i = 0;
-    size_t line_top_index = 0;
-    size_t line_num = 0;
-    for (; buf[i] != '\0'; ++i) {
-        if (i > 1 && buf[i - 1] == '\r' && buf[i] == '\n') {
-            buf[i - 1] = '\0';
-            all_lines[line_num] = buf + line_top_index;
-            line_num++;
-            line_top_index = i + 1;
-        }
+    if (value > DBL_MAX || value < -DBL_MAX) {
+        memcpy(dst, value > 0 ? "inf" : "-inf", value > 0 ? 4 : 5);
+        return value > 0 ? 3 : 4;
     }
-    picoredis_reply_t *reply = (picoredis_reply_t *)malloc(sizeof(picoredis_reply_t));
-    memset(reply, 0, sizeof(picoredis_reply_t));
-
-    for (i = 0; i < line_num; ++i) {
-        char *line = all_lines[i];
-        if (i == 0) {
-            switch (line[0]) {
-            case '+': {
-                reply->type = PICOREDIS_REPLY_SINGLE_LINE;
-                size_t line_size = strlen(line);
-                reply->v.svalue = (char *)malloc(line_size);
-                memset(reply->v.svalue, 0, line_size);
-                memcpy((void *)reply->v.svalue, line + 1, line_size);
-                break;
-            }
-            case '-': {
-                reply->type = PICOREDIS_REPLY_ERROR;
-                size_t line_size = strlen(line);
-                reply->v.svalue = (char *)malloc(line_size);
-                memset(reply->v.svalue, 0, line_size);
-                memcpy((void *)reply->v.svalue, line + 1, line_size);
-                break;
-            }
-            case ':':
-                reply->type     = PICOREDIS_REPLY_NUM;
-                reply->v.ivalue = atoi(line + 1);
-                break;
-            case '$': {
-                reply->type   = PICOREDIS_REPLY_BULK;
-                reply->length = atoi(line + 1);
-                break;
-            }
-            case '*':
-                reply->type     = PICOREDIS_REPLY_MULTI_BULK;
-                reply->v.avalue = picoredis_array_alloc(atoi(line + 1));
-                break;
-            default:
-                break;
-            }
-        } else {
-            switch (reply->type) {
-            case PICOREDIS_REPLY_SINGLE_LINE:
-                reply->v.ivalue = 0;
-                break;
-            case PICOREDIS_REPLY_ERROR:
-                reply->v.ivalue = -1;
-                break;
-            case PICOREDIS_REPLY_MULTI_BULK: {
-                int is_value_line = (i - 1) % 2;
-                if (is_value_line) {
-                    size_t size = strlen(line) + 1;
-                    char *value = (char *)malloc(size);
-                    memset(value, 0, size);
-                    memcpy(value, line, size - 1);
-                    reply->v.avalue->values[(i - 2) / 2] = value;
-                }
-                break;
-            }
-            case PICOREDIS_REPLY_BULK: {
-                if (reply->length > 0) {
-                    reply->v.svalue = (char *)malloc(reply->length + 1);
-                    memset(reply->v.svalue, 0, reply->length + 1);
-                    memcpy((void *)reply->v.svalue, line, reply->length);
-                }
-                break;
-            }
-            default:
-                break;
-            }
+    size_t scale = 0;
+    for (; scale <= 9; ++scale) {
+        double scaled = value * picoredis_exact_pow10[scale];
+        if (scaled < -max_exact || max_exact < scaled || scaled != (double)(long long)scaled) continue;
+        // both operands are exact, so the division rounds like parsing the decimal would
+        if (scaled / picoredis_exact_pow10[scale] != value) continue;
+
+        long long mantissa = (long long)scaled;
+        if (scale == 0) {
+            size_t length = picoredis_format_int(dst, mantissa);
+            dst[length] = '\0';
+            return length;
+        }
+        char *ptr = dst;
+        if (mantissa < 0) {
+            *ptr++ = '-';
         }
+        unsigned long long magnitude = mantissa < 0 ? 0ULL - (unsigned long long)mantissa : (unsigned long long)mantissa;
+        unsigned long long divisor   = (unsigned long long)picoredis_exact_pow10[scale];
+        ptr   += picoredis_format_uint(ptr, magnitude / divisor);
+        *ptr++ = '.';
+        char digits[24];
+        size_t length = picoredis_format_uint(digits, magnitude % divisor);
+        memset(ptr, '0', scale - length);
+        memcpy(ptr + scale - length, digits, length);
+        ptr += scale;
+        while (ptr[-1] == '0') {
+            ptr--;
+        }
+        *ptr = '\0';
+        return ptr - dst;
     }
-    return reply;
+    // 17 significant digits always round-trip, fewer are tried first
+    int length    = 0;
+    int precision = 15;
+    for (; precision <= 17; ++precision) {
+        length = snprintf(dst, PICOREDIS_DOUBLE_BUFFER_SIZE, "%.*g", precision, value);
+        if (strtod(dst, NULL) == value) break;
+    }
+    return length;
 }
 
-static picoredis_reply_t *picoredis_send_and_reply0(picoredis_t *ctx, picoredis_command_type type)
+// returns 0 and sets value when ptr is a whole signed 64 bit integer, -1 otherwise
+static int picoredis_parse_int64(const char *ptr, size_t length, int64_t *value)
 {
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, 0, NULL, NULL));
-    if (picoredis_has_error(ctx)) return NULL;
-
-    return picoredis_receive_command(ctx);
+    const char *end = ptr + length;
+    int negative = 0;
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+        negative = (*ptr == '-');
+        ptr++;
+    }
+    if (ptr == end) return -1;
+
+    uint64_t limit     = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t magnitude = 0;
+    for (; ptr < end; ++ptr) {
+        if (*ptr < '0' || '9' < *ptr) return -1;
+        uint64_t digit = *ptr - '0';
+        if (magnitude > (limit - digit) / 10) return -1;
+        magnitude = magnitude * 10 + digit;
+    }
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return 0;
 }
 
-static picoredis_reply_t *picoredis_send_and_reply1(picoredis_t *ctx, picoredis_command_type type, const char *arg)
+// the number of a ':', '$' or '*' header line without its "\r\n", checked
+// like picoredis_reader_parse does: digits only and lengths within the limits
+static int picoredis_parse_header_number(char type, const char *ptr, size_t length, long long *number)
 {
-    size_t lengths[]     = { strlen(arg) };
-    const char *values[] = { arg };
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, 1, lengths, values));
-    if (picoredis_has_error(ctx)) return NULL;
-
-    return picoredis_receive_command(ctx);
+    int64_t value;
+    if (length > 0 && ptr[0] == '+') return -1;
+    if (picoredis_parse_int64(ptr, length, &value) < 0) return -1;
+    if (type == '$' && value > PICOREDIS_MAX_BULK_LENGTH) return -1;
+    if (type == '*' && value > PICOREDIS_MAX_MULTI_BULK_LENGTH) return -1;
+    *number = value;
+    return 0;
 }
 
-static picoredis_reply_t *picoredis_send_and_reply2(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2)
+// decimals of up to 15 digits without exponent are computed exactly from an
+// integer and an exact power of ten, anything else goes through strtod.
+// returns 0 and sets value, -1 when ptr is not a number.
+static int picoredis_parse_double(const char *ptr, size_t length, double *value)
 {
-    static const size_t nargs = 2;
-    size_t lengths[]     = { strlen(arg1), strlen(arg2) };
-    const char *values[] = { arg1, arg2 };
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, 2, lengths, values));
-    if (picoredis_has_error(ctx)) return NULL;
+    const char *p   = ptr;
+    const char *end = ptr + length;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    uint64_t mantissa = 0;
+    size_t digits     = 0;
+    size_t scale      = 0;
+    for (; p < end && '0' <= *p && *p <= '9' && digits < 16; ++p, ++digits) {
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (p < end && *p == '.' && digits > 0) {
+        for (++p; p < end && '0' <= *p && *p <= '9' && digits < 16; ++p, ++digits, ++scale) {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+    }
+    if (p == end && digits > 0 && digits <= 15) {
+        double result = (double)mantissa / picoredis_exact_pow10[scale];
+        *value = negative ? -result : result;
+        return 0;
+    }
 
-    return picoredis_receive_command(ctx);
+    char buf[64];
+    if (length == 0 || length >= sizeof(buf)) return -1;
+    memcpy(buf, ptr, length);
+    buf[length] = '\0';
+    char *parsed_end;
+    *value = strtod(buf, &parsed_end);
+    return parsed_end == buf + length ? 0 : -1;
 }
 
-static picoredis_reply_t *picoredis_send_and_reply3(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3)
+// header is the precomputed "$<name length>\r\n<NAME>\r\n" part of a request
+#define COMMAND_HEADER(type, length) "$" #length "\r\n" #type "\r\n"
+#define COMMAND_DEF(type, length) \
+    [PICOREDIS_ ## type] = { PICOREDIS_ ## type, #type, length, COMMAND_HEADER(type, length), sizeof(COMMAND_HEADER(type, length)) - 1 }
+
+static const picoredis_command_type_t *picoredis_get_command_type(picoredis_command_type type)
 {
-    static const size_t nargs = 3;
-    size_t lengths[]     = { strlen(arg1), strlen(arg2), strlen(arg3) };
-    const char *values[] = { arg1, arg2, arg3 };
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, nargs, lengths, values));
-    if (picoredis_has_error(ctx)) return NULL;
+    static const picoredis_command_type_t all_command_types[] = {
+        COMMAND_DEF(QUIT, 4),
+        COMMAND_DEF(AUTH, 4),
+
+        COMMAND_DEF(EXISTS, 6),
+        COMMAND_DEF(DEL, 3),
+        COMMAND_DEF(TYPE, 4),
+        COMMAND_DEF(KEYS, 4),
+        COMMAND_DEF(RANDOMKEY, 9),
+        COMMAND_DEF(RENAME, 6),
+        COMMAND_DEF(RENAMENX, 8),
+        COMMAND_DEF(DBSIZE, 6),
+        COMMAND_DEF(EXPIRE, 6),
+        COMMAND_DEF(EXPIREAT, 8),
+        COMMAND_DEF(PERSIST, 7),
+        COMMAND_DEF(TTL, 3),
+        COMMAND_DEF(SELECT, 6),
+        COMMAND_DEF(MOVE, 4),
+        COMMAND_DEF(FLUSHDB, 7),
+        COMMAND_DEF(FLUSHALL, 8),
+
+        COMMAND_DEF(SET, 3),
+        COMMAND_DEF(GET, 3),
+        COMMAND_DEF(GETSET, 6),
+        COMMAND_DEF(MGET, 4),
+        COMMAND_DEF(SETNX, 5),
+        COMMAND_DEF(SETEX, 5),
+        COMMAND_DEF(MSET, 4),
+        COMMAND_DEF(MSETNX, 6),
+        COMMAND_DEF(INCR, 4),
+        COMMAND_DEF(INCRBY, 6),
+        COMMAND_DEF(DECR, 4),
+        COMMAND_DEF(DECRBY, 6),
+        COMMAND_DEF(APPEND, 6),
+        COMMAND_DEF(SUBSTR, 6),
+
+        COMMAND_DEF(RPUSH, 5),
+        COMMAND_DEF(LPUSH, 5),
+        COMMAND_DEF(LLEN, 4),
+        COMMAND_DEF(LRANGE, 6),
+        COMMAND_DEF(LTRIM, 5),
+        COMMAND_DEF(LINDEX, 6),
+        COMMAND_DEF(LSET, 4),
+        COMMAND_DEF(LREM, 4),
+        COMMAND_DEF(LPOP, 4),
+        COMMAND_DEF(RPOP, 4),
+        COMMAND_DEF(BLPOP, 5),
+        COMMAND_DEF(BRPOP, 5),
+        COMMAND_DEF(RPOPLPUSH, 9),
+
+        COMMAND_DEF(SADD, 4),
+        COMMAND_DEF(SREM, 4),
+        COMMAND_DEF(SPOP, 4),
+        COMMAND_DEF(SMOVE, 5),
+        COMMAND_DEF(SCARD, 5),
+        COMMAND_DEF(SISMEMBER, 9),
+        COMMAND_DEF(SINTER, 6),
+        COMMAND_DEF(SINTERSTORE, 11),
+        COMMAND_DEF(SUNION, 6),
+        COMMAND_DEF(SUNIONSTORE, 11),
+        COMMAND_DEF(SDIFF, 5),
+        COMMAND_DEF(SDIFFSTORE, 10),
+        COMMAND_DEF(SMEMBERS, 8),
+        COMMAND_DEF(SRANDMEMBER, 11),
+
+        COMMAND_DEF(ZADD, 4),
+        COMMAND_DEF(ZREM, 4),
+        COMMAND_DEF(ZINCRBY, 7),
+        COMMAND_DEF(ZRANK, 5),
+        COMMAND_DEF(ZREVRANK, 8),
+        COMMAND_DEF(ZRANGE, 6),
+        COMMAND_DEF(ZREVRANGE, 9),
+        COMMAND_DEF(ZRANGEBYSCORE, 13),
+        COMMAND_DEF(ZCOUNT, 6),
+        COMMAND_DEF(ZCARD, 5),
+        COMMAND_DEF(ZSCORE, 6),
+        COMMAND_DEF(ZREMRANGEBYRANK, 15),
+        COMMAND_DEF(ZREMRANGEBYSCORE, 16),
+        COMMAND_DEF(ZUNIONSTORE, 11),
+        COMMAND_DEF(ZINTERSTORE, 11),
+
+        COMMAND_DEF(HSET, 4),
+        COMMAND_DEF(HGET, 4),
+        COMMAND_DEF(HMGET, 5),
+        COMMAND_DEF(HMSET, 5),
+        COMMAND_DEF(HINCRBY, 7),
+        COMMAND_DEF(HEXISTS, 7),
+        COMMAND_DEF(HDEL, 4),
+        COMMAND_DEF(HLEN, 4),
+        COMMAND_DEF(HKEYS, 5),
+        COMMAND_DEF(HVALS, 5),
+        COMMAND_DEF(HGETALL, 7),
+
+        COMMAND_DEF(SORT, 4),
+
+        COMMAND_DEF(MULTI, 5),
+        COMMAND_DEF(EXEC, 4),
+        COMMAND_DEF(DISCARD, 7),
+        COMMAND_DEF(WATCH, 5),
+        COMMAND_DEF(UNWATCH, 7),
+
+        COMMAND_DEF(SUBSCRIBE, 9),
+        COMMAND_DEF(UNSUBSCRIBE, 11),
+        COMMAND_DEF(PUBLISH, 7),
+
+        COMMAND_DEF(SAVE, 4),
+        COMMAND_DEF(BGSAVE, 6),
+        COMMAND_DEF(LASTSAVE, 8),
+        COMMAND_DEF(SHUTDOWN, 8),
+        COMMAND_DEF(BGREWRITEAOF, 12),
+
+        COMMAND_DEF(INFO, 4),
+        COMMAND_DEF(MONITOR, 7),
+        COMMAND_DEF(SLAVEOF, 7),
+        COMMAND_DEF(CONFIG, 6),
+
+        COMMAND_DEF(CLUSTER, 7),
+        COMMAND_DEF(ASKING, 6),
+        COMMAND_DEF(SCAN, 4),
+        COMMAND_DEF(SSCAN, 5),
+        COMMAND_DEF(HSCAN, 5),
+        COMMAND_DEF(ZSCAN, 5),
+        COMMAND_DEF(EVAL, 4),
+        COMMAND_DEF(EVALSHA, 7),
+        COMMAND_DEF(SCRIPT, 6),
+        COMMAND_DEF(PSUBSCRIBE, 10),
+        COMMAND_DEF(PUNSUBSCRIBE, 12),
+        COMMAND_DEF(BRPOPLPUSH, 10),
+
+        COMMAND_DEF(NONE, 4),
+    };
 
-    return picoredis_receive_command(ctx);
+    assert(0 <= type && type <= COMMAND_TYPE_DEF(NONE));
+    return &all_command_types[type];
 }
 
-static picoredis_reply_t *picoredis_send_and_reply4(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3, const char *arg4)
+static int picoredis_reserve_send_buf(picoredis_t *ctx, size_t size)
 {
-    static const size_t nargs = 4;
-    size_t lengths[]     = { strlen(arg1), strlen(arg2), strlen(arg3), strlen(arg4) };
-    const char *values[] = { arg1, arg2, arg3, arg4 };
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, nargs, lengths, values));
-    if (picoredis_has_error(ctx)) return NULL;
-
-    return picoredis_receive_command(ctx);
+    size_t required = ctx->send_length + size;
+    if (required <= ctx->send_buf_size) return 0;
+
+    size_t new_size = ctx->send_buf_size * 2;
+    for (; new_size < required; new_size *= 2) {}
+    char *new_buf = (char *)realloc(ctx->send_buf, new_size);
+    if (!new_buf) {
+        ctx->error = "cannot allocate send buffer";
+        return -1;
+    }
+    ctx->send_buf      = new_buf;
+    ctx->send_buf_size = new_size;
+    return 0;
 }
 
-static picoredis_reply_t *picoredis_send_and_replyn(picoredis_t *ctx, picoredis_command_type type, size_t nargs, va_list list)
+// encodes one request straight into send_buf: the command header comes from
+// the table above and the argument lengths are formatted in place.
+static int picoredis_command_encode(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
 {
-    size_t lengths[nargs];
-    const char *values[nargs];
+    static const size_t max_digits = 20;
+    const picoredis_command_type_t *command_type = picoredis_get_command_type(type);
+    size_t total_length = 1 + max_digits + 2 + command_type->header_length; // '*', nargs, '\r\n', header
     size_t i = 0;
     for (; i < nargs; ++i) {
-        char *k    = va_arg(list, char *);
-        lengths[i] = strlen(k);
-        values[i]  = k;
+        total_length += 1 + max_digits + 2 + lengths[i] + 2;                 // '$', length, '\r\n', value, '\r\n'
     }
-
-    ctx->error = NULL;
-    picoredis_send_command(ctx, picoredis_command_create(type, nargs, lengths, values));
-    if (picoredis_has_error(ctx)) return NULL;
-
-    return picoredis_receive_command(ctx);
+    if (picoredis_reserve_send_buf(ctx, total_length) < 0) return -1;
+
+    char *ptr = ctx->send_buf + ctx->send_length;
+    *ptr++ = '*';
+    ptr   += picoredis_format_uint(ptr, nargs + 1);
+    *ptr++ = '\r';
+    *ptr++ = '\n';
+    memcpy(ptr, command_type->header, command_type->header_length);
+    ptr   += command_type->header_length;
+    for (i = 0; i < nargs; ++i) {
+        *ptr++ = '$';
+        ptr   += picoredis_format_uint(ptr, lengths[i]);
+        *ptr++ = '\r';
+        *ptr++ = '\n';
+        memcpy(ptr, values[i], lengths[i]);
+        ptr   += lengths[i];
+        *ptr++ = '\r';
+        *ptr++ = '\n';
+    }
+    ctx->send_length = ptr - ctx->send_buf;
+    return 0;
 }
 
-
-static void picoredis_exec_quit(picoredis_t *ctx)
+// encodes a request whose last argument is sent separately: only its
+// "$<length>\r\n" header goes to send_buf, its value and the final "\r\n" do not.
+static int picoredis_command_encode_head(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, size_t last_length)
 {
-    picoredis_send_and_reply0(ctx, PICOREDIS_QUIT);
+    static const size_t max_digits = 20;
+    const char *head_values[nargs + 1];
+    size_t head_lengths[nargs + 1];
+    memcpy(head_values, values, sizeof(const char *) * nargs);
+    memcpy(head_lengths, lengths, sizeof(size_t) * nargs);
+    head_values[nargs]  = "";
+    head_lengths[nargs] = 0;
+    if (picoredis_command_encode(ctx, type, nargs + 1, head_values, head_lengths) < 0) return -1;
+    if (picoredis_reserve_send_buf(ctx, max_digits) < 0) return -1;
+
+    // replace the "$0\r\n\r\n" of the empty placeholder by the real length
+    char *ptr = ctx->send_buf + ctx->send_length - 6;
+    *ptr++ = '$';
+    ptr   += picoredis_format_uint(ptr, last_length);
+    *ptr++ = '\r';
+    *ptr++ = '\n';
+    ctx->send_length = ptr - ctx->send_buf;
+    return 0;
 }
 
-static int picoredis_exec_auth(picoredis_t *ctx, const char *password)
+// makes room for at least size bytes after receive_end
+static int picoredis_reserve_receive_buf(picoredis_t *ctx, size_t size)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_AUTH, password);
-    if (!reply) {
-        ctx->error = "cannot receive reply";
-        return 0;
+    if (ctx->receive_buf_size - ctx->receive_end >= size) return 0;
+
+    // recycle the space of already consumed replies before growing
+    if (ctx->receive_begin > 0) {
+        size_t unread = ctx->receive_end - ctx->receive_begin;
+        memmove(ctx->receive_buf, ctx->receive_buf + ctx->receive_begin, unread);
+        ctx->reader.pos   -= ctx->receive_begin;
+        ctx->receive_end   = unread;
+        ctx->receive_begin = 0;
     }
-
-    if (reply->type == PICOREDIS_REPLY_ERROR) {
-        ctx->error = "cannot set";
-        return 0;
+    size_t required = ctx->reader.pos + ctx->reader.bulk_remaining;
+    if (required < ctx->receive_end + size) {
+        required = ctx->receive_end + size;
     }
-    return 1;
-}
-
-static int picoredis_exec_exists(picoredis_t *ctx, const char *key)
-{
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_EXISTS, key);
-    return reply ? reply->v.ivalue : 0;
-}
-
-static int picoredis_exec_del(picoredis_t *ctx, size_t nargs, ...)
-{
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_DEL, nargs, list);
-    va_end(list);
-    return reply ? reply->v.ivalue : 0;
-}
-
-static char *picoredis_exec_type(picoredis_t *ctx, const char *key)
-{
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_TYPE, key);
-    return reply ? reply->v.svalue : NULL;
+    if (required > ctx->receive_buf_size) {
+        size_t new_size = ctx->receive_buf_size * 2;
+        for (; new_size < required; new_size *= 2) {
+            if (new_size > SIZE_MAX / 2) {
+                ctx->error = "cannot allocate receive buffer";
+                return -1;
+            }
+        }
+        char *new_buf = (char *)realloc(ctx->receive_buf, new_size);
+        if (!new_buf) {
+            ctx->error = "cannot allocate receive buffer";
+            return -1;
+        }
+        ctx->receive_buf      = new_buf;
+        ctx->receive_buf_size = new_size;
+    }
+    return 0;
 }
 
-static picoredis_array_t *picoredis_exec_keys(picoredis_t *ctx, const char *key)
+// closes a connection that cannot be kept in sync any more and drops
+// everything buffered for it, so the ctx fails fast instead of hanging
+static void picoredis_disconnect(picoredis_t *ctx, const char *error)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_KEYS, key);
-    return reply ? reply->v.avalue : NULL;
+    if (ctx->sock >= 0) {
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+    ctx->error           = error;
+    ctx->send_length     = 0;
+    ctx->pending_replies = 0;
+    ctx->receive_begin   = ctx->receive_end = 0;
+    ctx->reader.pos      = 0;
+    picoredis_reader_consume(ctx);
 }
 
-static char *picoredis_exec_randomkey(picoredis_t *ctx)
+static int picoredis_receive_more(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_RANDOMKEY);
-    return reply ? reply->v.svalue : NULL;
-}
+#ifdef PICOREDIS_HAS_IO_URING
+    if (ctx->uring) return picoredis_uring_receive(ctx);
+#endif
+    if (ctx->receive_end == ctx->receive_buf_size && picoredis_reserve_receive_buf(ctx, 1) < 0) return -1;
 
-static int picoredis_exec_rename(picoredis_t *ctx, const char *oldkey, const char *newkey)
-{
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RENAME, oldkey, newkey);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    ssize_t recv_result = recv(ctx->sock, ctx->receive_buf + ctx->receive_end, ctx->receive_buf_size - ctx->receive_end, 0);
+    if (recv_result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    if (recv_result <= 0) {
+        ctx->error = (recv_result == 0) ? "connection closed by server" : strerror(errno);
+        return -1;
+    }
+    ctx->receive_end += recv_result;
+    return recv_result;
 }
 
-static int picoredis_exec_renamenx(picoredis_t *ctx, const char *oldkey, const char *newkey)
+static picoredis_token_t *picoredis_reader_push_token(picoredis_reader_t *reader, picoredis_reply_type type, size_t offset)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RENAMENX, oldkey, newkey);
-    return reply ? reply->v.ivalue : 0;
+    if (reader->token_num == reader->token_capacity) {
+        size_t new_capacity = reader->token_capacity ? reader->token_capacity * 2 : 16;
+        picoredis_token_t *new_tokens = (picoredis_token_t *)realloc(reader->tokens, sizeof(picoredis_token_t) * new_capacity);
+        if (!new_tokens) return NULL;
+        reader->tokens         = new_tokens;
+        reader->token_capacity = new_capacity;
+    }
+    picoredis_token_t *token = &reader->tokens[reader->token_num++];
+    token->type    = type;
+    token->offset  = offset;
+    token->length  = 0;
+    token->integer = 0;
+    return token;
 }
 
-static int picoredis_exec_dbsize(picoredis_t *ctx)
+// returns 1 when the value just finished also completes the whole reply
+static int picoredis_reader_value_done(picoredis_reader_t *reader)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_DBSIZE);
-    return reply ? reply->v.ivalue : 0;
+    reader->state = PICOREDIS_READER_TYPE;
+    while (reader->depth > 0) {
+        if (--reader->remaining[reader->depth - 1] > 0) return 0;
+        reader->depth--;
+    }
+    return 1;
 }
 
-static int picoredis_exec_expire(picoredis_t *ctx, const char *key, size_t seconds)
+// resumable RESP parser. every byte between receive_begin and receive_end is
+// visited at most once, bulk payloads are skipped by their declared length.
+// returns 1 when a whole reply is available in reader->tokens,
+// 0 when more bytes are required and -1 on protocol error.
+static int picoredis_reader_parse(picoredis_t *ctx)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%zu", seconds);
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_EXPIRE, key, int_value);
-    return reply ? reply->v.ivalue : 0;
-}
+    picoredis_reader_t *reader = &ctx->reader;
+    const char *buf  = ctx->receive_buf;
+    size_t base      = ctx->receive_begin;
+    size_t end       = ctx->receive_end;
+    if (reader->pos < base) {
+        reader->pos = base;
+    }
+    while (reader->pos < end) {
+        picoredis_token_t *token = reader->token_num ? &reader->tokens[reader->token_num - 1] : NULL;
+        switch (reader->state) {
+        case PICOREDIS_READER_TYPE: {
+            picoredis_reply_type type;
+            switch (buf[reader->pos]) {
+            case '+': type = PICOREDIS_REPLY_SINGLE_LINE; break;
+            case '-': type = PICOREDIS_REPLY_ERROR;       break;
+            case ':': type = PICOREDIS_REPLY_NUM;         break;
+            case '$': type = PICOREDIS_REPLY_BULK;        break;
+            case '*': type = PICOREDIS_REPLY_MULTI_BULK;  break;
+            default:
+                return -1;
+            }
+            reader->pos++;
+            if (!picoredis_reader_push_token(reader, type, reader->pos - base)) return -1;
+            reader->sign   = 1;
+            reader->number = 0;
+            reader->state  = (type == PICOREDIS_REPLY_SINGLE_LINE || type == PICOREDIS_REPLY_ERROR) ?
+                PICOREDIS_READER_LINE : PICOREDIS_READER_NUMBER;
+            break;
+        }
+        case PICOREDIS_READER_LINE: {
+            const char *cr = (const char *)memchr(buf + reader->pos, '\r', end - reader->pos);
+            if (!cr) {
+                reader->pos = end;
+                break;
+            }
+            reader->pos   = cr - buf;
+            token->length = reader->pos - base - token->offset;
+            reader->pos++;
+            reader->state = PICOREDIS_READER_LF;
+            break;
+        }
+        case PICOREDIS_READER_NUMBER: {
+            // lengths and integers are short, so the digits are folded in a tight loop
+            // instead of going back through the state switch for every byte
+            unsigned long long number = reader->number;
+            // LLONG_MIN has one more unit of magnitude than LLONG_MAX
+            unsigned long long limit  = (unsigned long long)LLONG_MAX + (reader->sign < 0);
+            while (reader->pos < end && (unsigned char)(buf[reader->pos] - '0') <= 9) {
+                unsigned digit = buf[reader->pos++] - '0';
+                if (number > (limit - digit) / 10) return -1;
+                number = number * 10 + digit;
+            }
+            reader->number = number;
+            if (reader->pos == end) break;
+
+            char c = buf[reader->pos++];
+            size_t digits = reader->pos - 1 - base - token->offset;
+            if (c == '-' && digits == 0) {
+                reader->sign = -1;
+            } else if (c == '\r') {
+                // a sign alone or nothing at all is not a number
+                if (digits == 0 || (reader->sign < 0 && digits == 1)) return -1;
+                token->length = digits;
+                reader->state = PICOREDIS_READER_LF;
+            } else {
+                return -1;
+            }
+            break;
+        }
+        case PICOREDIS_READER_LF: {
+            if (buf[reader->pos++] != '\n') return -1;
+            long long number = (reader->sign < 0 && reader->number > 0) ?
+                -(long long)(reader->number - 1) - 1 : (long long)reader->number;
+            switch (token->type) {
+            case PICOREDIS_REPLY_NUM:
+                token->integer = number;
+                if (picoredis_reader_value_done(reader)) return 1;
+                break;
+            case PICOREDIS_REPLY_BULK:
+                if (number > PICOREDIS_MAX_BULK_LENGTH) return -1;
+                token->length = number;
+                token->offset = reader->pos - base;
+                if (number < 0) {
+                    if (picoredis_reader_value_done(reader)) return 1;
+                    break;
+                }
+                reader->bulk_remaining = number + 2; // payload + '\r\n'
+                reader->state          = PICOREDIS_READER_BULK;
+                break;
+            case PICOREDIS_REPLY_MULTI_BULK:
+                if (number > PICOREDIS_MAX_MULTI_BULK_LENGTH) return -1;
+                token->length = number;
+                if (number <= 0) {
+                    if (picoredis_reader_value_done(reader)) return 1;
+                    break;
+                }
+                if (reader->depth == PICOREDIS_READER_MAX_DEPTH) return -1;
+                reader->remaining[reader->depth++] = number;
+                reader->state = PICOREDIS_READER_TYPE;
+                break;
+            default:
+                if (picoredis_reader_value_done(reader)) return 1;
+                break;
+            }
+            break;
+        }
+        case PICOREDIS_READER_BULK: {
+            size_t available = end - reader->pos;
+            if (available < reader->bulk_remaining) {
+                reader->pos            += available;
+                reader->bulk_remaining -= available;
+                break;
+            }
+            reader->pos           += reader->bulk_remaining;
+            reader->bulk_remaining = 0;
+            if (buf[reader->pos - 2] != '\r' || buf[reader->pos - 1] != '\n') return -1;
+            if (picoredis_reader_value_done(reader)) return 1;
+            break;
+        }
+        }
+    }
+    return 0;
+}
 
-static int picoredis_exec_expireat(picoredis_t *ctx, const char *key, time_t unixtime)
+static void picoredis_reader_consume(picoredis_t *ctx)
 {
-    char time_value[64] = {0};
-    snprintf(time_value, sizeof(time_value), "%zu", unixtime);
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_EXPIREAT, key, time_value);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reader_t *reader = &ctx->reader;
+    ctx->receive_begin = reader->pos;
+    if (ctx->receive_begin == ctx->receive_end) {
+        ctx->receive_begin = ctx->receive_end = 0;
+    }
+    reader->pos       = ctx->receive_begin;
+    reader->state     = PICOREDIS_READER_TYPE;
+    reader->depth     = 0;
+    reader->token_num = 0;
 }
 
-static int picoredis_exec_persist(picoredis_t *ctx, const char *key)
+static size_t picoredis_reader_next_sibling(picoredis_reader_t *reader, size_t idx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_PERSIST, key);
-    return reply ? reply->v.ivalue : 0;
+    long long pending = 1;
+    for (; pending > 0; ++idx) {
+        picoredis_token_t *token = &reader->tokens[idx];
+        pending--;
+        if (token->type == PICOREDIS_REPLY_MULTI_BULK && token->length > 0) {
+            pending += token->length;
+        }
+    }
+    return idx;
 }
 
-static int picoredis_exec_ttl(picoredis_t *ctx, const char *key)
+static char *picoredis_reply_copy_string(const char *src, size_t length)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_TTL, key);
-    return reply ? reply->v.ivalue : 0;
+    char *ret = (char *)malloc(length + 1);
+    memcpy(ret, src, length);
+    ret[length] = '\0';
+    return ret;
 }
 
-static int picoredis_exec_select(picoredis_t *ctx, size_t index)
+static char *picoredis_arena_copy_string(picoredis_arena_t *arena, const char *src, size_t length)
 {
-    char index_value[64] = {0};
-    snprintf(index_value, sizeof(index_value), "%zu", index);
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SELECT, index_value);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    char *ret = (char *)picoredis_arena_alloc(arena, length + 1);
+    if (!ret) return NULL;
+    memcpy(ret, src, length);
+    ret[length] = '\0';
+    return ret;
 }
 
-static int picoredis_exec_move(picoredis_t *ctx, const char *key, size_t dbindex)
+static picoredis_reply_t *picoredis_reply_create(picoredis_t *ctx)
 {
-    char index_value[64] = {0};
-    snprintf(index_value, sizeof(index_value), "%zu", dbindex);
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_MOVE, key, index_value);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reader_t *reader = &ctx->reader;
+    const char *base           = ctx->receive_buf + ctx->receive_begin;
+    picoredis_token_t *token   = &reader->tokens[0];
+    picoredis_arena_t *arena   = &ctx->arena;
+    picoredis_reply_t *reply   = (picoredis_reply_t *)picoredis_arena_alloc(arena, sizeof(picoredis_reply_t));
+    if (!reply) {
+        ctx->error = "cannot allocate reply";
+        return NULL;
+    }
+    memset(reply, 0, sizeof(picoredis_reply_t));
+    reply->type  = token->type;
+    reply->arena = arena;
+    arena->live_replies++;
+
+    int failed = 0;
+    switch (token->type) {
+    case PICOREDIS_REPLY_SINGLE_LINE:
+    case PICOREDIS_REPLY_ERROR:
+        reply->length   = (int)token->length;
+        reply->v.svalue = picoredis_arena_copy_string(arena, base + token->offset, token->length);
+        failed          = !reply->v.svalue;
+        break;
+    case PICOREDIS_REPLY_NUM:
+        reply->v.ivalue = (int)token->integer;
+        break;
+    case PICOREDIS_REPLY_BULK:
+        reply->length = (int)token->length;
+        if (token->length >= 0) {
+            reply->v.svalue = picoredis_arena_copy_string(arena, base + token->offset, token->length);
+            failed          = !reply->v.svalue;
+        }
+        break;
+    case PICOREDIS_REPLY_MULTI_BULK: {
+        reply->length = (int)token->length;
+        if (token->length < 0) break;
+
+        picoredis_array_t *array = (picoredis_array_t *)picoredis_arena_alloc(arena, sizeof(picoredis_array_t));
+        if (!array) {
+            failed = 1;
+            break;
+        }
+        array->num      = token->length;
+        array->values   = (const char **)picoredis_arena_alloc(arena, sizeof(const char *) * token->length);
+        array->lengths  = (size_t *)picoredis_arena_alloc(arena, sizeof(size_t) * token->length);
+        reply->v.avalue = array;
+        if (!array->values || !array->lengths) {
+            failed = 1;
+            break;
+        }
+        size_t idx = 1;
+        long long i = 0;
+        for (; i < token->length; ++i) {
+            picoredis_token_t *element = &reader->tokens[idx];
+            const char *value = NULL;
+            size_t length     = 0;
+            if (element->type != PICOREDIS_REPLY_MULTI_BULK && element->length >= 0) {
+                length = element->length;
+                value  = picoredis_arena_copy_string(arena, base + element->offset, length);
+                if (!value) {
+                    failed = 1;
+                    break;
+                }
+            }
+            reply->v.avalue->values[i]  = value;
+            reply->v.avalue->lengths[i] = length;
+            idx = picoredis_reader_next_sibling(reader, idx);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    if (failed) {
+        picoredis_reply_free(reply);
+        ctx->error = "cannot allocate reply";
+        return NULL;
+    }
+    return reply;
 }
 
-static int picoredis_exec_flushdb(picoredis_t *ctx)
+static int picoredis_reply_view_create(picoredis_t *ctx, picoredis_reply_view_t *view)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_FLUSHDB);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    picoredis_reader_t *reader = &ctx->reader;
+    const char *base           = ctx->receive_buf + ctx->receive_begin;
+    picoredis_token_t *token   = &reader->tokens[0];
+    memset(view, 0, sizeof(picoredis_reply_view_t));
+    view->type = token->type;
+
+    switch (token->type) {
+    case PICOREDIS_REPLY_NUM:
+        view->integer = token->integer;
+        // fallthrough
+    case PICOREDIS_REPLY_SINGLE_LINE:
+    case PICOREDIS_REPLY_ERROR:
+        view->value.ptr    = base + token->offset;
+        view->value.length = token->length;
+        break;
+    case PICOREDIS_REPLY_BULK:
+        view->is_nil = token->length < 0;
+        if (!view->is_nil) {
+            view->value.ptr    = base + token->offset;
+            view->value.length = token->length;
+        }
+        break;
+    case PICOREDIS_REPLY_MULTI_BULK: {
+        view->is_nil = token->length < 0;
+        if (token->length <= 0) break;
+
+        if (ctx->view_capacity < (size_t)token->length) {
+            picoredis_view_t *new_views = (picoredis_view_t *)realloc(ctx->views, sizeof(picoredis_view_t) * token->length);
+            if (!new_views) {
+                ctx->error = "cannot allocate reply view";
+                return -1;
+            }
+            ctx->views         = new_views;
+            ctx->view_capacity = token->length;
+        }
+        view->num      = token->length;
+        view->elements = ctx->views;
+        size_t idx = 1;
+        size_t i   = 0;
+        for (; i < view->num; ++i) {
+            picoredis_token_t *element = &reader->tokens[idx];
+            picoredis_view_t *slice    = &view->elements[i];
+            slice->ptr    = NULL;
+            slice->length = 0;
+            if (element->type != PICOREDIS_REPLY_MULTI_BULK && element->length >= 0) {
+                slice->ptr    = base + element->offset;
+                slice->length = element->length;
+            }
+            idx = picoredis_reader_next_sibling(reader, idx);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return 0;
 }
 
-static int picoredis_exec_flushall(picoredis_t *ctx)
+// waits until one whole reply is available in ctx->reader
+static int picoredis_receive_reply(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_FLUSHALL);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    for (;;) {
+        int parse_result = picoredis_reader_parse(ctx);
+        if (parse_result > 0) return 0;
+        if (parse_result < 0) {
+            picoredis_disconnect(ctx, "protocol error");
+            return -1;
+        }
+        if (picoredis_receive_more(ctx) < 0) return -1;
+    }
 }
 
-static int picoredis_exec_watch(picoredis_t *ctx, size_t nargs, ...)
+static picoredis_reply_t *picoredis_receive_command(picoredis_t *ctx)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_WATCH, nargs, list);
-    va_end(list);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    if (picoredis_receive_reply(ctx) < 0) return NULL;
+
+    picoredis_reply_t *reply = picoredis_reply_create(ctx);
+    picoredis_reader_consume(ctx);
+    return reply;
 }
 
-static int picoredis_exec_unwatch(picoredis_t *ctx)
+// the bytes stay in receive_buf after consume, so the view survives until the next read
+static int picoredis_receive_view(picoredis_t *ctx, picoredis_reply_view_t *view)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_UNWATCH);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    if (picoredis_receive_reply(ctx) < 0) return -1;
+
+    int ret = picoredis_reply_view_create(ctx, view);
+    picoredis_reader_consume(ctx);
+    return ret;
 }
 
-static int picoredis_exec_multi(picoredis_t *ctx)
+// copies the value at tokens[idx] into node and returns the index after it.
+// the members of an array are placed next to each other at *next_node.
+static size_t picoredis_reply_tree_fill(picoredis_t *ctx, size_t idx, picoredis_reply_tree_t *node, picoredis_reply_tree_t **next_node, char **data)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_MULTI);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    picoredis_token_t *token = &ctx->reader.tokens[idx];
+    const char *base = ctx->receive_buf + ctx->receive_begin;
+    memset(node, 0, sizeof(picoredis_reply_tree_t));
+    node->type = token->type;
+    switch (token->type) {
+    case PICOREDIS_REPLY_NUM:
+        node->integer = token->integer;
+        return idx + 1;
+    case PICOREDIS_REPLY_MULTI_BULK: {
+        node->is_nil = token->length < 0;
+        if (token->length <= 0) return idx + 1;
+
+        node->num      = token->length;
+        node->elements = *next_node;
+        *next_node    += node->num;
+        size_t child = idx + 1;
+        size_t i = 0;
+        for (; i < node->num; ++i) {
+            child = picoredis_reply_tree_fill(ctx, child, &node->elements[i], next_node, data);
+        }
+        return child;
+    }
+    default:
+        node->is_nil = token->length < 0;
+        if (node->is_nil) return idx + 1;
+
+        memcpy(*data, base + token->offset, token->length);
+        (*data)[token->length] = '\0';
+        node->value.ptr    = *data;
+        node->value.length = token->length;
+        *data += token->length + 1;
+        return idx + 1;
+    }
 }
 
-static int picoredis_exec_exec(picoredis_t *ctx)
+static picoredis_reply_tree_t *picoredis_reply_tree_create(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_EXEC);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    picoredis_reader_t *reader = &ctx->reader;
+    size_t data_size = 0;
+    size_t i = 0;
+    for (; i < reader->token_num; ++i) {
+        picoredis_token_t *token = &reader->tokens[i];
+        if (token->type != PICOREDIS_REPLY_NUM && token->type != PICOREDIS_REPLY_MULTI_BULK && token->length >= 0) {
+            data_size += token->length + 1;
+        }
+    }
+    size_t nodes_size = sizeof(picoredis_reply_tree_t) * reader->token_num;
+    picoredis_reply_tree_t *tree = (picoredis_reply_tree_t *)malloc(nodes_size + data_size);
+    if (!tree) {
+        ctx->error = "cannot allocate reply";
+        return NULL;
+    }
+    picoredis_reply_tree_t *next_node = tree + 1;
+    char *data = (char *)tree + nodes_size;
+    picoredis_reply_tree_fill(ctx, 0, tree, &next_node, &data);
+    return tree;
 }
 
-static int picoredis_exec_discard(picoredis_t *ctx)
+static void picoredis_reply_tree_free(picoredis_reply_tree_t *tree)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_DISCARD);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    free(tree);
 }
 
-static picoredis_array_t *picoredis_exec_sort(picoredis_t *ctx, size_t nargs, ...)
+static int picoredis_append_command_argv(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
+{
+    size_t value_lengths[nargs + 1];
+    if (!lengths) {
+        size_t i = 0;
+        for (; i < nargs; ++i) {
+            value_lengths[i] = strlen(values[i]);
+        }
+        value_lengths[nargs] = 0;
+        lengths = value_lengths;
+    }
+    if (picoredis_command_encode(ctx, type, nargs, values, lengths) < 0) return -1;
+
+    ctx->pending_replies++;
+    return 0;
+}
+
+static int picoredis_append_command(picoredis_t *ctx, picoredis_command_type type, size_t nargs, ...)
 {
+    const char *values[nargs + 1];
     va_list list;
     va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SORT, nargs, list);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
     va_end(list);
-    if (!reply) return NULL;
-    if (reply->type == PICOREDIS_REPLY_ERROR) return NULL;
-    return reply->v.avalue;
+    return picoredis_append_command_argv(ctx, type, nargs, values, NULL);
 }
 
-static void picoredis_exec_set(picoredis_t *ctx, const char *key, const char *value)
+// writes every queued command with as few send() calls as the kernel allows
+// a failed flush may have written part of a command, so the connection is
+// closed instead of leaving a torn request on the wire
+static int picoredis_flush(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_SET, key, value);
-    if (!reply) {
-        ctx->error = "cannot receive reply";
-        return;
+#ifdef PICOREDIS_HAS_IO_URING
+    if (ctx->uring) {
+        if (picoredis_uring_flush(ctx) < 0) {
+            picoredis_disconnect(ctx, ctx->error);
+            return -1;
+        }
+        return 0;
     }
-
-    if (reply->v.ivalue == -1) {
-        ctx->error = "cannot set";
-        return;
+#endif
+    size_t sent = 0;
+    while (sent < ctx->send_length) {
+        ssize_t ret = send(ctx->sock, ctx->send_buf + sent, ctx->send_length - sent, 0);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) {
+            picoredis_disconnect(ctx, ret < 0 ? strerror(errno) : "connection closed by server");
+            return -1;
+        }
+        sent += ret;
     }
+    ctx->send_length = 0;
+    return 0;
 }
 
-static char *picoredis_exec_get(picoredis_t *ctx, const char *key)
+// writes iov with writev(). the caller's memory is sent in place, so values
+// referenced by iov are never copied into send_buf.
+static int picoredis_send_iov(picoredis_t *ctx, struct iovec *iov, size_t iovcnt)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_GET, key);
-    if (!reply) return NULL;
-    if (reply->length < 0) return NULL;
-
-    return reply->v.svalue;
+    while (iovcnt > 0) {
+        ssize_t ret = writev(ctx->sock, iov, iovcnt < PICOREDIS_IOV_MAX ? iovcnt : PICOREDIS_IOV_MAX);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) {
+            ctx->error = strerror(errno);
+            return -1;
+        }
+        size_t sent = ret;
+        for (; iovcnt > 0 && sent >= iov->iov_len; ++iov, --iovcnt) {
+            sent -= iov->iov_len;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return 0;
 }
 
-static char *picoredis_exec_getset(picoredis_t *ctx, const char *key, const char *value)
+// sends length bytes of fd from offset. on Linux sendfile() moves them without
+// a copy through user space, elsewhere they are read in chunks into send_buf.
+static int picoredis_send_file(picoredis_t *ctx, int fd, off_t offset, size_t length)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_GETSET, key, value);
-    if (!reply) return NULL;
-    if (reply->length < 0) return NULL;
-
-    return reply->v.svalue;
+#ifdef __linux__
+    while (length > 0) {
+        ssize_t ret = sendfile(ctx->sock, fd, &offset, length);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (ret <= 0) {
+            ctx->error = (ret == 0) ? "file is shorter than length" : strerror(errno);
+            return -1;
+        }
+        length -= ret;
+    }
+#endif
+    if (length > 0 && picoredis_reserve_send_buf(ctx, PICOREDIS_SEND_BUFFER_SIZE) < 0) return -1;
+    while (length > 0) {
+        size_t chunk = length < ctx->send_buf_size ? length : ctx->send_buf_size;
+        ssize_t ret  = pread(fd, ctx->send_buf, chunk, offset);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) {
+            ctx->error = (ret == 0) ? "file is shorter than length" : strerror(errno);
+            return -1;
+        }
+        ctx->send_length = ret;
+        if (picoredis_flush(ctx) < 0) return -1;
+        offset += ret;
+        length -= ret;
+    }
+    return 0;
 }
 
-static int picoredis_exec_setnx(picoredis_t *ctx, const char *key, const char *value)
+#ifdef PICOREDIS_HAS_IO_URING
+// user_data of the two kinds of requests kept in flight
+#define PICOREDIS_URING_SEND 1
+#define PICOREDIS_URING_RECV 2
+
+// io_uring is driven through the raw system calls so that no liburing is required
+static picoredis_uring_t *picoredis_uring_create(void)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_SETNX, key, value);
-    return reply ? reply->v.ivalue : 0;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, PICOREDIS_URING_ENTRIES, &params);
+    if (fd < 0) return NULL;
+
+    picoredis_uring_t *uring = (picoredis_uring_t *)malloc(sizeof(picoredis_uring_t));
+    memset(uring, 0, sizeof(picoredis_uring_t));
+    uring->fd           = fd;
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_ring_size > uring->sq_ring_size) {
+            uring->sq_ring_size = uring->cq_ring_size;
+        }
+        uring->cq_ring_size = 0;
+    }
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        uring->sq_ring = NULL;
+        picoredis_uring_free(uring);
+        return NULL;
+    }
+    uring->cq_ring = uring->sq_ring;
+    if (uring->cq_ring_size > 0) {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) {
+            uring->cq_ring = NULL;
+            picoredis_uring_free(uring);
+            return NULL;
+        }
+    }
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe *)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        picoredis_uring_free(uring);
+        return NULL;
+    }
+    char *sq = (char *)uring->sq_ring;
+    char *cq = (char *)uring->cq_ring;
+    uring->sq_head    = (unsigned *)(sq + params.sq_off.head);
+    uring->sq_tail    = (unsigned *)(sq + params.sq_off.tail);
+    uring->sq_mask    = (unsigned *)(sq + params.sq_off.ring_mask);
+    uring->sq_entries = (unsigned *)(sq + params.sq_off.ring_entries);
+    uring->sq_array   = (unsigned *)(sq + params.sq_off.array);
+    uring->cq_head    = (unsigned *)(cq + params.cq_off.head);
+    uring->cq_tail    = (unsigned *)(cq + params.cq_off.tail);
+    uring->cq_mask    = (unsigned *)(cq + params.cq_off.ring_mask);
+    uring->cqes       = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // the buffer ring has to be page aligned, so it leads one anonymous mapping
+    // that also holds the receive buffers. MAP_POPULATE faults everything in up front.
+    size_t ring_size = (sizeof(struct io_uring_buf) * PICOREDIS_URING_BUFFER_NUM + 4095) & ~(size_t)4095;
+    uring->buf_region_size = ring_size + PICOREDIS_URING_BUFFER_NUM * PICOREDIS_URING_BUFFER_SIZE;
+    void *region = mmap(NULL, uring->buf_region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (region == MAP_FAILED) {
+        picoredis_uring_free(uring);
+        return NULL;
+    }
+    uring->buf_ring = (struct io_uring_buf_ring *)region;
+    uring->buffers  = (char *)region + ring_size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (unsigned long)uring->buf_ring;
+    reg.ring_entries = PICOREDIS_URING_BUFFER_NUM;
+    reg.bgid         = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        picoredis_uring_free(uring);
+        return NULL;
+    }
+    unsigned short bid = 0;
+    for (; bid < PICOREDIS_URING_BUFFER_NUM; ++bid) {
+        picoredis_uring_recycle(uring, bid);
+    }
+    return uring;
 }
 
-static int picoredis_exec_setex(picoredis_t *ctx, const char *key, time_t time, const char *value)
+static void picoredis_uring_free(picoredis_uring_t *uring)
 {
-    char time_value[64] = {0};
-    snprintf(time_value, sizeof(time_value), "%zu", time);
-
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_SETEX, key, time_value, value);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    if (!uring) return;
+
+    if (uring->buf_ring)                     munmap(uring->buf_ring, uring->buf_region_size);
+    if (uring->sqes)                         munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring && uring->cq_ring_size) munmap(uring->cq_ring, uring->cq_ring_size);
+    if (uring->sq_ring)                      munmap(uring->sq_ring, uring->sq_ring_size);
+    close(uring->fd);
+    free(uring);
 }
 
-static int picoredis_exec_mset(picoredis_t *ctx, size_t nargs, ...)
+// only fills the submission queue, picoredis_uring_enter hands it to the kernel
+static int picoredis_uring_queue(picoredis_uring_t *uring, int opcode, int fd, const void *addr, size_t length, int flags, int ioprio, unsigned long long user_data)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_MSET, nargs, list);
-    va_end(list);
-    if (!reply) return 0;
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    unsigned tail = *uring->sq_tail;
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == *uring->sq_entries) return -1;
+
+    unsigned idx = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->addr      = (unsigned long)addr;
+    sqe->len       = length;
+    sqe->flags     = flags;
+    sqe->ioprio    = ioprio;
+    sqe->user_data = user_data;
+    if (opcode == IORING_OP_SEND) {
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+    uring->sq_array[idx] = idx;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring->to_submit++;
+    return 0;
 }
 
-static int picoredis_exec_msetnx(picoredis_t *ctx, size_t nargs, ...)
+// submits everything queued and waits for `wait` completions with one system call
+static int picoredis_uring_enter(picoredis_t *ctx, unsigned wait)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_MSET, nargs, list);
-    va_end(list);
-    if (!reply) return 0;
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    picoredis_uring_t *uring = ctx->uring;
+    for (;;) {
+        uring->enter_count++;
+        int ret = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            uring->to_submit -= ret;
+            return 0;
+        }
+        if (errno != EINTR) {
+            ctx->error = strerror(errno);
+            return -1;
+        }
+    }
 }
 
-static int picoredis_exec_incr(picoredis_t *ctx, const char *key)
+static void picoredis_uring_recycle(picoredis_uring_t *uring, unsigned short bid)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_INCR, key);
-    return reply ? reply->v.ivalue : 0;
+    struct io_uring_buf *buf = &uring->buf_ring->bufs[uring->buf_tail & (PICOREDIS_URING_BUFFER_NUM - 1)];
+    buf->addr = (unsigned long)(uring->buffers + (size_t)bid * PICOREDIS_URING_BUFFER_SIZE);
+    buf->len  = PICOREDIS_URING_BUFFER_SIZE;
+    buf->bid  = bid;
+    uring->buf_tail++;
+    __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
 }
 
-static int picoredis_exec_incrby(picoredis_t *ctx, const char *key, int value)
+// drains the completion queue without a system call.
+// received bytes are appended to receive_buf, returns their count or -1.
+// the whole batch is always consumed and ctx->error keeps the first failure.
+static int picoredis_uring_reap(picoredis_t *ctx)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%d", value);
-
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_INCRBY, key, int_value);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_uring_t *uring = ctx->uring;
+    unsigned head = *uring->cq_head;
+    unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    int received  = 0;
+    int dropped   = 0;
+    int ret       = 0;
+    for (; head != tail; ++head) {
+        struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+        if (cqe->user_data == PICOREDIS_URING_SEND) {
+            uring->send_inflight = 0;
+            uring->send_result   = cqe->res;
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            uring->recv_armed = 0;
+        }
+        if (cqe->res == -ENOBUFS) continue; // rearmed by the next receive
+        if (cqe->res < 0) {
+            if (ret == 0) {
+                ctx->error = strerror(-cqe->res);
+            }
+            ret = -1;
+            continue;
+        }
+        if (cqe->res == 0) {
+            uring->closed = 1;
+            continue;
+        }
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        const char *error  = ctx->error;
+        if (dropped) {
+            // the stream already has a gap, later bytes cannot be parsed
+        } else if (picoredis_reserve_receive_buf(ctx, cqe->res) == 0) {
+            memcpy(ctx->receive_buf + ctx->receive_end, uring->buffers + (size_t)bid * PICOREDIS_URING_BUFFER_SIZE, cqe->res);
+            ctx->receive_end += cqe->res;
+            received         += cqe->res;
+        } else {
+            if (ret < 0) {
+                ctx->error = error;
+            }
+            dropped = 1;
+            ret     = -1;
+        }
+        picoredis_uring_recycle(uring, bid);
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return ret < 0 ? -1 : received;
 }
 
-static int picoredis_exec_decr(picoredis_t *ctx, const char *key)
+// the multishot receive stays armed across commands, so the replies of a batch
+// are usually already completed when the send completion is reaped
+static int picoredis_uring_arm_recv(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_DECR, key);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_uring_t *uring = ctx->uring;
+    if (uring->recv_armed || uring->closed) return 0;
+    if (picoredis_uring_queue(uring, IORING_OP_RECV, ctx->sock, NULL, 0, IOSQE_BUFFER_SELECT, IORING_RECV_MULTISHOT, PICOREDIS_URING_RECV) < 0) {
+        ctx->error = "io_uring submission queue is full";
+        return -1;
+    }
+    uring->recv_armed = 1;
+    return 0;
 }
 
-static int picoredis_exec_decrby(picoredis_t *ctx, const char *key, int value)
+static int picoredis_uring_flush(picoredis_t *ctx)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%d", value);
-
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_DECRBY, key, int_value);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_uring_t *uring = ctx->uring;
+    if (picoredis_uring_arm_recv(ctx) < 0) return -1;
+
+    size_t sent = 0;
+    while (sent < ctx->send_length) {
+        if (picoredis_uring_queue(uring, IORING_OP_SEND, ctx->sock, ctx->send_buf + sent, ctx->send_length - sent, 0, 0, PICOREDIS_URING_SEND) < 0) {
+            ctx->error = "io_uring submission queue is full";
+            return -1;
+        }
+        // send_buf is reused by the next command, so the send has to complete here
+        uring->send_inflight = 1;
+        int reap_result = 0;
+        while (uring->send_inflight) {
+            if (picoredis_uring_enter(ctx, 1) < 0) return -1;
+            if (picoredis_uring_reap(ctx) < 0) {
+                reap_result = -1;
+            }
+        }
+        if (reap_result < 0) return -1;
+        if (uring->send_result <= 0) {
+            ctx->error = uring->send_result ? strerror(-uring->send_result) : "connection closed by server";
+            return -1;
+        }
+        sent += uring->send_result;
+    }
+    ctx->send_length = 0;
+    return 0;
 }
 
-static int picoredis_exec_append(picoredis_t *ctx, const char *key, const char *value)
+static int picoredis_uring_receive(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_APPEND, key, value);
-    return reply ? reply->v.ivalue : 0;
+    for (;;) {
+        int received = picoredis_uring_reap(ctx);
+        if (received != 0) return received;
+        if (ctx->uring->closed) {
+            ctx->error = "connection closed by server";
+            return -1;
+        }
+        if (picoredis_uring_arm_recv(ctx) < 0) return -1;
+        if (picoredis_uring_enter(ctx, 1) < 0) return -1;
+    }
 }
+#endif
 
-static char *picoredis_exec_substr(picoredis_t *ctx, const char *key, int start, int end)
+// returns a malloc'ed copy that the caller owns
+static char *picoredis_reply_view_string(picoredis_reply_view_t *view, size_t *length)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
-
-    char end_value[64] = {0};
-    snprintf(end_value, sizeof(end_value), "%d", end);
+    if (view->type == PICOREDIS_REPLY_ERROR || view->type == PICOREDIS_REPLY_MULTI_BULK || view->is_nil) return NULL;
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_SUBSTR, key, start_value, end_value);
-    return reply ? reply->v.svalue : NULL;
+    if (length) *length = view->value.length;
+    return picoredis_reply_copy_string(view->value.ptr, view->value.length);
 }
 
-static int picoredis_exec_lpush(picoredis_t *ctx, const char *key, const char *value)
+// returns an array owned by the caller and released by picoredis_array_free
+static picoredis_array_t *picoredis_reply_view_array(picoredis_reply_view_t *view)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_LPUSH, key, value);
-    return reply ? reply->v.ivalue : 0;
+    if (view->type != PICOREDIS_REPLY_MULTI_BULK || view->is_nil) return NULL;
+
+    size_t data_size = 0;
+    size_t i = 0;
+    for (; i < view->num; ++i) {
+        data_size += view->elements[i].length + 1;
+    }
+    picoredis_array_t *array = picoredis_array_create(view->num, data_size);
+    if (!array) return NULL;
+
+    char *data = (char *)(array->lengths + view->num);
+    for (i = 0; i < view->num; ++i) {
+        picoredis_view_t *element = &view->elements[i];
+        array->lengths[i] = element->length;
+        if (!element->ptr) {
+            array->values[i] = NULL;
+            continue;
+        }
+        memcpy(data, element->ptr, element->length);
+        data[element->length] = '\0';
+        array->values[i] = data;
+        data += element->length + 1;
+    }
+    return array;
 }
 
-static int picoredis_exec_rpush(picoredis_t *ctx, const char *key, const char *value)
+static int picoredis_prepare_reply(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RPUSH, key, value);
-    return reply ? reply->v.ivalue : 0;
+    if (ctx->async) {
+        ctx->error = "cannot wait for a reply on an async context";
+        return -1;
+    }
+    if (ctx->send_length > 0 && picoredis_flush(ctx) < 0) return -1;
+    if (ctx->pending_replies == 0) {
+        ctx->error = "no pending reply";
+        return -1;
+    }
+    return 0;
 }
 
-static int picoredis_exec_llen(picoredis_t *ctx, const char *key)
+static picoredis_reply_t *picoredis_get_reply(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_LLEN, key);
-    return reply ? reply->v.ivalue : 0;
+    if (picoredis_prepare_reply(ctx) < 0) return NULL;
+
+    picoredis_reply_t *reply = picoredis_receive_command(ctx);
+    if (reply) {
+        ctx->pending_replies--;
+    }
+    return reply;
 }
 
-static picoredis_array_t *picoredis_exec_lrange(picoredis_t *ctx, const char *key, int start, int end)
+static int picoredis_get_reply_view(picoredis_t *ctx, picoredis_reply_view_t *view)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
+    if (picoredis_prepare_reply(ctx) < 0) return -1;
+    if (picoredis_receive_view(ctx, view) < 0) return -1;
 
-    char end_value[64] = {0};
-    snprintf(end_value, sizeof(end_value), "%d", end);
-
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LRANGE, key, start_value, end_value);
-    return reply ? reply->v.avalue : NULL;
+    ctx->pending_replies--;
+    return 0;
 }
 
-static int picoredis_exec_ltrim(picoredis_t *ctx, const char *key, int start, int end)
+// returns 1 and sets value for an integer reply or a bulk holding an integer,
+// 0 for nil and -1 otherwise
+static int picoredis_reply_view_int64(picoredis_t *ctx, picoredis_reply_view_t *view, int64_t *value)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
-
-    char end_value[64] = {0};
-    snprintf(end_value, sizeof(end_value), "%d", end);
+    switch (view->type) {
+    case PICOREDIS_REPLY_NUM:
+        *value = view->integer;
+        return 1;
+    case PICOREDIS_REPLY_BULK:
+        if (view->is_nil) return 0;
+        if (picoredis_parse_int64(view->value.ptr, view->value.length, value) == 0) return 1;
+        ctx->error = "value is not an integer";
+        return -1;
+    default:
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
+}
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LTRIM, key, start_value, end_value);
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+// returns 1 and sets value for a bulk holding a number, 0 for nil and -1 otherwise
+static int picoredis_reply_view_double(picoredis_t *ctx, picoredis_reply_view_t *view, double *value)
+{
+    switch (view->type) {
+    case PICOREDIS_REPLY_NUM:
+        *value = (double)view->integer;
+        return 1;
+    case PICOREDIS_REPLY_BULK:
+        if (view->is_nil) return 0;
+        if (picoredis_parse_double(view->value.ptr, view->value.length, value) == 0) return 1;
+        ctx->error = "value is not a number";
+        return -1;
+    default:
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
 }
 
-static char *picoredis_exec_lindex(picoredis_t *ctx, const char *key, int index)
+// copies a flat field / value reply into a picoredis_hash_t. the fields and
+// values are NUL-terminated like the values of picoredis_array_t.
+static picoredis_hash_t *picoredis_reply_view_hash(picoredis_reply_view_t *view)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%d", index);
+    if (view->type != PICOREDIS_REPLY_MULTI_BULK || view->num % 2 != 0) return NULL;
 
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_LINDEX, key, int_value);
-    return reply ? reply->v.svalue : NULL;
+    size_t num        = view->num / 2;
+    size_t table_size = 16;
+    for (; table_size < num * 2; table_size *= 2) {}
+    size_t data_size = 0;
+    size_t i = 0;
+    for (; i < view->num; ++i) {
+        data_size += view->elements[i].length + 1;
+    }
+    size_t header_size = sizeof(picoredis_hash_t) + sizeof(picoredis_view_t) * view->num + sizeof(size_t) * table_size;
+    char *block = (char *)malloc(header_size + data_size);
+    if (!block) return NULL;
+
+    picoredis_hash_t *hash = (picoredis_hash_t *)block;
+    hash->num        = num;
+    hash->fields     = (picoredis_view_t *)(block + sizeof(picoredis_hash_t));
+    hash->values     = hash->fields + num;
+    hash->table_size = table_size;
+    hash->table      = (size_t *)(hash->values + num);
+    memset(hash->table, 0, sizeof(size_t) * table_size);
+
+    char *data = block + header_size;
+    for (i = 0; i < view->num; ++i) {
+        picoredis_view_t *element = &view->elements[i];
+        picoredis_view_t *entry   = (i % 2 == 0) ? &hash->fields[i / 2] : &hash->values[i / 2];
+        memcpy(data, element->ptr, element->length);
+        data[element->length] = '\0';
+        entry->ptr    = data;
+        entry->length = element->length;
+        data += element->length + 1;
+    }
+    for (i = 0; i < num; ++i) {
+        size_t pos = picoredis_murmur3_32(hash->fields[i].ptr, hash->fields[i].length, 0) & (table_size - 1);
+        for (; hash->table[pos] != 0; pos = (pos + 1) & (table_size - 1)) {}
+        hash->table[pos] = i + 1;
+    }
+    return hash;
 }
 
-static int picoredis_exec_lset(picoredis_t *ctx, const char *key, int index, const char *value)
+// returns the next reply with nested arrays, owned by the caller
+static picoredis_reply_tree_t *picoredis_get_reply_tree(picoredis_t *ctx)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%d", index);
+    if (picoredis_prepare_reply(ctx) < 0) return NULL;
+    if (picoredis_receive_reply(ctx) < 0) return NULL;
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LSET, key, int_value, value);
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    picoredis_reply_tree_t *tree = picoredis_reply_tree_create(ctx);
+    picoredis_reader_consume(ctx);
+    ctx->pending_replies--;
+    return tree;
 }
 
-static int picoredis_exec_lrem(picoredis_t *ctx, const char *key, int count, const char *value)
+static picoredis_reply_tree_t *picoredis_exec_argv_tree(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
 {
-    char int_value[64] = {0};
-    snprintf(int_value, sizeof(int_value), "%d", count);
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return NULL;
+    }
+    if (picoredis_append_command_argv(ctx, type, nargs, values, lengths) < 0) return NULL;
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LREM, key, int_value, value);
-    return reply ? reply->v.ivalue : 0;
+    return picoredis_get_reply_tree(ctx);
 }
 
-static char *picoredis_exec_lpop(picoredis_t *ctx, const char *key)
+// reads until size bytes are available after receive_begin. consumed bytes are
+// recycled first, so the receive buffer only grows for a single larger value.
+static int picoredis_receive_at_least(picoredis_t *ctx, size_t size)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_LPOP, key);
-    return reply ? reply->v.svalue : NULL;
+    while (ctx->receive_end - ctx->receive_begin < size) {
+        ctx->reader.pos = ctx->receive_begin;
+        if (picoredis_reserve_receive_buf(ctx, size - (ctx->receive_end - ctx->receive_begin)) < 0) return -1;
+        if (picoredis_receive_more(ctx) < 0) return -1;
+    }
+    return 0;
 }
 
-static char *picoredis_exec_rpop(picoredis_t *ctx, const char *key)
+// parses one value at receive_begin without descending into arrays.
+// the view borrows the receive buffer until the next read. the reply is left
+// half read on failure, so the connection is dropped.
+static int picoredis_iterator_read(picoredis_t *ctx, picoredis_reply_view_t *element)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_RPOP, key);
-    return reply ? reply->v.svalue : NULL;
+    const char *lf;
+    while (!(lf = (const char *)memchr(ctx->receive_buf + ctx->receive_begin, '\n', ctx->receive_end - ctx->receive_begin))) {
+        if (picoredis_receive_at_least(ctx, ctx->receive_end - ctx->receive_begin + 1) < 0) {
+            picoredis_disconnect(ctx, ctx->error);
+            return -1;
+        }
+    }
+    const char *line = ctx->receive_buf + ctx->receive_begin;
+    size_t header    = lf + 1 - line;
+    if (header < 3 || lf[-1] != '\r') {
+        picoredis_disconnect(ctx, "protocol error");
+        return -1;
+    }
+    memset(element, 0, sizeof(picoredis_reply_view_t));
+    element->value.ptr    = line + 1;
+    element->value.length = header - 3;
+    switch (line[0]) {
+    case '+': element->type = PICOREDIS_REPLY_SINGLE_LINE; break;
+    case '-': element->type = PICOREDIS_REPLY_ERROR;       break;
+    case ':': element->type = PICOREDIS_REPLY_NUM;         break;
+    case '$': element->type = PICOREDIS_REPLY_BULK;        break;
+    case '*': element->type = PICOREDIS_REPLY_MULTI_BULK;  break;
+    default:
+        picoredis_disconnect(ctx, "protocol error");
+        return -1;
+    }
+    if (element->type == PICOREDIS_REPLY_NUM || element->type == PICOREDIS_REPLY_BULK || element->type == PICOREDIS_REPLY_MULTI_BULK) {
+        if (picoredis_parse_header_number(line[0], line + 1, header - 3, &element->integer) < 0) {
+            picoredis_disconnect(ctx, "protocol error");
+            return -1;
+        }
+    }
+    ctx->receive_begin += header;
+    if (element->type == PICOREDIS_REPLY_MULTI_BULK) {
+        element->value.ptr    = NULL;
+        element->value.length = 0;
+        element->is_nil       = element->integer < 0;
+        element->num          = element->integer < 0 ? 0 : element->integer;
+    } else if (element->type == PICOREDIS_REPLY_BULK) {
+        element->value.ptr    = NULL;
+        element->value.length = 0;
+        element->is_nil       = element->integer < 0;
+        if (!element->is_nil) {
+            size_t length = element->integer;
+            if (picoredis_receive_at_least(ctx, length + 2) < 0) {
+                picoredis_disconnect(ctx, ctx->error);
+                return -1;
+            }
+            const char *payload = ctx->receive_buf + ctx->receive_begin;
+            if (payload[length] != '\r' || payload[length + 1] != '\n') {
+                picoredis_disconnect(ctx, "protocol error");
+                return -1;
+            }
+            element->value.ptr    = payload;
+            element->value.length = length;
+            ctx->receive_begin   += length + 2;
+        }
+    }
+    return 0;
 }
 
-static char *picoredis_exec_rpoplpush(picoredis_t *ctx, const char *srckey, const char *dstkey)
+static void picoredis_iterator_finish(picoredis_iterator_t *iter)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RPOPLPUSH, srckey, dstkey);
-    return reply ? reply->v.svalue : NULL;
+    picoredis_t *ctx = iter->ctx;
+    iter->depth = 0;
+    ctx->pending_replies--;
+    ctx->reader.pos = ctx->receive_begin;
+    picoredis_reader_consume(ctx);
 }
 
-static int picoredis_exec_sadd(picoredis_t *ctx, const char *key, const char *member)
+// sends a command whose reply is read element by element with picoredis_iterator_next.
+// returns 1 when the reply is an array, 0 for a nil array and -1 on error.
+static int picoredis_exec_argv_iter(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_iterator_t *iter)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_SADD, key, member);
-    return reply ? reply->v.ivalue : 0;
+    iter->ctx   = ctx;
+    iter->depth = 0;
+    ctx->error  = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    if (picoredis_append_command_argv(ctx, type, nargs, values, lengths) < 0) return -1;
+
+    return picoredis_iterator_begin(ctx, iter);
 }
 
-static int picoredis_exec_srem(picoredis_t *ctx, const char *key, const char *member)
+// starts iterating over the next pending reply, which must be an array.
+// returns 1 when the reply is an array, 0 for a nil array and -1 on error.
+static int picoredis_iterator_begin(picoredis_t *ctx, picoredis_iterator_t *iter)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_SREM, key, member);
-    return reply ? reply->v.ivalue : 0;
+    iter->ctx   = ctx;
+    iter->depth = 0;
+    if (picoredis_prepare_reply(ctx) < 0) return -1;
+    if (picoredis_receive_at_least(ctx, 1) < 0) {
+        picoredis_disconnect(ctx, ctx->error);
+        return -1;
+    }
+    picoredis_reply_view_t header;
+    if (ctx->receive_buf[ctx->receive_begin] != '*') {
+        // error replies are small, let the reader consume them
+        if (picoredis_get_reply_view(ctx, &header) == 0) {
+            ctx->error = "unexpected reply type";
+        }
+        return -1;
+    }
+    if (picoredis_iterator_read(ctx, &header) < 0) return -1;
+    if (header.num > 0) {
+        iter->remaining[iter->depth++] = header.num;
+    } else {
+        picoredis_iterator_finish(iter);
+    }
+    return header.is_nil ? 0 : 1;
 }
 
-static char *picoredis_exec_spop(picoredis_t *ctx, const char *key)
+// returns 1 with the next element, 0 when the reply is exhausted and -1 on error.
+// the element borrows the receive buffer until the next call.
+static int picoredis_iterator_next(picoredis_iterator_t *iter, picoredis_reply_view_t *element)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SPOP, key);
-    return reply ? reply->v.svalue : NULL;
+    if (iter->depth == 0) return 0;
+
+    picoredis_t *ctx = iter->ctx;
+    if (picoredis_iterator_read(ctx, element) < 0) {
+        iter->depth = 0;
+        return -1;
+    }
+    iter->remaining[iter->depth - 1]--;
+    if (element->type == PICOREDIS_REPLY_MULTI_BULK && element->num > 0) {
+        if (iter->depth == PICOREDIS_READER_MAX_DEPTH) {
+            picoredis_disconnect(ctx, "protocol error");
+            iter->depth = 0;
+            return -1;
+        }
+        iter->remaining[iter->depth++] = element->num;
+    }
+    while (iter->depth > 0 && iter->remaining[iter->depth - 1] == 0) {
+        iter->depth--;
+    }
+    if (iter->depth == 0) {
+        picoredis_iterator_finish(iter);
+    }
+    return 1;
 }
 
-static int picoredis_exec_smove(picoredis_t *ctx, const char *srckey, const char *dstkey, const char *member)
+// skips the elements that were not read so that the connection can be used again
+static void picoredis_iterator_close(picoredis_iterator_t *iter)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_SMOVE, srckey, dstkey, member);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reply_view_t element;
+    while (picoredis_iterator_next(iter, &element) > 0) {}
 }
 
-static int picoredis_exec_scard(picoredis_t *ctx, const char *key)
+static size_t picoredis_pending_replies(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SCARD, key);
-    return reply ? reply->v.ivalue : 0;
+    return ctx->pending_replies;
 }
 
-static int picoredis_exec_sismember(picoredis_t *ctx, const char *key, const char *member)
+// the socket is non-blocking and the connection completes in the background.
+// commands may be queued right away, they are written once it is established.
+static picoredis_t *picoredis_async_connect(const char *host, int port)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_SISMEMBER, key, member);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_t *ctx = picoredis_alloc();
+    ctx->async = 1;
+    ctx->sock  = picoredis_connect_with_ctx(ctx, host, port);
+    if (ctx->sock < 0) {
+        ctx->error = strerror(errno);
+    }
+    return ctx;
 }
 
-static picoredis_array_t *picoredis_exec_sinter(picoredis_t *ctx, size_t nargs, ...)
+static int picoredis_async_push_callback(picoredis_t *ctx, picoredis_callback_t callback, void *privdata)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SINTER, nargs, list);
-    va_end(list);
-    return reply ? reply->v.avalue : NULL;
+    if (ctx->pending_replies == ctx->callback_capacity) {
+        size_t new_capacity = ctx->callback_capacity ? ctx->callback_capacity * 2 : 64;
+        picoredis_callback_entry_t *new_callbacks = (picoredis_callback_entry_t *)malloc(sizeof(picoredis_callback_entry_t) * new_capacity);
+        if (!new_callbacks) {
+            ctx->error = "cannot allocate callback queue";
+            return -1;
+        }
+        // unwrap the ring so that it starts at index 0 again
+        size_t i = 0;
+        for (; i < ctx->pending_replies; ++i) {
+            new_callbacks[i] = ctx->callbacks[(ctx->callback_head + i) % ctx->callback_capacity];
+        }
+        free(ctx->callbacks);
+        ctx->callbacks         = new_callbacks;
+        ctx->callback_capacity = new_capacity;
+        ctx->callback_head     = 0;
+    }
+    picoredis_callback_entry_t *entry = &ctx->callbacks[(ctx->callback_head + ctx->pending_replies) % ctx->callback_capacity];
+    entry->callback = callback;
+    entry->privdata = privdata;
+    return 0;
 }
 
-static int picoredis_exec_sinterstore(picoredis_t *ctx, size_t nargs, ...)
+// callback may be NULL to discard the reply
+static int picoredis_async_command_argv(picoredis_t *ctx, picoredis_callback_t callback, void *privdata, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SINTERSTORE, nargs, list);
-    va_end(list);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    if (ctx->sock < 0) {
+        ctx->error = "not connected";
+        return -1;
+    }
+    if (picoredis_async_push_callback(ctx, callback, privdata) < 0) return -1;
+    if (picoredis_append_command_argv(ctx, type, nargs, values, lengths) < 0) return -1;
+
+    picoredis_async_update_events(ctx);
+    return 0;
 }
 
-static picoredis_array_t *picoredis_exec_sunion(picoredis_t *ctx, size_t nargs, ...)
+static int picoredis_async_command(picoredis_t *ctx, picoredis_callback_t callback, void *privdata, picoredis_command_type type, size_t nargs, ...)
 {
+    const char *values[nargs + 1];
     va_list list;
     va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SUNION, nargs, list);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
     va_end(list);
-    return reply ? reply->v.avalue : NULL;
+    return picoredis_async_command_argv(ctx, callback, privdata, type, nargs, values, NULL);
 }
 
-static int picoredis_exec_sunionstore(picoredis_t *ctx, size_t nargs, ...)
+static int picoredis_async_fd(picoredis_t *ctx)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SUNIONSTORE, nargs, list);
-    va_end(list);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    return ctx->sock;
 }
 
-static picoredis_array_t *picoredis_exec_sdiff(picoredis_t *ctx, size_t nargs, ...)
+// POLLIN / POLLOUT mask the caller should wait for on picoredis_async_fd
+static int picoredis_async_events(picoredis_t *ctx)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SDIFF, nargs, list);
-    va_end(list);
-    return reply ? reply->v.avalue : NULL;
+    if (ctx->sock < 0) return 0;
+    if (ctx->connecting) return POLLOUT;
+
+    int events = POLLIN;
+    if (ctx->send_length > 0) {
+        events |= POLLOUT;
+    }
+    return events;
 }
 
-static int picoredis_exec_sdiffstore(picoredis_t *ctx, size_t nargs, ...)
+// writes as much of send_buf as the socket accepts and keeps the rest
+static int picoredis_async_write(picoredis_t *ctx)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SDIFFSTORE, nargs, list);
-    va_end(list);
-    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+    if (ctx->connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(ctx->sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+            error = errno;
+        }
+        if (error) {
+            ctx->error = strerror(error);
+            return -1;
+        }
+        ctx->connecting = 0;
+    }
+    size_t sent = 0;
+    while (sent < ctx->send_length) {
+        ssize_t ret = send(ctx->sock, ctx->send_buf + sent, ctx->send_length - sent, 0);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (ret <= 0) {
+            ctx->error = strerror(errno);
+            return -1;
+        }
+        sent += ret;
+    }
+    memmove(ctx->send_buf, ctx->send_buf + sent, ctx->send_length - sent);
+    ctx->send_length -= sent;
+    return 0;
 }
 
-static picoredis_array_t *picoredis_exec_smembers(picoredis_t *ctx, const char *key)
+static void picoredis_async_invoke(picoredis_t *ctx, picoredis_callback_entry_t entry, picoredis_reply_view_t *reply)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SMEMBERS, key);
-    return reply ? reply->v.avalue : NULL;
+    ctx->in_callback++;
+    entry.callback(ctx, reply, entry.privdata);
+    ctx->in_callback--;
 }
 
-static char *picoredis_exec_srandmember(picoredis_t *ctx, const char *key)
+// reads what is available and runs the callback of every completed reply
+static int picoredis_async_read(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SRANDMEMBER, key);
-    return reply ? reply->v.svalue : NULL;
+    if (picoredis_receive_more(ctx) < 0) return -1;
+
+    for (;;) {
+        int parse_result = picoredis_reader_parse(ctx);
+        if (parse_result == 0) break;
+        if (parse_result < 0 || ctx->pending_replies == 0) {
+            ctx->error = "protocol error";
+            return -1;
+        }
+        picoredis_callback_entry_t entry = ctx->callbacks[ctx->callback_head];
+        ctx->callback_head = (ctx->callback_head + 1) % ctx->callback_capacity;
+        ctx->pending_replies--;
+        if (entry.callback) {
+            if (picoredis_reply_view_create(ctx, &ctx->reply_view) < 0) return -1;
+            picoredis_async_invoke(ctx, entry, &ctx->reply_view);
+            if (ctx->free_deferred) {
+                ctx->error = "connection freed";
+                return -1;
+            }
+        }
+        picoredis_reader_consume(ctx);
+    }
+    return 0;
 }
 
-static int picoredis_exec_zadd(picoredis_t *ctx, const char *key, double score, const char *member)
+// closes the connection and completes every pending callback with a NULL reply
+static void picoredis_async_fail(picoredis_t *ctx, const char *error)
+{
+    if (ctx->sock >= 0) {
+#ifdef __linux__
+        if (ctx->event_loop) {
+            picoredis_event_loop_remove(ctx->event_loop, ctx);
+        }
+#endif
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+    ctx->error         = error;
+    ctx->connecting    = 0;
+    ctx->send_length   = 0;
+    ctx->receive_begin = ctx->receive_end = 0;
+    ctx->reader.pos    = 0;
+    picoredis_reader_consume(ctx);
+    while (ctx->pending_replies > 0) {
+        picoredis_callback_entry_t entry = ctx->callbacks[ctx->callback_head];
+        ctx->callback_head = (ctx->callback_head + 1) % ctx->callback_capacity;
+        ctx->pending_replies--;
+        if (entry.callback) {
+            picoredis_async_invoke(ctx, entry, NULL);
+        }
+    }
+}
+
+// revents is the POLLIN / POLLOUT / POLLERR / POLLHUP mask reported for picoredis_async_fd.
+// returns -1 when the connection failed, ctx->error tells why. when a callback
+// freed ctx the remaining callbacks get a NULL reply and ctx is gone on return.
+static int picoredis_async_handle_events(picoredis_t *ctx, int revents)
 {
-    char double_value[64] = {0};
-    snprintf(double_value, sizeof(double_value), "%f", score);
+    if (ctx->sock < 0) return -1;
+
+    int result = 0;
+    if ((revents & POLLOUT) || (ctx->connecting && (revents & (POLLERR | POLLHUP)))) {
+        result = picoredis_async_write(ctx);
+    }
+    if (result == 0 && (revents & (POLLIN | POLLERR | POLLHUP))) {
+        result = picoredis_async_read(ctx);
+    }
+    if (result < 0) {
+        picoredis_async_fail(ctx, ctx->error);
+        if (ctx->free_deferred && !ctx->in_callback) {
+            ctx->free_deferred = 0;
+            picoredis_free(ctx);
+        }
+        return -1;
+    }
+    picoredis_async_update_events(ctx);
+    return 0;
+}
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZADD, key, double_value, member);
-    return reply ? reply->v.ivalue : 0;
+static void picoredis_async_update_events(picoredis_t *ctx)
+{
+#ifdef __linux__
+    if (!ctx->event_loop) return;
+
+    int events = picoredis_async_events(ctx);
+    if (events == ctx->watched_events) return;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+    event.data.ptr = ctx;
+    if (epoll_ctl(ctx->event_loop->epfd, EPOLL_CTL_MOD, ctx->sock, &event) == 0) {
+        ctx->watched_events = events;
+    }
+#else
+    (void)ctx;
+#endif
 }
 
-static int picoredis_exec_zrem(picoredis_t *ctx, const char *key, const char *member)
+#ifdef __linux__
+static picoredis_event_loop_t *picoredis_event_loop_create(void)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZREM, key, member);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_event_loop_t *loop = (picoredis_event_loop_t *)malloc(sizeof(picoredis_event_loop_t));
+    memset(loop, 0, sizeof(picoredis_event_loop_t));
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
 }
 
-static char *picoredis_exec_zincrby(picoredis_t *ctx, const char *key, double incr, const char *member)
+static void picoredis_event_loop_free(picoredis_event_loop_t *loop)
 {
-    char double_value[64] = {0};
-    snprintf(double_value, sizeof(double_value), "%f", incr);
+    if (!loop) return;
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZINCRBY, key, double_value, member);
-    return reply ? reply->v.svalue : NULL;
+    close(loop->epfd);
+    free(loop);
 }
 
-static int picoredis_exec_zrank(picoredis_t *ctx, const char *key, const char *member)
+static int picoredis_event_loop_add(picoredis_event_loop_t *loop, picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZRANK, key, member);
-    if (!reply) return -1;
-    return reply->type == PICOREDIS_REPLY_BULK ? -1 : reply->v.ivalue;
+    if (ctx->sock < 0) {
+        ctx->error = "not connected";
+        return -1;
+    }
+    int events = picoredis_async_events(ctx);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+    event.data.ptr = ctx;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, ctx->sock, &event) < 0) {
+        ctx->error = strerror(errno);
+        return -1;
+    }
+    ctx->event_loop     = loop;
+    ctx->watched_events = events;
+    loop->num++;
+    return 0;
 }
 
-static int picoredis_exec_zrevrank(picoredis_t *ctx, const char *key, const char *member)
+static int picoredis_event_loop_remove(picoredis_event_loop_t *loop, picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZREVRANK, key, member);
-    if (!reply) return -1;
-    return reply->type == PICOREDIS_REPLY_BULK ? -1 : reply->v.ivalue;
+    if (ctx->event_loop != loop) return -1;
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, ctx->sock, NULL);
+    // a callback may remove a connection whose events are still to be dispatched
+    int i = 0;
+    for (; i < loop->ready_num; ++i) {
+        if (loop->events[i].data.ptr == ctx) {
+            loop->events[i].data.ptr = NULL;
+        }
+    }
+    ctx->event_loop     = NULL;
+    ctx->watched_events = 0;
+    loop->num--;
+    return 0;
 }
 
-static picoredis_array_t *picoredis_exec_zrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score)
+// waits up to timeout_ms (-1 blocks) and dispatches every ready connection.
+// returns the number of connections that had events or -1 on error.
+static int picoredis_event_loop_run_once(picoredis_event_loop_t *loop, int timeout_ms)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
+    int num = epoll_wait(loop->epfd, loop->events, PICOREDIS_EVENT_LOOP_MAX_EVENTS, timeout_ms);
+    if (num < 0) return (errno == EINTR) ? 0 : -1;
+
+    loop->ready_num = num;
+    int i = 0;
+    for (; i < num; ++i) {
+        picoredis_t *ctx = (picoredis_t *)loop->events[i].data.ptr;
+        if (!ctx) continue;
+
+        uint32_t events  = loop->events[i].events;
+        int revents = ((events & EPOLLIN)  ? POLLIN  : 0) |
+                      ((events & EPOLLOUT) ? POLLOUT : 0) |
+                      ((events & EPOLLERR) ? POLLERR : 0) |
+                      ((events & EPOLLHUP) ? POLLHUP : 0);
+        picoredis_async_handle_events(ctx, revents);
+    }
+    loop->ready_num = 0;
+    return num;
+}
+#endif
 
-    char stop_value[64] = {0};
-    snprintf(stop_value, sizeof(stop_value), "%d", stop);
+// the reply is only valid until the next command on ctx
+static int picoredis_exec_argv_view(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_reply_view_t *view)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    if (picoredis_append_command_argv(ctx, type, nargs, values, lengths) < 0) return -1;
 
-    static const char *with_score = "WITHSCORES";
+    return picoredis_get_reply_view(ctx, view);
+}
 
-    picoredis_reply_t *reply = is_with_score ?
-        picoredis_send_and_reply4(ctx, PICOREDIS_ZRANGE, key, start_value, stop_value, with_score) :
-        picoredis_send_and_reply3(ctx, PICOREDIS_ZRANGE, key, start_value, stop_value);
-    return reply ? reply->v.avalue : NULL;
+static picoredis_reply_view_t *picoredis_send_and_reply_argv(picoredis_t *ctx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
+{
+    if (picoredis_exec_argv_view(ctx, type, nargs, values, lengths, &ctx->reply_view) < 0) return NULL;
+    return &ctx->reply_view;
 }
 
-static picoredis_array_t *picoredis_exec_zrevrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score)
+// sends key followed by the fields, or by field / value pairs when values is given
+static picoredis_reply_view_t *picoredis_send_and_reply_fields(picoredis_t *ctx, picoredis_command_type type, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
+    size_t nargs = 1 + field_num * (values ? 2 : 1);
+    const char **args = (const char **)malloc((sizeof(const char *) + sizeof(size_t)) * nargs);
+    if (!args) {
+        ctx->error = "cannot allocate command";
+        return NULL;
+    }
+    size_t *lengths = (size_t *)(args + nargs);
+    args[0]    = key;
+    lengths[0] = strlen(key);
+    size_t n = 1;
+    size_t i = 0;
+    for (; i < field_num; ++i) {
+        args[n]      = fields[i].ptr;
+        lengths[n++] = fields[i].length;
+        if (values) {
+            args[n]      = values[i].ptr;
+            lengths[n++] = values[i].length;
+        }
+    }
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_argv(ctx, type, nargs, args, lengths);
+    free(args);
+    return reply;
+}
 
-    char stop_value[64] = {0};
-    snprintf(stop_value, sizeof(stop_value), "%d", stop);
+static picoredis_reply_view_t *picoredis_send_and_reply_binary1(picoredis_t *ctx, picoredis_command_type type, const void *arg, size_t length)
+{
+    const char *values[] = { (const char *)arg };
+    size_t lengths[]     = { length };
+    return picoredis_send_and_reply_argv(ctx, type, 1, values, lengths);
+}
 
-    static const char *with_score = "WITHSCORES";
+static picoredis_reply_view_t *picoredis_send_and_reply_binary2(picoredis_t *ctx, picoredis_command_type type, const void *arg1, size_t length1, const void *arg2, size_t length2)
+{
+    const char *values[] = { (const char *)arg1, (const char *)arg2 };
+    size_t lengths[]     = { length1, length2 };
+    return picoredis_send_and_reply_argv(ctx, type, 2, values, lengths);
+}
 
-    picoredis_reply_t *reply = is_with_score ?
-        picoredis_send_and_reply4(ctx, PICOREDIS_ZREVRANGE, key, start_value, stop_value, with_score) :
-        picoredis_send_and_reply3(ctx, PICOREDIS_ZREVRANGE, key, start_value, stop_value);
-    return reply ? reply->v.avalue : NULL;
+static picoredis_reply_view_t *picoredis_send_and_reply_binary3(picoredis_t *ctx, picoredis_command_type type, const void *arg1, size_t length1, const void *arg2, size_t length2, const void *arg3, size_t length3)
+{
+    const char *values[] = { (const char *)arg1, (const char *)arg2, (const char *)arg3 };
+    size_t lengths[]     = { length1, length2, length3 };
+    return picoredis_send_and_reply_argv(ctx, type, 3, values, lengths);
 }
 
-static picoredis_array_t *picoredis_exec_zrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max, int is_with_score)
+static picoredis_reply_view_t *picoredis_send_and_reply0(picoredis_t *ctx, picoredis_command_type type)
 {
-    static const char *with_score = "WITHSCORES";
+    return picoredis_send_and_reply_argv(ctx, type, 0, NULL, NULL);
+}
 
-    picoredis_reply_t *reply = is_with_score ?
-        picoredis_send_and_reply4(ctx, PICOREDIS_ZRANGEBYSCORE, key, min, max, with_score) :
-        picoredis_send_and_reply3(ctx, PICOREDIS_ZRANGEBYSCORE, key, min, max);
-    return reply ? reply->v.avalue : NULL;
+static picoredis_reply_view_t *picoredis_send_and_reply1(picoredis_t *ctx, picoredis_command_type type, const char *arg)
+{
+    const char *values[] = { arg };
+    return picoredis_send_and_reply_argv(ctx, type, 1, values, NULL);
 }
 
-static int picoredis_exec_zcount(picoredis_t *ctx, const char *key, const char *min, const char *max)
+static picoredis_reply_view_t *picoredis_send_and_reply2(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZCOUNT, key, min, max);
-    return reply ? reply->v.ivalue : 0;
+    const char *values[] = { arg1, arg2 };
+    return picoredis_send_and_reply_argv(ctx, type, 2, values, NULL);
 }
 
-static int picoredis_exec_zremrangebyrank(picoredis_t *ctx, const char *key, int start, int stop)
+static picoredis_reply_view_t *picoredis_send_and_reply3(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3)
 {
-    char start_value[64] = {0};
-    snprintf(start_value, sizeof(start_value), "%d", start);
+    const char *values[] = { arg1, arg2, arg3 };
+    return picoredis_send_and_reply_argv(ctx, type, 3, values, NULL);
+}
 
-    char stop_value[64] = {0};
-    snprintf(stop_value, sizeof(stop_value), "%d", stop);
+static picoredis_reply_view_t *picoredis_send_and_reply4(picoredis_t *ctx, picoredis_command_type type, const char *arg1, const char *arg2, const char *arg3, const char *arg4)
+{
+    const char *values[] = { arg1, arg2, arg3, arg4 };
+    return picoredis_send_and_reply_argv(ctx, type, 4, values, NULL);
+}
 
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZREMRANGEBYRANK, key, start_value, stop_value);
-    return reply ? reply->v.ivalue : 0;
+static picoredis_reply_view_t *picoredis_send_and_replyn(picoredis_t *ctx, picoredis_command_type type, size_t nargs, va_list list)
+{
+    const char *values[nargs + 1];
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    return picoredis_send_and_reply_argv(ctx, type, nargs, values, NULL);
 }
 
-static int picoredis_exec_zremrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max)
+
+static void picoredis_exec_quit(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZREMRANGEBYSCORE, key, min, max);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_send_and_reply0(ctx, PICOREDIS_QUIT);
 }
 
-static int picoredis_exec_zcard(picoredis_t *ctx, const char *key)
+static int picoredis_exec_auth(picoredis_t *ctx, const char *password)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_ZCARD, key);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_AUTH, password);
+    if (!reply) {
+        ctx->error = "cannot receive reply";
+        return 0;
+    }
+
+    if (reply->type == PICOREDIS_REPLY_ERROR) {
+        ctx->error = "cannot set";
+        return 0;
+    }
+    ctx->authenticated = 1;
+    return 1;
 }
 
-static char *picoredis_exec_zscore(picoredis_t *ctx, const char *key, const char *member)
+static int picoredis_exec_exists(picoredis_t *ctx, const char *key)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZSCORE, key, member);
-    return reply ? reply->v.svalue : NULL;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_EXISTS, key);
+    return reply ? reply->integer : 0;
 }
 
-static int picoredis_exec_zunionstore(picoredis_t *ctx, size_t nargs, ...)
+static int picoredis_exec_del(picoredis_t *ctx, size_t nargs, ...)
 {
     va_list list;
     va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_ZUNIONSTORE, nargs, list);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_DEL, nargs, list);
     va_end(list);
-    return reply ? reply->v.ivalue : 0;
+    return reply ? reply->integer : 0;
 }
 
-static int picoredis_exec_zinterstore(picoredis_t *ctx, size_t nargs, ...)
+static char *picoredis_exec_type(picoredis_t *ctx, const char *key)
 {
-    va_list list;
-    va_start(list, nargs);
-    picoredis_reply_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_ZINTERSTORE, nargs, list);
-    va_end(list);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_TYPE, key);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
 }
 
-static int picoredis_exec_save(picoredis_t *ctx)
+static picoredis_array_t *picoredis_exec_keys(picoredis_t *ctx, const char *key)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_SAVE);
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_KEYS, key);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
 }
 
-static int picoredis_exec_bgsave(picoredis_t *ctx)
+static int picoredis_exec_keys_iter(picoredis_t *ctx, const char *key, picoredis_iterator_t *iter)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_BGSAVE);
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    const char *values[] = { key };
+    return picoredis_exec_argv_iter(ctx, PICOREDIS_KEYS, 1, values, NULL, iter);
 }
 
-static int picoredis_exec_bgrewriteaof(picoredis_t *ctx)
+static char *picoredis_exec_randomkey(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_BGREWRITEAOF);
-    return reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_RANDOMKEY);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
 }
 
-static int picoredis_exec_lastsave(picoredis_t *ctx)
+static int picoredis_exec_rename(picoredis_t *ctx, const char *oldkey, const char *newkey)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_LASTSAVE);
-    return reply ? reply->v.ivalue : 0;
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RENAME, oldkey, newkey);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
 }
 
-static void picoredis_exec_shutdown(picoredis_t *ctx)
+static int picoredis_exec_renamenx(picoredis_t *ctx, const char *oldkey, const char *newkey)
 {
-    picoredis_send_and_reply0(ctx, PICOREDIS_SHUTDOWN);
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RENAMENX, oldkey, newkey);
+    return reply ? reply->integer : 0;
 }
 
-static char *picoredis_exec_info(picoredis_t *ctx)
+static int picoredis_exec_dbsize(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_DBSIZE);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_expire(picoredis_t *ctx, const char *key, size_t seconds)
+{
+    char int_value[64] = {0};
+    picoredis_format_uint(int_value, seconds);
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_EXPIRE, key, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_expireat(picoredis_t *ctx, const char *key, time_t unixtime)
+{
+    char time_value[64] = {0};
+    picoredis_format_int(time_value, unixtime);
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_EXPIREAT, key, time_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_persist(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_PERSIST, key);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_ttl(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_TTL, key);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_select(picoredis_t *ctx, size_t index)
+{
+    char index_value[64] = {0};
+    picoredis_format_uint(index_value, index);
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SELECT, index_value);
+    if (!reply || reply->type == PICOREDIS_REPLY_ERROR) return 0;
+
+    ctx->db = index;
+    return 1;
+}
+
+static int picoredis_exec_move(picoredis_t *ctx, const char *key, size_t dbindex)
+{
+    char index_value[64] = {0};
+    picoredis_format_uint(index_value, dbindex);
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_MOVE, key, index_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_flushdb(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_FLUSHDB);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_flushall(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_FLUSHALL);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_watch(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_WATCH, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_unwatch(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_UNWATCH);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_multi(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_MULTI);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_exec(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_EXEC);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_discard(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_DISCARD);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+// nothing is sent before picoredis_transaction_exec. commands that read
+// (e.g. the values of watched keys) must be executed before the first append.
+static void picoredis_transaction_begin(picoredis_transaction_t *tx, picoredis_t *ctx)
+{
+    tx->ctx           = ctx;
+    tx->command_num   = 0;
+    tx->send_start    = ctx->send_length;
+    tx->pending_start = ctx->pending_replies;
+    tx->failed        = 0;
+    ctx->error        = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        tx->failed = 1;
+    }
+}
+
+static int picoredis_transaction_append_argv(picoredis_transaction_t *tx, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
+{
+    picoredis_t *ctx = tx->ctx;
+    if (tx->failed) return -1;
+    if (tx->command_num == 0 && picoredis_append_command_argv(ctx, PICOREDIS_MULTI, 0, NULL, NULL) < 0) {
+        tx->failed = 1;
+        return -1;
+    }
+    if (picoredis_append_command_argv(ctx, type, nargs, values, lengths) < 0) {
+        tx->failed = 1;
+        return -1;
+    }
+    tx->command_num++;
+    return 0;
+}
+
+static int picoredis_transaction_append(picoredis_transaction_t *tx, picoredis_command_type type, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+    return picoredis_transaction_append_argv(tx, type, nargs, values, NULL);
+}
+
+// drops the queued commands. they were never sent, so this costs no round trip.
+// a failed append may have left part of the transaction buffered, it goes as well.
+static void picoredis_transaction_discard(picoredis_transaction_t *tx)
+{
+    picoredis_t *ctx = tx->ctx;
+    if (ctx->send_length >= tx->send_start) {
+        ctx->send_length     = tx->send_start;
+        ctx->pending_replies = tx->pending_start;
+    }
+    tx->command_num = 0;
+    tx->failed      = 1;
+}
+
+// writes MULTI, the queued commands and EXEC at once. *replies receives the
+// reply of every command (free it with picoredis_reply_tree_free).
+// returns 1 when committed, 0 when a watched key was modified and -1 on error.
+static int picoredis_transaction_exec(picoredis_transaction_t *tx, picoredis_reply_tree_t **replies)
+{
+    picoredis_t *ctx = tx->ctx;
+    *replies = NULL;
+    if (tx->failed) {
+        picoredis_transaction_discard(tx);
+        if (!ctx->error) {
+            ctx->error = "transaction failed";
+        }
+        return -1;
+    }
+    if (tx->command_num == 0) {
+        // an empty transaction still ends a WATCH like EXEC would
+        return picoredis_exec_unwatch(ctx) ? 1 : -1;
+    }
+    tx->failed = 1;
+    if (picoredis_append_command_argv(ctx, PICOREDIS_EXEC, 0, NULL, NULL) < 0) {
+        picoredis_transaction_discard(tx);
+        return -1;
+    }
+    // MULTI and the QUEUED replies carry nothing, only errors are kept
+    const char *error = NULL;
+    size_t i = 0;
+    for (; i <= tx->command_num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_ERROR && !error) {
+            error = (i == 0) ? "cannot start transaction" : "command rejected in transaction";
+        }
+    }
+    picoredis_reply_tree_t *tree = picoredis_get_reply_tree(ctx);
+    if (!tree) return -1;
+    if (tree->type == PICOREDIS_REPLY_ERROR || error) {
+        picoredis_reply_tree_free(tree);
+        ctx->error = error ? error : "transaction aborted";
+        return -1;
+    }
+    if (tree->is_nil) {
+        picoredis_reply_tree_free(tree);
+        return 0;
+    }
+    *replies = tree;
+    return 1;
+}
+
+static void picoredis_backoff(size_t attempt)
+{
+    unsigned long usec = PICOREDIS_WATCH_BACKOFF_USEC;
+    for (; attempt > 0 && usec < PICOREDIS_WATCH_BACKOFF_MAX_USEC; --attempt) {
+        usec *= 2;
+    }
+    if (usec > PICOREDIS_WATCH_BACKOFF_MAX_USEC) {
+        usec = PICOREDIS_WATCH_BACKOFF_MAX_USEC;
+    }
+    // jitter keeps competing clients from retrying in lockstep
+    usec = usec / 2 + (unsigned long)rand() % (usec / 2 + 1);
+    struct timespec ts = { (time_t)(usec / 1000000), (long)(usec % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+}
+
+// optimistic transaction: WATCH keys, let fn read them and queue its commands,
+// then EXEC. when a watched key changed in between, it is retried after a
+// growing delay. returns 1 when committed, 0 when max_attempts were used up,
+// and -1 on error or when fn gave up.
+static int picoredis_transaction_watch(picoredis_t *ctx, size_t key_num, const char **keys, size_t max_attempts, picoredis_transaction_fn_t fn, void *privdata, picoredis_reply_tree_t **replies)
+{
+    *replies = NULL;
+    size_t attempt = 0;
+    for (; attempt < max_attempts; ++attempt) {
+        if (attempt > 0) {
+            picoredis_backoff(attempt - 1);
+        }
+        picoredis_reply_view_t view;
+        if (picoredis_exec_argv_view(ctx, PICOREDIS_WATCH, key_num, keys, NULL, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            ctx->error = "cannot watch";
+            return -1;
+        }
+        picoredis_transaction_t tx;
+        picoredis_transaction_begin(&tx, ctx);
+        if (fn(ctx, &tx, privdata) != 0) {
+            picoredis_transaction_discard(&tx);
+            picoredis_exec_unwatch(ctx);
+            if (!ctx->error) {
+                ctx->error = "transaction given up";
+            }
+            return -1;
+        }
+        int ret = picoredis_transaction_exec(&tx, replies);
+        if (ret != 0) return ret;
+    }
+    return 0;
+}
+
+static picoredis_array_t *picoredis_exec_sort(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SORT, nargs, list);
+    va_end(list);
+    if (!reply) return NULL;
+    if (reply->type == PICOREDIS_REPLY_ERROR) return NULL;
+    return picoredis_reply_view_array(reply);
+}
+
+static int picoredis_exec_sort_iter(picoredis_t *ctx, picoredis_iterator_t *iter, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+    return picoredis_exec_argv_iter(ctx, PICOREDIS_SORT, nargs, values, NULL, iter);
+}
+
+static void picoredis_exec_set(picoredis_t *ctx, const char *key, const char *value)
+{
+    picoredis_exec_set_binary(ctx, key, strlen(key), value, strlen(value));
+}
+
+static void picoredis_exec_set_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    if (value_length >= PICOREDIS_ZERO_COPY_THRESHOLD && ctx->pending_replies == 0) {
+        struct iovec iov = { (void *)value, value_length };
+        picoredis_exec_set_iov(ctx, key, key_length, &iov, 1);
+        return;
+    }
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_SET, key, key_length, value, value_length);
+    if (!reply) {
+        ctx->error = "cannot receive reply";
+        return;
+    }
+
+    if (reply->type == PICOREDIS_REPLY_ERROR) {
+        ctx->error = "cannot set";
+        return;
+    }
+}
+
+static int picoredis_exec_set_finish(picoredis_t *ctx)
+{
+    ctx->pending_replies++;
+    picoredis_reply_view_t view;
+    if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+    if (view.type == PICOREDIS_REPLY_ERROR) {
+        ctx->error = "cannot set";
+        return -1;
+    }
+    return 1;
+}
+
+// SET whose value is the concatenation of the buffers in value. the buffers
+// are written with writev() as they are, only the RESP framing is formatted.
+// returns 1 when the value was stored and -1 on error.
+static int picoredis_exec_set_iov(picoredis_t *ctx, const void *key, size_t key_length, const struct iovec *value, size_t value_iovcnt)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    size_t value_length = 0;
+    size_t i = 0;
+    for (; i < value_iovcnt; ++i) {
+        value_length += value[i].iov_len;
+    }
+    const char *values[] = { (const char *)key };
+    size_t lengths[]     = { key_length };
+    if (picoredis_command_encode_head(ctx, PICOREDIS_SET, 1, values, lengths, value_length) < 0) return -1;
+
+    struct iovec *iov = (struct iovec *)malloc(sizeof(struct iovec) * (value_iovcnt + 2));
+    if (!iov) {
+        ctx->send_length = 0;
+        ctx->error       = "cannot allocate iovec";
+        return -1;
+    }
+    iov[0].iov_base = ctx->send_buf;
+    iov[0].iov_len  = ctx->send_length;
+    memcpy(iov + 1, value, sizeof(struct iovec) * value_iovcnt);
+    iov[value_iovcnt + 1].iov_base = (void *)"\r\n";
+    iov[value_iovcnt + 1].iov_len  = 2;
+    int ret = picoredis_send_iov(ctx, iov, value_iovcnt + 2);
+    free(iov);
+    ctx->send_length = 0;
+    if (ret < 0) {
+        // part of the command may be on the wire already
+        picoredis_disconnect(ctx, ctx->error);
+        return -1;
+    }
+
+    return picoredis_exec_set_finish(ctx);
+}
+
+// SET whose value is length bytes of fd starting at offset, sent with sendfile() on Linux.
+// returns 1 when the value was stored and -1 on error.
+static int picoredis_exec_set_file(picoredis_t *ctx, const void *key, size_t key_length, int fd, off_t offset, size_t length)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ctx->error = strerror(errno);
+        return -1;
+    }
+    if (S_ISREG(st.st_mode) && (offset > st.st_size || length > (size_t)(st.st_size - offset))) {
+        ctx->error = "file is shorter than length";
+        return -1;
+    }
+    const char *values[] = { (const char *)key };
+    size_t lengths[]     = { key_length };
+    if (picoredis_command_encode_head(ctx, PICOREDIS_SET, 1, values, lengths, length) < 0) return -1;
+    if (picoredis_flush(ctx) < 0) return -1;
+    if (picoredis_send_file(ctx, fd, offset, length) < 0) {
+        // the server still waits for the rest of the value
+        picoredis_disconnect(ctx, ctx->error);
+        return -1;
+    }
+    memcpy(ctx->send_buf, "\r\n", 2);
+    ctx->send_length = 2;
+    if (picoredis_flush(ctx) < 0) return -1;
+
+    return picoredis_exec_set_finish(ctx);
+}
+
+static char *picoredis_exec_get(picoredis_t *ctx, const char *key)
+{
+    return picoredis_exec_get_binary(ctx, key, strlen(key), NULL);
+}
+
+static char *picoredis_exec_get_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary1(ctx, PICOREDIS_GET, key, key_length);
+    return reply ? picoredis_reply_view_string(reply, value_length) : NULL;
+}
+
+static int picoredis_exec_get_view(picoredis_t *ctx, const void *key, size_t key_length, picoredis_view_t *value)
+{
+    const char *values[] = { (const char *)key };
+    size_t lengths[]     = { key_length };
+    picoredis_reply_view_t view;
+    if (picoredis_exec_argv_view(ctx, PICOREDIS_GET, 1, values, lengths, &view) < 0) return -1;
+    if (view.type != PICOREDIS_REPLY_BULK) {
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
+    if (view.is_nil) return 0;
+
+    *value = view.value;
+    return 1;
+}
+
+// copies the value into buf and returns its whole length, which is larger
+// than bufsize when the value was truncated. returns -1 if the key does not exist.
+static ssize_t picoredis_exec_get_into(picoredis_t *ctx, const void *key, size_t key_length, void *buf, size_t bufsize)
+{
+    picoredis_view_t value;
+    if (picoredis_exec_get_view(ctx, key, key_length, &value) <= 0) return -1;
+
+    memcpy(buf, value.ptr, value.length < bufsize ? value.length : bufsize);
+    return value.length;
+}
+
+// reads the "$<length>\r\n" header of a GET reply and leaves the payload unread.
+// returns 1 when a value follows, 0 if the key does not exist and -1 on error.
+static int picoredis_stream_begin(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    const char *values[] = { (const char *)key };
+    size_t lengths[]     = { key_length };
+    if (picoredis_append_command_argv(ctx, PICOREDIS_GET, 1, values, lengths) < 0) return -1;
+    if (picoredis_prepare_reply(ctx) < 0) return -1;
+
+    const char *lf;
+    while (!(lf = (const char *)memchr(ctx->receive_buf + ctx->receive_begin, '\n', ctx->receive_end - ctx->receive_begin))) {
+        if (picoredis_receive_more(ctx) < 0) {
+            picoredis_disconnect(ctx, ctx->error);
+            return -1;
+        }
+    }
+    const char *header = ctx->receive_buf + ctx->receive_begin;
+    if (header[0] != '$') {
+        // error replies are small, let the reader consume them
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) == 0) {
+            ctx->error = "unexpected reply type";
+        }
+        return -1;
+    }
+    size_t header_length = lf + 1 - header;
+    long long length;
+    if (header_length < 3 || lf[-1] != '\r' || picoredis_parse_header_number('$', header + 1, header_length - 3, &length) < 0) {
+        picoredis_disconnect(ctx, "protocol error");
+        return -1;
+    }
+    ctx->receive_begin = lf + 1 - ctx->receive_buf;
+    if (length < 0) {
+        ctx->pending_replies--;
+        ctx->reader.pos = ctx->receive_begin;
+        picoredis_reader_consume(ctx);
+        return 0;
+    }
+    *value_length = length;
+    return 1;
+}
+
+// makes sure that the next bytes of the payload are in the receive buffer.
+// the buffer is reused from its start, so the payload never piles up in memory.
+// the connection is dropped on failure since the payload is left half read.
+static int picoredis_stream_fill(picoredis_t *ctx)
+{
+    if (ctx->receive_begin < ctx->receive_end) return 0;
+
+    ctx->receive_begin = ctx->receive_end = 0;
+    ctx->reader.pos    = 0;
+    if (picoredis_reserve_receive_buf(ctx, PICOREDIS_STREAM_CHUNK_SIZE) < 0) {
+        picoredis_disconnect(ctx, ctx->error);
+        return -1;
+    }
+    while (ctx->receive_end == 0) {
+        if (picoredis_receive_more(ctx) < 0) {
+            picoredis_disconnect(ctx, ctx->error);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// consumes the "\r\n" after the payload
+static int picoredis_stream_finish(picoredis_t *ctx)
+{
+    size_t i = 0;
+    for (; i < 2; ++i) {
+        if (picoredis_stream_fill(ctx) < 0) return -1;
+        if (ctx->receive_buf[ctx->receive_begin++] != "\r\n"[i]) {
+            picoredis_disconnect(ctx, "protocol error");
+            return -1;
+        }
+    }
+    ctx->pending_replies--;
+    ctx->reader.pos = ctx->receive_begin;
+    picoredis_reader_consume(ctx);
+    return 0;
+}
+
+// passes the value to callback as it arrives, in pieces of at most PICOREDIS_STREAM_CHUNK_SIZE bytes.
+// returns 1 when the value was delivered, 0 if the key does not exist and -1 on error.
+static int picoredis_exec_get_stream(picoredis_t *ctx, const void *key, size_t key_length, picoredis_stream_callback_t callback, void *privdata)
+{
+    size_t value_length;
+    int ret = picoredis_stream_begin(ctx, key, key_length, &value_length);
+    if (ret <= 0) return ret;
+
+    size_t remaining = value_length;
+    int stopped      = 0;
+    while (remaining > 0) {
+        if (picoredis_stream_fill(ctx) < 0) return -1;
+        size_t length = ctx->receive_end - ctx->receive_begin;
+        if (length > remaining) {
+            length = remaining;
+        }
+        if (!stopped && callback(ctx->receive_buf + ctx->receive_begin, length, value_length, privdata) != 0) {
+            stopped = 1;
+        }
+        ctx->receive_begin += length;
+        remaining          -= length;
+    }
+    if (picoredis_stream_finish(ctx) < 0) return -1;
+    if (stopped) {
+        ctx->error = "stream stopped by callback";
+        return -1;
+    }
+    return 1;
+}
+
+static int picoredis_write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t ret = write(fd, data, length);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret < 0) return -1;
+        data   += ret;
+        length -= ret;
+    }
+    return 0;
+}
+
+#ifdef PICOREDIS_HAS_SPLICE
+#define PICOREDIS_SPLICE_F_MOVE 1
+#define PICOREDIS_SPLICE_F_MORE 4
+
+// splice() is called through syscall() so that _GNU_SOURCE is not required
+static ssize_t picoredis_splice(int fd_in, int fd_out, size_t length)
+{
+    return syscall(SYS_splice, fd_in, NULL, fd_out, NULL, length, PICOREDIS_SPLICE_F_MOVE | PICOREDIS_SPLICE_F_MORE);
+}
+
+// moves the payload from the socket to fd inside the kernel. a fd that is not a
+// pipe is fed through an intermediate pipe. stops early when splice() is not
+// supported and leaves the rest of the payload to the caller.
+static int picoredis_stream_splice(picoredis_t *ctx, int fd, size_t *remaining, const char **write_error)
+{
+    struct stat st;
+    int pipe_fds[2] = { -1, -1 };
+    int direct      = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    if (!direct && pipe(pipe_fds) < 0) return 0;
+
+    int ret = 0;
+    while (*remaining > 0 && !*write_error) {
+        ssize_t moved = picoredis_splice(ctx->sock, direct ? fd : pipe_fds[1], *remaining);
+        if (moved < 0 && errno == EINTR) continue;
+        if (moved < 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (moved == 0) {
+            ctx->error = "connection closed by server";
+            ret = -1;
+            break;
+        }
+        if (moved < 0) {
+            *write_error = strerror(errno);
+            break;
+        }
+        *remaining -= moved;
+        while (!direct && moved > 0) {
+            ssize_t written = picoredis_splice(pipe_fds[0], fd, moved);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0 && errno == EINVAL) {
+                // fd can not be spliced to (O_APPEND files for example), copy it out
+                written = read(pipe_fds[0], ctx->receive_buf, (size_t)moved < ctx->receive_buf_size ? (size_t)moved : ctx->receive_buf_size);
+                if (written > 0 && picoredis_write_all(fd, ctx->receive_buf, written) < 0) {
+                    written = -1;
+                }
+            }
+            if (written <= 0) {
+                *write_error = (written < 0) ? strerror(errno) : "cannot write to file descriptor";
+                break;
+            }
+            moved -= written;
+        }
+    }
+    if (!direct) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+    return ret;
+}
+#endif
+
+// writes the value to fd. on Linux the payload goes from the socket to fd with
+// splice() without being copied to user space. returns 1 when the value was
+// written, 0 if the key does not exist and -1 on error.
+static int picoredis_exec_get_to_fd(picoredis_t *ctx, const void *key, size_t key_length, int fd, size_t *value_length)
+{
+    size_t length;
+    int ret = picoredis_stream_begin(ctx, key, key_length, &length);
+    if (ret <= 0) return ret;
+    if (value_length) *value_length = length;
+
+    // even after a write error the payload is read to keep the connection usable
+    const char *write_error = NULL;
+    size_t remaining        = length;
+    size_t buffered         = ctx->receive_end - ctx->receive_begin;
+    if (buffered > remaining) {
+        buffered = remaining;
+    }
+    if (picoredis_write_all(fd, ctx->receive_buf + ctx->receive_begin, buffered) < 0) {
+        write_error = strerror(errno);
+    }
+    ctx->receive_begin += buffered;
+    remaining          -= buffered;
+#ifdef PICOREDIS_HAS_SPLICE
+    // the multishot receive of io_uring owns the socket, it can not be spliced from
+    if (remaining > 0 && !write_error && !ctx->uring) {
+        if (picoredis_stream_splice(ctx, fd, &remaining, &write_error) < 0) {
+            picoredis_disconnect(ctx, ctx->error);
+            return -1;
+        }
+    }
+#endif
+    while (remaining > 0) {
+        if (picoredis_stream_fill(ctx) < 0) return -1;
+        size_t chunk = ctx->receive_end - ctx->receive_begin;
+        if (chunk > remaining) {
+            chunk = remaining;
+        }
+        if (!write_error && picoredis_write_all(fd, ctx->receive_buf + ctx->receive_begin, chunk) < 0) {
+            write_error = strerror(errno);
+        }
+        ctx->receive_begin += chunk;
+        remaining          -= chunk;
+    }
+    if (picoredis_stream_finish(ctx) < 0) return -1;
+    if (write_error) {
+        ctx->error = write_error;
+        return -1;
+    }
+    return 1;
+}
+
+static char *picoredis_exec_getset(picoredis_t *ctx, const char *key, const char *value)
+{
+    return picoredis_exec_getset_binary(ctx, key, strlen(key), value, strlen(value), NULL);
+}
+
+static char *picoredis_exec_getset_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length, size_t *old_value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_GETSET, key, key_length, value, value_length);
+    return reply ? picoredis_reply_view_string(reply, old_value_length) : NULL;
+}
+
+static int picoredis_exec_setnx(picoredis_t *ctx, const char *key, const char *value)
+{
+    return picoredis_exec_setnx_binary(ctx, key, strlen(key), value, strlen(value));
+}
+
+static int picoredis_exec_setnx_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_SETNX, key, key_length, value, value_length);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_setex(picoredis_t *ctx, const char *key, time_t time, const char *value)
+{
+    return picoredis_exec_setex_binary(ctx, key, strlen(key), time, value, strlen(value));
+}
+
+static int picoredis_exec_setex_binary(picoredis_t *ctx, const void *key, size_t key_length, time_t time, const void *value, size_t value_length)
+{
+    char time_value[64] = {0};
+    size_t time_length = picoredis_format_int(time_value, time);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary3(ctx, PICOREDIS_SETEX, key, key_length, time_value, time_length, value, value_length);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_mset(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_MSET, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_msetnx(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_MSET, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+// queues one command per PICOREDIS_BATCH_CHUNK_SIZE keys and flushes them together,
+// so a batch of any size costs a single round trip
+static int picoredis_batch_send(picoredis_t *ctx, picoredis_command_type type, size_t key_num, const picoredis_view_t *keys, const picoredis_view_t *values, size_t *chunk_num)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    size_t step = values ? 2 : 1;
+    const char **argv = (const char **)malloc(sizeof(const char *) * PICOREDIS_BATCH_CHUNK_SIZE * step);
+    size_t *lengths   = (size_t *)malloc(sizeof(size_t) * PICOREDIS_BATCH_CHUNK_SIZE * step);
+    *chunk_num = 0;
+    size_t i = 0;
+    while (i < key_num) {
+        size_t count = key_num - i < PICOREDIS_BATCH_CHUNK_SIZE ? key_num - i : PICOREDIS_BATCH_CHUNK_SIZE;
+        size_t j = 0;
+        for (; j < count; ++j) {
+            argv[j * step]    = keys[i + j].ptr;
+            lengths[j * step] = keys[i + j].length;
+            if (values) {
+                argv[j * step + 1]    = values[i + j].ptr;
+                lengths[j * step + 1] = values[i + j].length;
+            }
+        }
+        if (picoredis_append_command_argv(ctx, type, count * step, argv, lengths) < 0) break;
+        (*chunk_num)++;
+        i += count;
+    }
+    free(argv);
+    free(lengths);
+    if (i < key_num) {
+        // drop the chunks queued so far, nothing has been written yet
+        ctx->send_length     = 0;
+        ctx->pending_replies = 0;
+        *chunk_num           = 0;
+        return -1;
+    }
+    return picoredis_flush(ctx);
+}
+
+// values are NULL for keys that do not exist
+static picoredis_array_t *picoredis_exec_mget_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys)
+{
+    size_t chunk_num;
+    if (picoredis_batch_send(ctx, PICOREDIS_MGET, key_num, keys, NULL, &chunk_num) < 0) return NULL;
+
+    // chunk replies are read one at a time, so values are gathered by offset first
+    size_t *offsets   = (size_t *)malloc(sizeof(size_t) * (key_num + 1));
+    size_t *lengths   = (size_t *)malloc(sizeof(size_t) * (key_num + 1));
+    char *data        = NULL;
+    size_t data_size  = 0;
+    size_t data_capacity = 0;
+    size_t index = 0;
+    int failed   = 0;
+    size_t i = 0;
+    for (; i < chunk_num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) {
+            // nothing can be read after a failed receive
+            failed = 1;
+            break;
+        }
+        if (failed || view.type != PICOREDIS_REPLY_MULTI_BULK) {
+            failed = 1;
+            continue;
+        }
+        size_t j = 0;
+        for (; j < view.num && index < key_num; ++j, ++index) {
+            picoredis_view_t *element = &view.elements[j];
+            lengths[index] = element->length;
+            if (!element->ptr) {
+                offsets[index] = (size_t)-1;
+                continue;
+            }
+            if (data_size + element->length + 1 > data_capacity) {
+                size_t new_capacity = data_capacity ? data_capacity * 2 : 4096;
+                for (; new_capacity < data_size + element->length + 1; new_capacity *= 2) {}
+                char *new_data = (char *)realloc(data, new_capacity);
+                if (!new_data) {
+                    failed = 1;
+                    break;
+                }
+                data          = new_data;
+                data_capacity = new_capacity;
+            }
+            memcpy(data + data_size, element->ptr, element->length);
+            data[data_size + element->length] = '\0';
+            offsets[index] = data_size;
+            data_size += element->length + 1;
+        }
+    }
+    picoredis_array_t *array = NULL;
+    if (!failed && index == key_num) {
+        array = picoredis_array_create(key_num, data_size);
+    }
+    if (array) {
+        char *array_data = (char *)(array->lengths + key_num);
+        if (data_size > 0) {
+            memcpy(array_data, data, data_size);
+        }
+        for (i = 0; i < key_num; ++i) {
+            array->values[i]  = (offsets[i] == (size_t)-1) ? NULL : array_data + offsets[i];
+            array->lengths[i] = lengths[i];
+        }
+    } else if (!ctx->error) {
+        ctx->error = "unexpected reply type";
+    }
+    free(offsets);
+    free(lengths);
+    free(data);
+    return array;
+}
+
+static picoredis_array_t *picoredis_exec_mget(picoredis_t *ctx, size_t nargs, ...)
+{
+    picoredis_view_t keys[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        keys[i].ptr    = va_arg(list, const char *);
+        keys[i].length = strlen(keys[i].ptr);
+    }
+    va_end(list);
+    return picoredis_exec_mget_batch(ctx, nargs, keys);
+}
+
+// returns 1 when every chunk was stored
+static int picoredis_exec_mset_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys, const picoredis_view_t *values)
+{
+    size_t chunk_num;
+    if (picoredis_batch_send(ctx, PICOREDIS_MSET, key_num, keys, values, &chunk_num) < 0) return 0;
+
+    int ret = 1;
+    size_t i = 0;
+    for (; i < chunk_num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) return 0;
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+static long long picoredis_batch_sum(picoredis_t *ctx, picoredis_command_type type, size_t key_num, const picoredis_view_t *keys)
+{
+    size_t chunk_num;
+    if (picoredis_batch_send(ctx, type, key_num, keys, NULL, &chunk_num) < 0) return -1;
+
+    long long sum = 0;
+    int failed    = 0;
+    size_t i = 0;
+    for (; i < chunk_num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+        // the other chunks are still read so that the connection stays usable
+        if (view.type != PICOREDIS_REPLY_NUM) {
+            failed = 1;
+            continue;
+        }
+        sum += view.integer;
+    }
+    if (failed) {
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
+    return sum;
+}
+
+// returns the number of removed keys or -1 on error
+static long long picoredis_exec_del_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys)
+{
+    return picoredis_batch_sum(ctx, PICOREDIS_DEL, key_num, keys);
+}
+
+// returns the number of existing keys (a key given twice is counted twice) or -1 on error
+static long long picoredis_exec_exists_batch(picoredis_t *ctx, size_t key_num, const picoredis_view_t *keys)
+{
+    return picoredis_batch_sum(ctx, PICOREDIS_EXISTS, key_num, keys);
+}
+
+// returns the number of elements of the chunk starting at start. a chunk is
+// bounded by PICOREDIS_BATCH_CHUNK_SIZE elements and PICOREDIS_BULK_CHUNK_BYTES
+// argument bytes, so that no single command keeps the server busy for long.
+static size_t picoredis_bulk_chunk(const picoredis_view_t *args, size_t step, size_t start, size_t num)
+{
+    size_t bytes = 0;
+    size_t count = 0;
+    while (start + count < num && count < PICOREDIS_BATCH_CHUNK_SIZE) {
+        size_t element_bytes = 0;
+        size_t j = 0;
+        for (; j < step; ++j) {
+            element_bytes += args[(start + count) * step + j].length;
+        }
+        if (count > 0 && bytes + element_bytes > PICOREDIS_BULK_CHUNK_BYTES) break;
+        bytes += element_bytes;
+        count++;
+    }
+    return count;
+}
+
+// sends the elements [start, end) in one flush, as one command per chunk or
+// one command per element, and reads the replies. returns 0 on success, 1
+// when the server rejected a multi-element command for its arity and -1 on error.
+static int picoredis_bulk_range(picoredis_t *ctx, picoredis_command_type type, const char *key, const picoredis_view_t *args, size_t step, size_t start, size_t end, int variadic, long long *sum, long long *last)
+{
+    size_t max_args   = 1 + PICOREDIS_BATCH_CHUNK_SIZE * step;
+    const char **argv = (const char **)malloc((sizeof(const char *) + sizeof(size_t)) * max_args);
+    if (!argv) {
+        ctx->error = "cannot allocate command";
+        return -1;
+    }
+    size_t *lengths = (size_t *)(argv + max_args);
+    argv[0]    = key;
+    lengths[0] = strlen(key);
+
+    size_t command_num = 0;
+    size_t i = start;
+    while (i < end) {
+        size_t count = variadic ? picoredis_bulk_chunk(args, step, i, end) : 1;
+        size_t j = 0;
+        for (; j < count * step; ++j) {
+            argv[1 + j]    = args[i * step + j].ptr;
+            lengths[1 + j] = args[i * step + j].length;
+        }
+        if (picoredis_append_command_argv(ctx, type, 1 + count * step, argv, lengths) < 0) break;
+        command_num++;
+        i += count;
+    }
+    free(argv);
+    if (i < end) {
+        // nothing has been written yet
+        ctx->send_length     = 0;
+        ctx->pending_replies = 0;
+        return -1;
+    }
+
+    int ret = 0;
+    for (i = 0; i < command_num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            static const char arity_error[] = "ERR wrong number of arguments";
+            if (variadic && ret == 0 && view.value.length >= sizeof(arity_error) - 1 &&
+                memcmp(view.value.ptr, arity_error, sizeof(arity_error) - 1) == 0) {
+                ret = 1;
+            } else {
+                ctx->error = "bulk command rejected";
+                ret = -1;
+            }
+            continue;
+        }
+        *sum += view.integer;
+        *last = view.integer;
+    }
+    return ret;
+}
+
+// writes num elements of step arguments each to key. while it is not known
+// whether the server takes several members per command, one chunk is sent
+// alone as a probe; after that the whole batch costs one round trip.
+// returns the sum of the integer replies and -1 on error.
+static long long picoredis_bulk_write(picoredis_t *ctx, picoredis_command_type type, const char *key, size_t num, const picoredis_view_t *args, size_t step, long long *last)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    long long sum = 0;
+    *last = 0;
+    size_t i = 0;
+    while (i < num) {
+        int probing  = (type != PICOREDIS_HMSET && ctx->variadic == 0);
+        int variadic = (type == PICOREDIS_HMSET || ctx->variadic >= 0);
+        size_t end   = probing ? i + picoredis_bulk_chunk(args, step, i, num) : num;
+        int ret = picoredis_bulk_range(ctx, type, key, args, step, i, end, variadic, &sum, last);
+        if (ret < 0) return -1;
+        if (ret > 0) {
+            if (!probing) {
+                ctx->error = "bulk command rejected";
+                return -1;
+            }
+            // redis < 2.4, the probe is sent again one element per command
+            ctx->variadic = -1;
+            continue;
+        }
+        if (probing && end - i > 1) {
+            ctx->variadic = 1;
+        }
+        i = end;
+    }
+    return sum;
+}
+
+// returns the number of members added or -1
+static long long picoredis_exec_sadd_bulk(picoredis_t *ctx, const char *key, size_t member_num, const picoredis_view_t *members)
+{
+    long long last;
+    return picoredis_bulk_write(ctx, PICOREDIS_SADD, key, member_num, members, 1, &last);
+}
+
+// returns the number of members added or -1
+static long long picoredis_exec_zadd_bulk(picoredis_t *ctx, const char *key, size_t member_num, const double *scores, const picoredis_view_t *members)
+{
+    static const size_t score_size = PICOREDIS_DOUBLE_BUFFER_SIZE;
+    picoredis_view_t *args = (picoredis_view_t *)malloc((sizeof(picoredis_view_t) * 2 + score_size) * member_num);
+    if (!args && member_num > 0) {
+        ctx->error = "cannot allocate command";
+        return -1;
+    }
+    char *score_values = (char *)(args + member_num * 2);
+    size_t i = 0;
+    for (; i < member_num; ++i) {
+        char *score = score_values + i * score_size;
+        args[i * 2].ptr    = score;
+        args[i * 2].length = picoredis_format_double(score, scores[i]);
+        args[i * 2 + 1]    = members[i];
+    }
+    long long last;
+    long long ret = picoredis_bulk_write(ctx, PICOREDIS_ZADD, key, member_num, args, 2, &last);
+    free(args);
+    return ret;
+}
+
+// returns the length of the list after the push or -1
+static long long picoredis_exec_rpush_bulk(picoredis_t *ctx, const char *key, size_t value_num, const picoredis_view_t *values)
+{
+    long long last;
+    return picoredis_bulk_write(ctx, PICOREDIS_RPUSH, key, value_num, values, 1, &last) < 0 ? -1 : last;
+}
+
+// returns the length of the list after the push or -1
+static long long picoredis_exec_lpush_bulk(picoredis_t *ctx, const char *key, size_t value_num, const picoredis_view_t *values)
+{
+    long long last;
+    return picoredis_bulk_write(ctx, PICOREDIS_LPUSH, key, value_num, values, 1, &last) < 0 ? -1 : last;
+}
+
+// HMSET takes any number of fields on every supported version, so only the chunking applies
+static int picoredis_exec_hset_bulk(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values)
+{
+    picoredis_view_t *args = (picoredis_view_t *)malloc(sizeof(picoredis_view_t) * 2 * field_num);
+    if (!args && field_num > 0) {
+        ctx->error = "cannot allocate command";
+        return 0;
+    }
+    size_t i = 0;
+    for (; i < field_num; ++i) {
+        args[i * 2]     = fields[i];
+        args[i * 2 + 1] = values[i];
+    }
+    long long last;
+    long long ret = picoredis_bulk_write(ctx, PICOREDIS_HMSET, key, field_num, args, 2, &last);
+    free(args);
+    return ret < 0 ? 0 : 1;
+}
+
+static int picoredis_exec_incr(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_INCR, key);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_incrby(picoredis_t *ctx, const char *key, int value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_INCRBY, key, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_decr(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_DECR, key);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_decrby(picoredis_t *ctx, const char *key, int value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_DECRBY, key, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int64_t picoredis_exec_incr_int64(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_INCR, key);
+    return reply ? reply->integer : 0;
+}
+
+static int64_t picoredis_exec_incrby_int64(picoredis_t *ctx, const char *key, int64_t value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_INCRBY, key, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int64_t picoredis_exec_decr_int64(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_DECR, key);
+    return reply ? reply->integer : 0;
+}
+
+static int64_t picoredis_exec_decrby_int64(picoredis_t *ctx, const char *key, int64_t value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_DECRBY, key, int_value);
+    return reply ? reply->integer : 0;
+}
+
+// returns 1 and sets value, 0 when key does not exist and -1 when it does not hold an integer
+static int picoredis_exec_get_int64(picoredis_t *ctx, const char *key, int64_t *value)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_GET, key);
+    return reply ? picoredis_reply_view_int64(ctx, reply, value) : -1;
+}
+
+// returns 1 and sets value, 0 when key does not exist and -1 when it does not hold a number
+static int picoredis_exec_get_double(picoredis_t *ctx, const char *key, double *value)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_GET, key);
+    return reply ? picoredis_reply_view_double(ctx, reply, value) : -1;
+}
+
+static int picoredis_exec_append(picoredis_t *ctx, const char *key, const char *value)
+{
+    return picoredis_exec_append_binary(ctx, key, strlen(key), value, strlen(value));
+}
+
+static int picoredis_exec_append_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_APPEND, key, key_length, value, value_length);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_substr(picoredis_t *ctx, const char *key, int start, int end)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char end_value[64] = {0};
+    picoredis_format_int(end_value, end);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_SUBSTR, key, start_value, end_value);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static int picoredis_exec_lpush(picoredis_t *ctx, const char *key, const char *value)
+{
+    return picoredis_exec_lpush_binary(ctx, key, strlen(key), value, strlen(value));
+}
+
+static int picoredis_exec_lpush_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_LPUSH, key, key_length, value, value_length);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_rpush(picoredis_t *ctx, const char *key, const char *value)
+{
+    return picoredis_exec_rpush_binary(ctx, key, strlen(key), value, strlen(value));
+}
+
+static int picoredis_exec_rpush_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *value, size_t value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_RPUSH, key, key_length, value, value_length);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_llen(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_LLEN, key);
+    return reply ? reply->integer : 0;
+}
+
+static picoredis_array_t *picoredis_exec_lrange(picoredis_t *ctx, const char *key, int start, int end)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char end_value[64] = {0};
+    picoredis_format_int(end_value, end);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LRANGE, key, start_value, end_value);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_lrange_iter(picoredis_t *ctx, const char *key, int start, int end, picoredis_iterator_t *iter)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char end_value[64] = {0};
+    picoredis_format_int(end_value, end);
+
+    const char *values[] = { key, start_value, end_value };
+    return picoredis_exec_argv_iter(ctx, PICOREDIS_LRANGE, 3, values, NULL, iter);
+}
+
+static int picoredis_exec_lrange_view(picoredis_t *ctx, const void *key, size_t key_length, int start, int end, picoredis_reply_view_t *view)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char end_value[64] = {0};
+    picoredis_format_int(end_value, end);
+
+    const char *values[] = { (const char *)key, start_value, end_value };
+    size_t lengths[]     = { key_length, strlen(start_value), strlen(end_value) };
+    if (picoredis_exec_argv_view(ctx, PICOREDIS_LRANGE, 3, values, lengths, view) < 0) return -1;
+    if (view->type != PICOREDIS_REPLY_MULTI_BULK) {
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
+    return 0;
+}
+
+static int picoredis_exec_ltrim(picoredis_t *ctx, const char *key, int start, int end)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char end_value[64] = {0};
+    picoredis_format_int(end_value, end);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LTRIM, key, start_value, end_value);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static char *picoredis_exec_lindex(picoredis_t *ctx, const char *key, int index)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, index);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_LINDEX, key, int_value);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static int picoredis_exec_lset(picoredis_t *ctx, const char *key, int index, const char *value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, index);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LSET, key, int_value, value);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_lrem(picoredis_t *ctx, const char *key, int count, const char *value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, count);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_LREM, key, int_value, value);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_lpop(picoredis_t *ctx, const char *key)
+{
+    return picoredis_exec_lpop_binary(ctx, key, strlen(key), NULL);
+}
+
+static char *picoredis_exec_lpop_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary1(ctx, PICOREDIS_LPOP, key, key_length);
+    return reply ? picoredis_reply_view_string(reply, value_length) : NULL;
+}
+
+static char *picoredis_exec_rpop(picoredis_t *ctx, const char *key)
+{
+    return picoredis_exec_rpop_binary(ctx, key, strlen(key), NULL);
+}
+
+static char *picoredis_exec_rpop_binary(picoredis_t *ctx, const void *key, size_t key_length, size_t *value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary1(ctx, PICOREDIS_RPOP, key, key_length);
+    return reply ? picoredis_reply_view_string(reply, value_length) : NULL;
+}
+
+static char *picoredis_exec_rpoplpush(picoredis_t *ctx, const char *srckey, const char *dstkey)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_RPOPLPUSH, srckey, dstkey);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static int picoredis_exec_sadd(picoredis_t *ctx, const char *key, const char *member)
+{
+    return picoredis_exec_sadd_binary(ctx, key, strlen(key), member, strlen(member));
+}
+
+static int picoredis_exec_sadd_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_SADD, key, key_length, member, member_length);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_srem(picoredis_t *ctx, const char *key, const char *member)
+{
+    return picoredis_exec_srem_binary(ctx, key, strlen(key), member, strlen(member));
+}
+
+static int picoredis_exec_srem_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_SREM, key, key_length, member, member_length);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_spop(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SPOP, key);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static int picoredis_exec_smove(picoredis_t *ctx, const char *srckey, const char *dstkey, const char *member)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_SMOVE, srckey, dstkey, member);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_scard(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SCARD, key);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_sismember(picoredis_t *ctx, const char *key, const char *member)
+{
+    return picoredis_exec_sismember_binary(ctx, key, strlen(key), member, strlen(member));
+}
+
+static int picoredis_exec_sismember_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *member, size_t member_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_SISMEMBER, key, key_length, member, member_length);
+    return reply ? reply->integer : 0;
+}
+
+static picoredis_array_t *picoredis_exec_sinter(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SINTER, nargs, list);
+    va_end(list);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_sinterstore(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SINTERSTORE, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static picoredis_array_t *picoredis_exec_sunion(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SUNION, nargs, list);
+    va_end(list);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_sunionstore(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SUNIONSTORE, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static picoredis_array_t *picoredis_exec_sdiff(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SDIFF, nargs, list);
+    va_end(list);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_sdiffstore(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_SDIFFSTORE, nargs, list);
+    va_end(list);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static picoredis_array_t *picoredis_exec_smembers(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SMEMBERS, key);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_smembers_iter(picoredis_t *ctx, const char *key, picoredis_iterator_t *iter)
+{
+    const char *values[] = { key };
+    return picoredis_exec_argv_iter(ctx, PICOREDIS_SMEMBERS, 1, values, NULL, iter);
+}
+
+static int picoredis_exec_smembers_view(picoredis_t *ctx, const void *key, size_t key_length, picoredis_reply_view_t *view)
+{
+    const char *values[] = { (const char *)key };
+    size_t lengths[]     = { key_length };
+    if (picoredis_exec_argv_view(ctx, PICOREDIS_SMEMBERS, 1, values, lengths, view) < 0) return -1;
+    if (view->type != PICOREDIS_REPLY_MULTI_BULK) {
+        ctx->error = "unexpected reply type";
+        return -1;
+    }
+    return 0;
+}
+
+static char *picoredis_exec_srandmember(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_SRANDMEMBER, key);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static int picoredis_exec_zadd(picoredis_t *ctx, const char *key, double score, const char *member)
+{
+    char double_value[PICOREDIS_DOUBLE_BUFFER_SIZE];
+    picoredis_format_double(double_value, score);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZADD, key, double_value, member);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_zrem(picoredis_t *ctx, const char *key, const char *member)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZREM, key, member);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_zincrby(picoredis_t *ctx, const char *key, double incr, const char *member)
+{
+    char double_value[PICOREDIS_DOUBLE_BUFFER_SIZE];
+    picoredis_format_double(double_value, incr);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZINCRBY, key, double_value, member);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+// returns 1 and sets score to the new score, -1 on error
+static int picoredis_exec_zincrby_double(picoredis_t *ctx, const char *key, double incr, const char *member, double *score)
+{
+    char double_value[PICOREDIS_DOUBLE_BUFFER_SIZE];
+    picoredis_format_double(double_value, incr);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZINCRBY, key, double_value, member);
+    return (reply && picoredis_reply_view_double(ctx, reply, score) > 0) ? 1 : -1;
+}
+
+static int picoredis_exec_zrank(picoredis_t *ctx, const char *key, const char *member)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZRANK, key, member);
+    if (!reply) return -1;
+    return reply->type == PICOREDIS_REPLY_BULK ? -1 : reply->integer;
+}
+
+static int picoredis_exec_zrevrank(picoredis_t *ctx, const char *key, const char *member)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZREVRANK, key, member);
+    if (!reply) return -1;
+    return reply->type == PICOREDIS_REPLY_BULK ? -1 : reply->integer;
+}
+
+static picoredis_array_t *picoredis_exec_zrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char stop_value[64] = {0};
+    picoredis_format_int(stop_value, stop);
+
+    static const char *with_score = "WITHSCORES";
+
+    picoredis_reply_view_t *reply = is_with_score ?
+        picoredis_send_and_reply4(ctx, PICOREDIS_ZRANGE, key, start_value, stop_value, with_score) :
+        picoredis_send_and_reply3(ctx, PICOREDIS_ZRANGE, key, start_value, stop_value);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_zrange_iter(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score, picoredis_iterator_t *iter)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char stop_value[64] = {0};
+    picoredis_format_int(stop_value, stop);
+
+    const char *values[] = { key, start_value, stop_value, "WITHSCORES" };
+    return picoredis_exec_argv_iter(ctx, PICOREDIS_ZRANGE, is_with_score ? 4 : 3, values, NULL, iter);
+}
+
+static picoredis_array_t *picoredis_exec_zrevrange(picoredis_t *ctx, const char *key, int start, int stop, int is_with_score)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char stop_value[64] = {0};
+    picoredis_format_int(stop_value, stop);
+
+    static const char *with_score = "WITHSCORES";
+
+    picoredis_reply_view_t *reply = is_with_score ?
+        picoredis_send_and_reply4(ctx, PICOREDIS_ZREVRANGE, key, start_value, stop_value, with_score) :
+        picoredis_send_and_reply3(ctx, PICOREDIS_ZREVRANGE, key, start_value, stop_value);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static picoredis_array_t *picoredis_exec_zrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max, int is_with_score)
+{
+    static const char *with_score = "WITHSCORES";
+
+    picoredis_reply_view_t *reply = is_with_score ?
+        picoredis_send_and_reply4(ctx, PICOREDIS_ZRANGEBYSCORE, key, min, max, with_score) :
+        picoredis_send_and_reply3(ctx, PICOREDIS_ZRANGEBYSCORE, key, min, max);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_zcount(picoredis_t *ctx, const char *key, const char *min, const char *max)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZCOUNT, key, min, max);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_zremrangebyrank(picoredis_t *ctx, const char *key, int start, int stop)
+{
+    char start_value[64] = {0};
+    picoredis_format_int(start_value, start);
+
+    char stop_value[64] = {0};
+    picoredis_format_int(stop_value, stop);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZREMRANGEBYRANK, key, start_value, stop_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_zremrangebyscore(picoredis_t *ctx, const char *key, const char *min, const char *max)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_ZREMRANGEBYSCORE, key, min, max);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_zcard(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_ZCARD, key);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_zscore(picoredis_t *ctx, const char *key, const char *member)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZSCORE, key, member);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+// returns 1 and sets score, 0 when member is not in the set and -1 on error
+static int picoredis_exec_zscore_double(picoredis_t *ctx, const char *key, const char *member, double *score)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_ZSCORE, key, member);
+    return reply ? picoredis_reply_view_double(ctx, reply, score) : -1;
+}
+
+static int picoredis_exec_zunionstore(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_ZUNIONSTORE, nargs, list);
+    va_end(list);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_zinterstore(picoredis_t *ctx, size_t nargs, ...)
+{
+    va_list list;
+    va_start(list, nargs);
+    picoredis_reply_view_t *reply = picoredis_send_and_replyn(ctx, PICOREDIS_ZINTERSTORE, nargs, list);
+    va_end(list);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_hset(picoredis_t *ctx, const char *key, const char *field, const char *value)
+{
+    return picoredis_exec_hset_binary(ctx, key, strlen(key), field, strlen(field), value, strlen(value));
+}
+
+static int picoredis_exec_hset_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *field, size_t field_length, const void *value, size_t value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary3(ctx, PICOREDIS_HSET, key, key_length, field, field_length, value, value_length);
+    return reply ? reply->integer : 0;
+}
+
+static char *picoredis_exec_hget(picoredis_t *ctx, const char *key, const char *field)
+{
+    return picoredis_exec_hget_binary(ctx, key, strlen(key), field, strlen(field), NULL);
+}
+
+static char *picoredis_exec_hget_binary(picoredis_t *ctx, const void *key, size_t key_length, const void *field, size_t field_length, size_t *value_length)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_binary2(ctx, PICOREDIS_HGET, key, key_length, field, field_length);
+    return reply ? picoredis_reply_view_string(reply, value_length) : NULL;
+}
+
+// the values of missing fields are NULL
+static picoredis_array_t *picoredis_exec_hmget(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_fields(ctx, PICOREDIS_HMGET, key, field_num, fields, NULL);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static int picoredis_exec_hmset(picoredis_t *ctx, const char *key, size_t field_num, const picoredis_view_t *fields, const picoredis_view_t *values)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply_fields(ctx, PICOREDIS_HMSET, key, field_num, fields, values);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_hincrby(picoredis_t *ctx, const char *key, const char *field, int value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_HINCRBY, key, field, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int64_t picoredis_exec_hincrby_int64(picoredis_t *ctx, const char *key, const char *field, int64_t value)
+{
+    char int_value[64] = {0};
+    picoredis_format_int(int_value, value);
+
+    picoredis_reply_view_t *reply = picoredis_send_and_reply3(ctx, PICOREDIS_HINCRBY, key, field, int_value);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_hexists(picoredis_t *ctx, const char *key, const char *field)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_HEXISTS, key, field);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_hdel(picoredis_t *ctx, const char *key, const char *field)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_HDEL, key, field);
+    return reply ? reply->integer : 0;
+}
+
+static int picoredis_exec_hlen(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_HLEN, key);
+    return reply ? reply->integer : 0;
+}
+
+static picoredis_array_t *picoredis_exec_hkeys(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_HKEYS, key);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+static picoredis_array_t *picoredis_exec_hvals(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_HVALS, key);
+    return reply ? picoredis_reply_view_array(reply) : NULL;
+}
+
+// a missing key is an empty hash
+static picoredis_hash_t *picoredis_exec_hgetall(picoredis_t *ctx, const char *key)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply1(ctx, PICOREDIS_HGETALL, key);
+    return reply ? picoredis_reply_view_hash(reply) : NULL;
+}
+
+static int picoredis_exec_save(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_SAVE);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_bgsave(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_BGSAVE);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_bgrewriteaof(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_BGREWRITEAOF);
+    return reply ? (reply->type == PICOREDIS_REPLY_ERROR ? 0 : 1) : 0;
+}
+
+static int picoredis_exec_lastsave(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_LASTSAVE);
+    return reply ? reply->integer : 0;
+}
+
+static void picoredis_exec_shutdown(picoredis_t *ctx)
+{
+    picoredis_send_and_reply0(ctx, PICOREDIS_SHUTDOWN);
+}
+
+static char *picoredis_exec_info(picoredis_t *ctx)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_INFO);
+    return reply ? picoredis_reply_view_string(reply, NULL) : NULL;
+}
+
+static picoredis_pool_t *picoredis_pool_create(const char *host, int port, size_t min_size, size_t max_size)
+{
+    if (max_size == 0 || min_size > max_size) return NULL;
+
+    picoredis_pool_t *pool = (picoredis_pool_t *)malloc(sizeof(picoredis_pool_t));
+    memset(pool, 0, sizeof(picoredis_pool_t));
+    pool->host        = host;
+    pool->port        = port;
+    pool->min_size    = min_size;
+    pool->max_size    = max_size;
+    pool->connections = (picoredis_t **)calloc(max_size, sizeof(picoredis_t *));
+    pool->next        = (unsigned *)calloc(max_size, sizeof(unsigned));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    size_t i = 0;
+    for (; i < min_size; ++i) {
+        picoredis_t *ctx = picoredis_pool_grow(pool);
+        if (ctx) {
+            picoredis_pool_push(pool, ctx->pool_slot);
+        }
+    }
+    return pool;
+}
+
+// every connection must have been checked in
+static void picoredis_pool_free(picoredis_pool_t *pool)
+{
+    if (!pool) return;
+
+    size_t i = 0;
+    for (; i < pool->size; ++i) {
+        picoredis_free(pool->connections[i]);
+    }
+    free(pool->connections);
+    free(pool->next);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+    free(pool);
+}
+
+// applied to every connection on checkout, call before sharing the pool
+static void picoredis_pool_set_auth(picoredis_pool_t *pool, const char *password)
+{
+    pool->password = password;
+}
+
+static void picoredis_pool_set_db(picoredis_pool_t *pool, size_t db)
+{
+    pool->db = db;
+}
+
+static size_t picoredis_pool_size(picoredis_pool_t *pool)
+{
+    return __atomic_load_n(&pool->size, __ATOMIC_ACQUIRE);
+}
+
+static void picoredis_pool_push(picoredis_pool_t *pool, size_t slot)
+{
+    unsigned long long head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        __atomic_store_n(&pool->next[slot], (unsigned)(head & 0xffffffffULL), __ATOMIC_RELAXED);
+        unsigned long long new_head = (((head >> 32) + 1) << 32) | (slot + 1);
+        if (__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) return;
+    }
+}
+
+static int picoredis_pool_pop(picoredis_pool_t *pool, size_t *slot)
+{
+    unsigned long long head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        unsigned top = (unsigned)(head & 0xffffffffULL);
+        if (top == 0) return -1;
+
+        unsigned next = __atomic_load_n(&pool->next[top - 1], __ATOMIC_RELAXED);
+        unsigned long long new_head = (((head >> 32) + 1) << 32) | next;
+        if (__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *slot = top - 1;
+            return 0;
+        }
+    }
+}
+
+// claims a new slot while the pool is below max_size and connects it
+static picoredis_t *picoredis_pool_grow(picoredis_pool_t *pool)
+{
+    size_t size = __atomic_load_n(&pool->size, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if (size >= pool->max_size) return NULL;
+        if (__atomic_compare_exchange_n(&pool->size, &size, size + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) break;
+    }
+    picoredis_t *ctx = picoredis_connect(pool->host, pool->port);
+    ctx->pool_slot = size;
+    __atomic_store_n(&pool->connections[size], ctx, __ATOMIC_RELEASE);
+    return ctx;
+}
+
+// reconnects a dropped connection and restores the cached AUTH / SELECT state
+static int picoredis_pool_prepare(picoredis_pool_t *pool, picoredis_t *ctx)
+{
+    if (ctx->sock < 0) {
+        ctx->sock          = picoredis_connect_with_ctx(ctx, pool->host, pool->port);
+        ctx->db            = 0;
+        ctx->authenticated = 0;
+        if (ctx->sock < 0) {
+            ctx->error = "cannot connect";
+            return -1;
+        }
+    }
+    ctx->error = NULL;
+    if (pool->password && !ctx->authenticated && !picoredis_exec_auth(ctx, pool->password)) return -1;
+    if (ctx->db != pool->db && !picoredis_exec_select(ctx, pool->db)) return -1;
+    return 0;
+}
+
+// blocks while max_size connections are checked out
+static picoredis_t *picoredis_pool_checkout(picoredis_pool_t *pool)
+{
+    size_t slot;
+    picoredis_t *ctx = NULL;
+    if (picoredis_pool_pop(pool, &slot) == 0) {
+        ctx = pool->connections[slot];
+    } else if (!(ctx = picoredis_pool_grow(pool))) {
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        // pairs with the fence in checkin: either it sees the waiter or the pop sees its push
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while (picoredis_pool_pop(pool, &slot) < 0) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        ctx = pool->connections[slot];
+    }
+    if (picoredis_pool_prepare(pool, ctx) < 0) {
+        picoredis_pool_checkin(pool, ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void picoredis_pool_checkin(picoredis_pool_t *pool, picoredis_t *ctx)
+{
+    // a connection with unread replies or a broken socket cannot be reused as is
+    if (ctx->sock >= 0 && (ctx->pending_replies > 0 || ctx->send_length > 0 || ctx->receive_begin != ctx->receive_end)) {
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+    if (ctx->sock < 0) {
+        ctx->pending_replies = 0;
+        ctx->send_length     = 0;
+        ctx->receive_begin   = ctx->receive_end = 0;
+        ctx->reader.pos      = 0;
+        picoredis_reader_consume(ctx);
+    }
+    picoredis_pool_push(pool, ctx->pool_slot);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// runs fn on a checked out connection and returns its result, or -1 when no connection is available
+static int picoredis_exec_with_pool(picoredis_pool_t *pool, int (*fn)(picoredis_t *ctx, void *arg), void *arg)
+{
+    picoredis_t *ctx = picoredis_pool_checkout(pool);
+    if (!ctx) return -1;
+
+    int ret = fn(ctx, arg);
+    picoredis_pool_checkin(pool, ctx);
+    return ret;
+}
+
+static void picoredis_pool_exec_set(picoredis_pool_t *pool, const char *key, const char *value)
+{
+    picoredis_t *ctx = picoredis_pool_checkout(pool);
+    if (!ctx) return;
+
+    picoredis_exec_set(ctx, key, value);
+    picoredis_pool_checkin(pool, ctx);
+}
+
+static char *picoredis_pool_exec_get(picoredis_pool_t *pool, const char *key)
+{
+    picoredis_t *ctx = picoredis_pool_checkout(pool);
+    if (!ctx) return NULL;
+
+    char *ret = picoredis_exec_get(ctx, key);
+    picoredis_pool_checkin(pool, ctx);
+    return ret;
+}
+
+static int picoredis_pool_exec_incr(picoredis_pool_t *pool, const char *key)
+{
+    picoredis_t *ctx = picoredis_pool_checkout(pool);
+    if (!ctx) return 0;
+
+    int ret = picoredis_exec_incr(ctx, key);
+    picoredis_pool_checkin(pool, ctx);
+    return ret;
+}
+
+static int picoredis_pool_exec_del(picoredis_pool_t *pool, const char *key)
+{
+    picoredis_t *ctx = picoredis_pool_checkout(pool);
+    if (!ctx) return 0;
+
+    int ret = picoredis_exec_del(ctx, 1, key);
+    picoredis_pool_checkin(pool, ctx);
+    return ret;
+}
+
+static picoredis_mux_t *picoredis_mux_connect(const char *host, int port)
+{
+    picoredis_mux_t *mux = (picoredis_mux_t *)malloc(sizeof(picoredis_mux_t));
+    memset(mux, 0, sizeof(picoredis_mux_t));
+    mux->ctx = picoredis_connect(host, port);
+    pthread_mutex_init(&mux->lock, NULL);
+    pthread_cond_init(&mux->completed, NULL);
+    return mux;
+}
+
+static void picoredis_mux_free(picoredis_mux_t *mux)
+{
+    if (!mux) return;
+
+    picoredis_free(mux->ctx);
+    pthread_mutex_destroy(&mux->lock);
+    pthread_cond_destroy(&mux->completed);
+    free(mux);
+}
+
+static void picoredis_mux_request_release(picoredis_mux_request_t *request)
+{
+    free(request->value);
+    picoredis_array_free(request->array);
+    request->value = NULL;
+    request->array = NULL;
+}
+
+// pops the oldest in-flight request and completes it with the parsed reply (or error)
+static void picoredis_mux_complete(picoredis_mux_t *mux, const char *error)
+{
+    picoredis_mux_request_t *request = mux->inflight_head;
+    mux->inflight_head = request->next;
+    if (!mux->inflight_head) {
+        mux->inflight_tail = NULL;
+    }
+    request->error = error;
+    if (!error) {
+        picoredis_reply_view_t view;
+        if (picoredis_reply_view_create(mux->ctx, &view) < 0) {
+            request->error = mux->ctx->error;
+        } else {
+            request->reply_type = view.type;
+            request->is_nil     = view.is_nil;
+            request->integer    = view.integer;
+            if (view.type == PICOREDIS_REPLY_MULTI_BULK) {
+                request->array = picoredis_reply_view_array(&view);
+            } else if (!view.is_nil) {
+                request->value  = picoredis_reply_copy_string(view.value.ptr, view.value.length);
+                request->length = view.value.length;
+            }
+        }
+    }
+    __atomic_store_n(&request->done, 1, __ATOMIC_RELEASE);
+}
+
+static void picoredis_mux_fail(picoredis_mux_t *mux, const char *error)
+{
+    picoredis_t *ctx = mux->ctx;
+    if (ctx->sock >= 0) {
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+    ctx->send_length     = 0;
+    ctx->pending_replies = 0;
+    ctx->receive_begin   = ctx->receive_end = 0;
+    ctx->reader.pos      = 0;
+    picoredis_reader_consume(ctx);
+    while (mux->inflight_head) {
+        picoredis_mux_complete(mux, error);
+    }
+}
+
+// runs by the thread holding the flusher role until its own request is done.
+// each round writes every queued command with one send and then reads replies.
+static void picoredis_mux_drive(picoredis_mux_t *mux, picoredis_mux_request_t *request)
+{
+    picoredis_t *ctx = mux->ctx;
+    for (;;) {
+        picoredis_mux_request_t *list = __atomic_exchange_n(&mux->queue, NULL, __ATOMIC_ACQUIRE);
+        picoredis_mux_request_t *fifo = NULL;
+        while (list) {
+            picoredis_mux_request_t *next = list->next;
+            list->next = fifo;
+            fifo = list;
+            list = next;
+        }
+        while (fifo) {
+            picoredis_mux_request_t *next = fifo->next;
+            fifo->next = NULL;
+            if (mux->inflight_tail) {
+                mux->inflight_tail->next = fifo;
+            } else {
+                mux->inflight_head = fifo;
+            }
+            mux->inflight_tail = fifo;
+            if (ctx->sock < 0 || picoredis_append_command_argv(ctx, fifo->type, fifo->nargs, fifo->values, fifo->lengths) < 0) {
+                // keep FIFO order with the commands already buffered
+                picoredis_mux_fail(mux, ctx->sock < 0 ? "not connected" : ctx->error);
+            }
+            fifo = next;
+        }
+        if (ctx->send_length > 0 && picoredis_flush(ctx) < 0) {
+            picoredis_mux_fail(mux, ctx->error);
+        }
+        int completed = 0;
+        while (mux->inflight_head) {
+            int parse_result = picoredis_reader_parse(ctx);
+            if (parse_result == 0) break;
+            if (parse_result < 0) {
+                picoredis_mux_fail(mux, "protocol error");
+                break;
+            }
+            picoredis_mux_complete(mux, NULL);
+            picoredis_reader_consume(ctx);
+            ctx->pending_replies--;
+            completed = 1;
+        }
+        if (completed) {
+            pthread_mutex_lock(&mux->lock);
+            pthread_cond_broadcast(&mux->completed);
+            pthread_mutex_unlock(&mux->lock);
+        }
+        if (__atomic_load_n(&request->done, __ATOMIC_ACQUIRE)) return;
+        if (picoredis_receive_more(ctx) < 0) {
+            picoredis_mux_fail(mux, ctx->error);
+        }
+    }
+}
+
+// submits one command and blocks until its reply arrived. concurrent callers
+// are batched into the same send. returns -1 when the command failed
+// (request->error), otherwise the reply is in request.
+static int picoredis_mux_exec_argv(picoredis_mux_t *mux, picoredis_mux_request_t *request, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths)
+{
+    memset(request, 0, sizeof(picoredis_mux_request_t));
+    request->type    = type;
+    request->nargs   = nargs;
+    request->values  = values;
+    request->lengths = lengths;
+
+    picoredis_mux_request_t *head = __atomic_load_n(&mux->queue, __ATOMIC_RELAXED);
+    do {
+        request->next = head;
+    } while (!__atomic_compare_exchange_n(&mux->queue, &head, request, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    while (!__atomic_load_n(&request->done, __ATOMIC_ACQUIRE)) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&mux->flushing, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            picoredis_mux_drive(mux, request);
+            // hand the flusher role to one of the threads still waiting
+            pthread_mutex_lock(&mux->lock);
+            __atomic_store_n(&mux->flushing, 0, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&mux->completed);
+            pthread_mutex_unlock(&mux->lock);
+            break;
+        }
+        pthread_mutex_lock(&mux->lock);
+        while (!__atomic_load_n(&request->done, __ATOMIC_ACQUIRE) && __atomic_load_n(&mux->flushing, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&mux->completed, &mux->lock);
+        }
+        pthread_mutex_unlock(&mux->lock);
+    }
+    return request->error ? -1 : 0;
+}
+
+// returns 1 when the value was stored and -1 on error
+static int picoredis_mux_exec_set(picoredis_mux_t *mux, const char *key, const char *value)
+{
+    const char *values[] = { key, value };
+    picoredis_mux_request_t request;
+    if (picoredis_mux_exec_argv(mux, &request, PICOREDIS_SET, 2, values, NULL) < 0) return -1;
+
+    int ret = request.reply_type == PICOREDIS_REPLY_ERROR ? -1 : 1;
+    picoredis_mux_request_release(&request);
+    return ret;
+}
+
+static char *picoredis_mux_exec_get(picoredis_mux_t *mux, const char *key)
+{
+    const char *values[] = { key };
+    picoredis_mux_request_t request;
+    if (picoredis_mux_exec_argv(mux, &request, PICOREDIS_GET, 1, values, NULL) < 0) return NULL;
+    if (request.reply_type == PICOREDIS_REPLY_ERROR) {
+        picoredis_mux_request_release(&request);
+        return NULL;
+    }
+    return request.value;
+}
+
+static int picoredis_mux_exec_incr(picoredis_mux_t *mux, const char *key)
+{
+    const char *values[] = { key };
+    picoredis_mux_request_t request;
+    if (picoredis_mux_exec_argv(mux, &request, PICOREDIS_INCR, 1, values, NULL) < 0) return 0;
+
+    picoredis_mux_request_release(&request);
+    return request.integer;
+}
+
+// CRC16-CCITT (XMODEM) as used by Redis Cluster for key hash slots
+static unsigned short picoredis_crc16(const char *buf, size_t length)
+{
+    static const unsigned short table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+    };
+    unsigned short crc = 0;
+    size_t i = 0;
+    for (; i < length; ++i) {
+        crc = (crc << 8) ^ table[((crc >> 8) ^ (unsigned char)buf[i]) & 0xff];
+    }
+    return crc;
+}
+
+// only the part between the first '{' and the next '}' is hashed when it is not empty
+static unsigned picoredis_cluster_keyslot(const void *key, size_t length)
+{
+    const char *ptr  = (const char *)key;
+    const char *open = (const char *)memchr(ptr, '{', length);
+    if (open) {
+        const char *close = (const char *)memchr(open + 1, '}', length - (open + 1 - ptr));
+        if (close && close > open + 1) {
+            return picoredis_crc16(open + 1, close - open - 1) & (PICOREDIS_CLUSTER_SLOTS - 1);
+        }
+    }
+    return picoredis_crc16(ptr, length) & (PICOREDIS_CLUSTER_SLOTS - 1);
+}
+
+static picoredis_cluster_t *picoredis_cluster_connect(const char *host, int port)
+{
+    picoredis_cluster_t *cluster = (picoredis_cluster_t *)malloc(sizeof(picoredis_cluster_t));
+    memset(cluster, 0, sizeof(picoredis_cluster_t));
+    memset(cluster->slots, 0xff, sizeof(cluster->slots));
+    picoredis_cluster_node_add(cluster, host, strlen(host), port);
+    picoredis_cluster_refresh(cluster);
+    return cluster;
+}
+
+static void picoredis_cluster_free(picoredis_cluster_t *cluster)
+{
+    if (!cluster) return;
+
+    size_t i = 0;
+    for (; i < cluster->node_num; ++i) {
+        picoredis_free(cluster->nodes[i].ctx);
+        free(cluster->nodes[i].host);
+    }
+    free(cluster->nodes);
+    free(cluster);
+}
+
+static int picoredis_cluster_has_error(picoredis_cluster_t *cluster)
+{
+    return cluster->error != NULL;
+}
+
+// returns the index of the node at host:port, adding it when it is new
+static int picoredis_cluster_node_add(picoredis_cluster_t *cluster, const char *host, size_t host_length, int port)
+{
+    size_t i = 0;
+    for (; i < cluster->node_num; ++i) {
+        picoredis_cluster_node_t *node = &cluster->nodes[i];
+        if (node->port == port && strlen(node->host) == host_length && memcmp(node->host, host, host_length) == 0) return i;
+    }
+    if (cluster->node_num == cluster->node_capacity) {
+        size_t new_capacity = cluster->node_capacity ? cluster->node_capacity * 2 : 8;
+        picoredis_cluster_node_t *new_nodes = (picoredis_cluster_node_t *)realloc(cluster->nodes, sizeof(picoredis_cluster_node_t) * new_capacity);
+        if (!new_nodes) return -1;
+        cluster->nodes         = new_nodes;
+        cluster->node_capacity = new_capacity;
+    }
+    picoredis_cluster_node_t *node = &cluster->nodes[cluster->node_num];
+    memset(node, 0, sizeof(picoredis_cluster_node_t));
+    node->host = picoredis_reply_copy_string(host, host_length);
+    node->port = port;
+    return cluster->node_num++;
+}
+
+static picoredis_t *picoredis_cluster_node_ctx(picoredis_cluster_t *cluster, int node)
+{
+    picoredis_cluster_node_t *entry = &cluster->nodes[node];
+    if (!entry->ctx) {
+        entry->ctx = picoredis_connect(entry->host, entry->port);
+    }
+    if (entry->ctx->sock < 0) {
+        cluster->error = "cannot connect to cluster node";
+        picoredis_cluster_node_drop(cluster, node);
+        return NULL;
+    }
+    return entry->ctx;
+}
+
+static void picoredis_cluster_node_drop(picoredis_cluster_t *cluster, int node)
+{
+    picoredis_free(cluster->nodes[node].ctx);
+    cluster->nodes[node].ctx = NULL;
+    cluster->nodes[node].generation++;
+}
+
+// <id> <ip:port@cport[,hostname]> <flags> <master> <ping-sent> <pong-recv> <config-epoch> <link-state> <slot>...
+static int picoredis_cluster_parse_nodes(picoredis_cluster_t *cluster, int queried, const char *text, size_t length)
+{
+    const char *end = text + length;
+    const char *line = text;
+    while (line < end) {
+        const char *line_end = (const char *)memchr(line, '\n', end - line);
+        if (!line_end) {
+            line_end = end;
+        }
+        const char *fields[8];
+        size_t field_lengths[8];
+        size_t field_num = 0;
+        const char *ptr  = line;
+        while (ptr < line_end && field_num < 8) {
+            const char *space = (const char *)memchr(ptr, ' ', line_end - ptr);
+            const char *field_end = space ? space : line_end;
+            fields[field_num]        = ptr;
+            field_lengths[field_num] = field_end - ptr;
+            field_num++;
+            ptr = field_end + 1;
+        }
+        if (field_num < 8) {
+            line = line_end + 1;
+            continue;
+        }
+        size_t address_length = field_lengths[1];
+        const char *at = (const char *)memchr(fields[1], '@', address_length);
+        if (at) {
+            address_length = at - fields[1];
+        }
+        const char *colon = NULL;
+        size_t i = 0;
+        for (; i < address_length; ++i) {
+            if (fields[1][i] == ':') {
+                colon = fields[1] + i;
+            }
+        }
+        char flags[128] = {0};
+        memcpy(flags, fields[2], field_lengths[2] < sizeof(flags) - 1 ? field_lengths[2] : sizeof(flags) - 1);
+        if (!colon || strstr(flags, "fail") || strstr(flags, "handshake") || strstr(flags, "noaddr")) {
+            line = line_end + 1;
+            continue;
+        }
+        int port = atoi(colon + 1);
+        int node = (colon == fields[1]) ?
+            queried : // the node answering may not know its own address yet
+            picoredis_cluster_node_add(cluster, fields[1], colon - fields[1], port);
+        if (node < 0) return -1;
+
+        // slot ranges follow the 8th field, "[slot->-id]" entries describe migrations
+        while (ptr < line_end) {
+            const char *space = (const char *)memchr(ptr, ' ', line_end - ptr);
+            const char *field_end = space ? space : line_end;
+            if (*ptr != '[') {
+                char *range_end = NULL;
+                long first = strtol(ptr, &range_end, 10);
+                long last  = (range_end < field_end && *range_end == '-') ? strtol(range_end + 1, NULL, 10) : first;
+                long slot  = first;
+                for (; 0 <= slot && slot <= last && slot < PICOREDIS_CLUSTER_SLOTS; ++slot) {
+                    cluster->slots[slot] = node;
+                }
+            }
+            ptr = field_end + 1;
+        }
+        line = line_end + 1;
+    }
+    return 0;
+}
+
+// reloads the whole slot map from the first node that answers CLUSTER NODES
+static int picoredis_cluster_refresh(picoredis_cluster_t *cluster)
+{
+    size_t i = 0;
+    for (; i < cluster->node_num; ++i) {
+        picoredis_t *ctx = picoredis_cluster_node_ctx(cluster, i);
+        if (!ctx) continue;
+
+        const char *values[] = { "NODES" };
+        picoredis_reply_view_t view;
+        if (picoredis_exec_argv_view(ctx, PICOREDIS_CLUSTER, 1, values, NULL, &view) < 0) {
+            picoredis_cluster_node_drop(cluster, i);
+            continue;
+        }
+        if (view.type != PICOREDIS_REPLY_BULK || view.is_nil) continue;
+        if (picoredis_cluster_parse_nodes(cluster, i, view.value.ptr, view.value.length) < 0) continue;
+
+        cluster->error = NULL;
+        return 0;
+    }
+    cluster->error = "cannot load cluster slots";
+    return -1;
+}
+
+// returns 1 for MOVED (slot map updated), 2 for ASK and 0 for any other reply
+static int picoredis_cluster_redirect(picoredis_cluster_t *cluster, picoredis_reply_view_t *view, unsigned *slot, int *node)
+{
+    if (view->type != PICOREDIS_REPLY_ERROR) return 0;
+
+    const char *ptr = view->value.ptr;
+    size_t length   = view->value.length;
+    int kind = 0;
+    if (length > 6 && memcmp(ptr, "MOVED ", 6) == 0) {
+        kind = 1;
+        ptr += 6;
+    } else if (length > 4 && memcmp(ptr, "ASK ", 4) == 0) {
+        kind = 2;
+        ptr += 4;
+    } else {
+        return 0;
+    }
+    const char *end   = view->value.ptr + length;
+    const char *space = (const char *)memchr(ptr, ' ', end - ptr);
+    if (!space) return 0;
+
+    *slot = strtoul(ptr, NULL, 10) & (PICOREDIS_CLUSTER_SLOTS - 1);
+    const char *address = space + 1;
+    const char *colon   = NULL;
+    for (ptr = address; ptr < end; ++ptr) {
+        if (*ptr == ':') {
+            colon = ptr;
+        }
+    }
+    if (!colon) return 0;
+
+    char port[8] = {0};
+    memcpy(port, colon + 1, (size_t)(end - colon - 1) < sizeof(port) - 1 ? (size_t)(end - colon - 1) : sizeof(port) - 1);
+    *node = picoredis_cluster_node_add(cluster, address, colon - address, atoi(port));
+    if (*node < 0) return 0;
+    if (kind == 1) {
+        cluster->slots[*slot] = *node;
+    }
+    return kind;
+}
+
+// routes by the slot of values[0]. the reply borrows the receive buffer of the
+// node connection and is valid until the next command on that node.
+static int picoredis_cluster_exec_argv_view(picoredis_cluster_t *cluster, picoredis_command_type type, size_t nargs, const char **values, const size_t *lengths, picoredis_reply_view_t *view)
+{
+    unsigned slot = nargs > 0 ? picoredis_cluster_keyslot(values[0], lengths ? lengths[0] : strlen(values[0])) : 0;
+    int node      = cluster->slots[slot] >= 0 ? cluster->slots[slot] : 0;
+    int asking    = 0;
+    int redirects = 0;
+    cluster->error = NULL;
+    for (; redirects <= PICOREDIS_CLUSTER_MAX_REDIRECTS; ++redirects) {
+        picoredis_t *ctx = picoredis_cluster_node_ctx(cluster, node);
+        int result = -1;
+        if (ctx && asking) {
+            // ASKING only applies to the command right after it
+            picoredis_append_command_argv(ctx, PICOREDIS_ASKING, 0, NULL, NULL);
+            picoredis_append_command_argv(ctx, type, nargs, values, lengths);
+            result = picoredis_get_reply_view(ctx, view);
+            if (result == 0) {
+                result = picoredis_get_reply_view(ctx, view);
+            }
+        } else if (ctx) {
+            result = picoredis_exec_argv_view(ctx, type, nargs, values, lengths, view);
+        }
+        if (result < 0) {
+            // the node went away, the map is probably stale as well
+            if (ctx) {
+                picoredis_cluster_node_drop(cluster, node);
+            }
+            if (picoredis_cluster_refresh(cluster) < 0) return -1;
+            node   = cluster->slots[slot] >= 0 ? cluster->slots[slot] : 0;
+            asking = 0;
+            continue;
+        }
+        unsigned redirect_slot;
+        int redirect = picoredis_cluster_redirect(cluster, view, &redirect_slot, &node);
+        if (redirect == 0) return 0;
+        asking = (redirect == 2);
+    }
+    cluster->error = "too many cluster redirects";
+    return -1;
+}
+
+static void picoredis_cluster_exec_set(picoredis_cluster_t *cluster, const char *key, const char *value)
+{
+    const char *values[] = { key, value };
+    picoredis_reply_view_t view;
+    picoredis_cluster_exec_argv_view(cluster, PICOREDIS_SET, 2, values, NULL, &view);
+}
+
+static char *picoredis_cluster_exec_get(picoredis_cluster_t *cluster, const char *key)
+{
+    const char *values[] = { key };
+    picoredis_reply_view_t view;
+    if (picoredis_cluster_exec_argv_view(cluster, PICOREDIS_GET, 1, values, NULL, &view) < 0) return NULL;
+    return picoredis_reply_view_string(&view, NULL);
+}
+
+static int picoredis_cluster_exec_incr(picoredis_cluster_t *cluster, const char *key)
+{
+    const char *values[] = { key };
+    picoredis_reply_view_t view;
+    if (picoredis_cluster_exec_argv_view(cluster, PICOREDIS_INCR, 1, values, NULL, &view) < 0) return 0;
+    return view.integer;
+}
+
+static int picoredis_cluster_key_compare(const void *a, const void *b)
+{
+    const picoredis_cluster_key_t *key1 = (const picoredis_cluster_key_t *)a;
+    const picoredis_cluster_key_t *key2 = (const picoredis_cluster_key_t *)b;
+    if (key1->slot != key2->slot) return key1->slot < key2->slot ? -1 : 1;
+    return key1->index < key2->index ? -1 : (key1->index > key2->index);
+}
+
+// splits a multi-key command (step values per key) into one command per slot.
+// every node gets its share pipelined and all nodes are flushed before any
+// reply is read, so the nodes work in parallel. groups that come back with a
+// redirect or a broken connection are retried through the routed path.
+// integer replies are added to sum; returns -1 when any group failed.
+static int picoredis_cluster_exec_multi(picoredis_cluster_t *cluster, picoredis_command_type type, size_t nargs, const char **values, size_t step, long long *sum)
+{
+    size_t key_num = nargs / step;
+    picoredis_cluster_key_t *keys = (picoredis_cluster_key_t *)malloc(sizeof(picoredis_cluster_key_t) * (key_num + 1));
+    const char **argv   = (const char **)malloc(sizeof(const char *) * (nargs + 1));
+    size_t *group_start = (size_t *)malloc(sizeof(size_t) * (key_num + 1) * 4);
+    size_t *group_num   = group_start + key_num + 1;
+    size_t *group_node  = group_num + key_num + 1;
+    size_t *group_gen   = group_node + key_num + 1;
+    size_t i = 0;
+    for (; i < key_num; ++i) {
+        keys[i].slot  = picoredis_cluster_keyslot(values[i * step], strlen(values[i * step]));
+        keys[i].index = i;
+    }
+    qsort(keys, key_num, sizeof(picoredis_cluster_key_t), picoredis_cluster_key_compare);
+    for (i = 0; i < key_num; ++i) {
+        memcpy(&argv[i * step], &values[keys[i].index * step], sizeof(const char *) * step);
+    }
+
+    cluster->error = NULL;
+    size_t groups = 0;
+    for (i = 0; i < key_num; ++groups) {
+        size_t first = i;
+        for (; i < key_num && keys[i].slot == keys[first].slot; ++i) {}
+        int node = cluster->slots[keys[first].slot] >= 0 ? cluster->slots[keys[first].slot] : 0;
+        group_start[groups] = first * step;
+        group_num[groups]   = (i - first) * step;
+        group_node[groups]  = node;
+        // a failed connect or append drops the node, so the generation no longer matches
+        group_gen[groups]   = cluster->nodes[node].generation;
+        picoredis_t *ctx    = picoredis_cluster_node_ctx(cluster, node);
+        if (ctx && picoredis_append_command_argv(ctx, type, group_num[groups], &argv[group_start[groups]], NULL) < 0) {
+            picoredis_cluster_node_drop(cluster, node);
+        }
+    }
+    for (i = 0; i < cluster->node_num; ++i) {
+        picoredis_t *ctx = cluster->nodes[i].ctx;
+        if (ctx && ctx->send_length > 0 && picoredis_flush(ctx) < 0) {
+            picoredis_cluster_node_drop(cluster, i);
+        }
+    }
+
+    // every pipelined reply is drained before any retry goes out on the same connections
+    int ret = 0;
+    size_t retries = 0;
+    for (i = 0; i < groups; ++i) {
+        picoredis_cluster_node_t *node = &cluster->nodes[group_node[i]];
+        picoredis_reply_view_t view;
+        int result = -1;
+        if (node->ctx && node->generation == group_gen[i]) {
+            result = picoredis_get_reply_view(node->ctx, &view);
+            if (result < 0) {
+                picoredis_cluster_node_drop(cluster, group_node[i]);
+            }
+        }
+        unsigned slot;
+        int redirect_node;
+        if (result < 0 || picoredis_cluster_redirect(cluster, &view, &slot, &redirect_node)) {
+            group_start[retries] = group_start[i];
+            group_num[retries]   = group_num[i];
+            retries++;
+            continue;
+        }
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            ret = -1;
+        } else if (view.type == PICOREDIS_REPLY_NUM) {
+            *sum += view.integer;
+        }
+    }
+    for (i = 0; i < retries; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_cluster_exec_argv_view(cluster, type, group_num[i], &argv[group_start[i]], NULL, &view) < 0 || view.type == PICOREDIS_REPLY_ERROR) {
+            ret = -1;
+        } else if (view.type == PICOREDIS_REPLY_NUM) {
+            *sum += view.integer;
+        }
+    }
+    free(keys);
+    free(argv);
+    free(group_start);
+    return ret;
+}
+
+static int picoredis_cluster_exec_del(picoredis_cluster_t *cluster, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+    long long sum = 0;
+    picoredis_cluster_exec_multi(cluster, PICOREDIS_DEL, nargs, values, 1, &sum);
+    return sum;
+}
+
+// nargs counts keys and values, like picoredis_exec_mset
+static int picoredis_cluster_exec_mset(picoredis_cluster_t *cluster, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+    long long sum = 0;
+    return picoredis_cluster_exec_multi(cluster, PICOREDIS_MSET, nargs, values, 2, &sum) < 0 ? 0 : 1;
+}
+
+static unsigned picoredis_murmur3_32(const void *key, size_t length, unsigned seed)
+{
+    const unsigned char *data = (const unsigned char *)key;
+    const unsigned c1 = 0xcc9e2d51;
+    const unsigned c2 = 0x1b873593;
+    unsigned hash = seed;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        unsigned k;
+        memcpy(&k, data + i, sizeof(k));
+        k *= c1;
+        k  = (k << 15) | (k >> 17);
+        k *= c2;
+        hash ^= k;
+        hash  = (hash << 13) | (hash >> 19);
+        hash  = hash * 5 + 0xe6546b64;
+    }
+    unsigned k = 0;
+    switch (length & 3) {
+    case 3: k ^= data[i + 2] << 16; // fallthrough
+    case 2: k ^= data[i + 1] << 8;  // fallthrough
+    case 1: k ^= data[i];
+        k *= c1;
+        k  = (k << 15) | (k >> 17);
+        k *= c2;
+        hash ^= k;
+    }
+    hash ^= (unsigned)length;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static picoredis_shard_t *picoredis_shard_create(void)
+{
+    picoredis_shard_t *shard = (picoredis_shard_t *)malloc(sizeof(picoredis_shard_t));
+    memset(shard, 0, sizeof(picoredis_shard_t));
+    return shard;
+}
+
+static void picoredis_shard_free(picoredis_shard_t *shard)
+{
+    if (!shard) return;
+
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        picoredis_free(shard->nodes[i].ctx);
+        free(shard->nodes[i].name);
+        free(shard->nodes[i].host);
+    }
+    free(shard->nodes);
+    free(shard->points);
+    free(shard);
+}
+
+static int picoredis_shard_point_compare(const void *a, const void *b)
+{
+    const picoredis_shard_point_t *point1 = (const picoredis_shard_point_t *)a;
+    const picoredis_shard_point_t *point2 = (const picoredis_shard_point_t *)b;
+    if (point1->hash != point2->hash) return point1->hash < point2->hash ? -1 : 1;
+    return point1->node < point2->node ? -1 : (point1->node > point2->node);
+}
+
+// the points of a node only depend on its name, so adding or removing a node
+// only moves the keys that land on its own points
+static int picoredis_shard_build_ring(picoredis_shard_t *shard)
+{
+    size_t point_num = 0;
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        if (!shard->nodes[i].removed) {
+            point_num += shard->nodes[i].weight * PICOREDIS_SHARD_POINTS_PER_WEIGHT;
+        }
+    }
+    picoredis_shard_point_t *points = (picoredis_shard_point_t *)malloc(sizeof(picoredis_shard_point_t) * (point_num + 1));
+    if (!points) {
+        shard->error = "cannot allocate hash ring";
+        return -1;
+    }
+    size_t num = 0;
+    for (i = 0; i < shard->node_num; ++i) {
+        picoredis_shard_node_t *node = &shard->nodes[i];
+        if (node->removed) continue;
+
+        size_t name_length = strlen(node->name);
+        size_t j = 0;
+        for (; j < node->weight * PICOREDIS_SHARD_POINTS_PER_WEIGHT; ++j) {
+            points[num].hash = picoredis_murmur3_32(node->name, name_length, (unsigned)j);
+            points[num].node = i;
+            num++;
+        }
+    }
+    qsort(points, num, sizeof(picoredis_shard_point_t), picoredis_shard_point_compare);
+    free(shard->points);
+    shard->points    = points;
+    shard->point_num = num;
+    return 0;
+}
+
+static int picoredis_shard_add_node(picoredis_shard_t *shard, const char *name, const char *host, int port, size_t weight)
+{
+    if (weight == 0) return -1;
+
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        if (strcmp(shard->nodes[i].name, name) == 0 && !shard->nodes[i].removed) {
+            shard->error = "node already exists";
+            return -1;
+        }
+    }
+    if (shard->node_num == shard->node_capacity) {
+        size_t new_capacity = shard->node_capacity ? shard->node_capacity * 2 : 8;
+        picoredis_shard_node_t *new_nodes = (picoredis_shard_node_t *)realloc(shard->nodes, sizeof(picoredis_shard_node_t) * new_capacity);
+        if (!new_nodes) return -1;
+        shard->nodes         = new_nodes;
+        shard->node_capacity = new_capacity;
+    }
+    picoredis_shard_node_t *node = &shard->nodes[shard->node_num++];
+    memset(node, 0, sizeof(picoredis_shard_node_t));
+    node->name   = picoredis_reply_copy_string(name, strlen(name));
+    node->host   = picoredis_reply_copy_string(host, strlen(host));
+    node->port   = port;
+    node->weight = weight;
+    return picoredis_shard_build_ring(shard);
+}
+
+// node indexes stay stable, a removed node only stops owning points
+static int picoredis_shard_remove_node(picoredis_shard_t *shard, const char *name)
+{
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        picoredis_shard_node_t *node = &shard->nodes[i];
+        if (node->removed || strcmp(node->name, name) != 0) continue;
+
+        node->removed = 1;
+        picoredis_free(node->ctx);
+        node->ctx = NULL;
+        return picoredis_shard_build_ring(shard);
+    }
+    return -1;
+}
+
+static int picoredis_shard_get_node(picoredis_shard_t *shard, const void *key, size_t length)
+{
+    if (shard->point_num == 0) return -1;
+
+    unsigned hash = picoredis_murmur3_32(key, length, 0);
+    size_t low    = 0;
+    size_t high   = shard->point_num;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (shard->points[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return shard->points[low == shard->point_num ? 0 : low].node;
+}
+
+static picoredis_t *picoredis_shard_node_ctx(picoredis_shard_t *shard, size_t node)
+{
+    picoredis_shard_node_t *entry = &shard->nodes[node];
+    if (!entry->ctx) {
+        entry->ctx = picoredis_connect(entry->host, entry->port);
+    }
+    if (entry->ctx->sock < 0) {
+        // retried on the next use
+        picoredis_free(entry->ctx);
+        entry->ctx   = NULL;
+        shard->error = "cannot connect to shard node";
+        return NULL;
+    }
+    return entry->ctx;
+}
+
+static picoredis_t *picoredis_shard_get_ctx(picoredis_shard_t *shard, const char *key)
+{
+    int node = picoredis_shard_get_node(shard, key, strlen(key));
+    if (node < 0) {
+        shard->error = "no shard node";
+        return NULL;
+    }
+    return picoredis_shard_node_ctx(shard, node);
+}
+
+static void picoredis_shard_exec_set(picoredis_shard_t *shard, const char *key, const char *value)
+{
+    picoredis_t *ctx = picoredis_shard_get_ctx(shard, key);
+    if (!ctx) return;
+
+    picoredis_exec_set(ctx, key, value);
+}
+
+static char *picoredis_shard_exec_get(picoredis_shard_t *shard, const char *key)
+{
+    picoredis_t *ctx = picoredis_shard_get_ctx(shard, key);
+    if (!ctx) return NULL;
+
+    return picoredis_exec_get(ctx, key);
+}
+
+// sends one command per node holding any of the keys (step values per key).
+// all nodes are flushed before any reply is read, so a batch costs one round
+// trip to the slowest node. on return order lists the key indexes grouped by
+// node, node_start[node]..node_start[node + 1] is the range of each node and
+// replies[node] is its reply (type ERROR with no value when the node failed).
+static int picoredis_shard_fanout(picoredis_shard_t *shard, picoredis_command_type type, size_t nargs, const char **values, size_t step, size_t *order, size_t *node_start, picoredis_reply_view_t *replies)
+{
+    size_t key_num  = nargs / step;
+    size_t node_num = shard->node_num;
+    size_t i = 0;
+    memset(node_start, 0, sizeof(size_t) * (node_num + 1));
+    for (; i < node_num; ++i) {
+        memset(&replies[i], 0, sizeof(picoredis_reply_view_t));
+        replies[i].type = PICOREDIS_REPLY_ERROR;
+    }
+    shard->error = NULL;
+    if (shard->point_num == 0) {
+        shard->error = "no shard node";
+        return -1;
+    }
+    int *key_nodes = (int *)malloc(sizeof(int) * (key_num + 1));
+    for (i = 0; i < key_num; ++i) {
+        key_nodes[i] = picoredis_shard_get_node(shard, values[i * step], strlen(values[i * step]));
+        node_start[key_nodes[i] + 1]++;
+    }
+    // counting sort keeps the original key order inside every node
+    for (i = 0; i < node_num; ++i) {
+        node_start[i + 1] += node_start[i];
+    }
+    size_t fill[node_num + 1];
+    memcpy(fill, node_start, sizeof(size_t) * (node_num + 1));
+    for (i = 0; i < key_num; ++i) {
+        order[fill[key_nodes[i]]++] = i;
+    }
+    free(key_nodes);
+
+    const char **argv = (const char **)malloc(sizeof(const char *) * (nargs + 1));
+    picoredis_t *ctxs[node_num + 1];
+    for (i = 0; i < node_num; ++i) {
+        ctxs[i] = NULL;
+        size_t count = node_start[i + 1] - node_start[i];
+        if (count == 0) continue;
+
+        size_t j = 0;
+        for (; j < count; ++j) {
+            memcpy(&argv[j * step], &values[order[node_start[i] + j] * step], sizeof(const char *) * step);
+        }
+        ctxs[i] = picoredis_shard_node_ctx(shard, i);
+        if (ctxs[i] && picoredis_append_command_argv(ctxs[i], type, count * step, argv, NULL) < 0) {
+            ctxs[i] = NULL;
+        }
+    }
+    free(argv);
+    for (i = 0; i < node_num; ++i) {
+        if (ctxs[i] && picoredis_flush(ctxs[i]) < 0) {
+            ctxs[i] = NULL;
+        }
+    }
+    int ret = 0;
+    for (i = 0; i < node_num; ++i) {
+        if (node_start[i + 1] == node_start[i]) continue;
+        if (!ctxs[i] || picoredis_get_reply_view(ctxs[i], &replies[i]) < 0) {
+            memset(&replies[i], 0, sizeof(picoredis_reply_view_t));
+            replies[i].type = PICOREDIS_REPLY_ERROR;
+            // drop the connection so that unread replies cannot leak into the next command
+            picoredis_free(shard->nodes[i].ctx);
+            shard->nodes[i].ctx = NULL;
+            shard->error = "shard node failed";
+            ret = -1;
+        } else if (replies[i].type == PICOREDIS_REPLY_ERROR) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int picoredis_shard_exec_del(picoredis_shard_t *shard, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+
+    size_t order[nargs + 1];
+    size_t node_start[shard->node_num + 1];
+    picoredis_reply_view_t replies[shard->node_num + 1];
+    picoredis_shard_fanout(shard, PICOREDIS_DEL, nargs, values, 1, order, node_start, replies);
+    int sum = 0;
+    for (i = 0; i < shard->node_num; ++i) {
+        if (replies[i].type == PICOREDIS_REPLY_NUM) {
+            sum += replies[i].integer;
+        }
+    }
+    return sum;
+}
+
+// nargs counts keys and values, like picoredis_exec_mset
+static int picoredis_shard_exec_mset(picoredis_shard_t *shard, size_t nargs, ...)
+{
+    const char *values[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        values[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+
+    size_t order[nargs / 2 + 1];
+    size_t node_start[shard->node_num + 1];
+    picoredis_reply_view_t replies[shard->node_num + 1];
+    return picoredis_shard_fanout(shard, PICOREDIS_MSET, nargs, values, 2, order, node_start, replies) < 0 ? 0 : 1;
+}
+
+// values come back in the order of keys, missing keys and failed nodes give NULL
+static picoredis_array_t *picoredis_shard_exec_mget_argv(picoredis_shard_t *shard, size_t nargs, const char **keys)
+{
+    size_t *order      = (size_t *)malloc(sizeof(size_t) * (nargs + 1));
+    size_t *node_start = (size_t *)malloc(sizeof(size_t) * (shard->node_num + 1));
+    picoredis_reply_view_t *replies = (picoredis_reply_view_t *)malloc(sizeof(picoredis_reply_view_t) * (shard->node_num + 1));
+    picoredis_shard_fanout(shard, PICOREDIS_MGET, nargs, keys, 1, order, node_start, replies);
+
+    // the replies borrow one receive buffer per node, so they are all valid here.
+    // keys that no node answered for (no node at all, failed fanout) stay NULL.
+    picoredis_view_t *elements[nargs + 1];
+    memset(elements, 0, sizeof(picoredis_view_t *) * (nargs + 1));
+    size_t data_size = 0;
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        size_t count = node_start[i + 1] - node_start[i];
+        int valid    = replies[i].type == PICOREDIS_REPLY_MULTI_BULK && replies[i].num == count;
+        size_t j = 0;
+        for (; j < count; ++j) {
+            picoredis_view_t *element = valid ? &replies[i].elements[j] : NULL;
+            elements[order[node_start[i] + j]] = element;
+            if (element) {
+                data_size += element->length + 1;
+            }
+        }
+    }
+    picoredis_array_t *array = picoredis_array_create(nargs, data_size);
+    if (array) {
+        char *data = (char *)(array->lengths + nargs);
+        for (i = 0; i < nargs; ++i) {
+            picoredis_view_t *element = elements[i];
+            array->values[i]  = NULL;
+            array->lengths[i] = 0;
+            if (!element || !element->ptr) continue;
+
+            memcpy(data, element->ptr, element->length);
+            data[element->length] = '\0';
+            array->values[i]  = data;
+            array->lengths[i] = element->length;
+            data += element->length + 1;
+        }
+    }
+    free(order);
+    free(node_start);
+    free(replies);
+    return array;
+}
+
+static picoredis_array_t *picoredis_shard_exec_mget(picoredis_shard_t *shard, size_t nargs, ...)
+{
+    const char *keys[nargs + 1];
+    va_list list;
+    va_start(list, nargs);
+    size_t i = 0;
+    for (; i < nargs; ++i) {
+        keys[i] = va_arg(list, const char *);
+    }
+    va_end(list);
+    return picoredis_shard_exec_mget_argv(shard, nargs, keys);
+}
+
+// scans the keyspace of every live node, see picoredis_scan_parallel
+static int picoredis_shard_scan(picoredis_shard_t *shard, const char *match, size_t count, picoredis_scan_callback_t callback, void *privdata)
+{
+    shard->error = NULL;
+    picoredis_t *ctxs[shard->node_num + 1];
+    size_t ctx_num = 0;
+    size_t i = 0;
+    for (; i < shard->node_num; ++i) {
+        if (shard->nodes[i].removed) continue;
+        picoredis_t *ctx = picoredis_shard_node_ctx(shard, i);
+        if (!ctx) return -1;
+        ctxs[ctx_num++] = ctx;
+    }
+    if (picoredis_scan_parallel(ctxs, ctx_num, match, count, callback, privdata) < 0) {
+        shard->error = "cannot scan shard node";
+        return -1;
+    }
+    return 0;
+}
+
+// SCAN family
+
+// type is PICOREDIS_SCAN, PICOREDIS_SSCAN, PICOREDIS_HSCAN or PICOREDIS_ZSCAN.
+// key, match and the context must outlive the scan.
+static void picoredis_scan_init(picoredis_scan_t *scan, picoredis_t *ctx, picoredis_command_type type, const char *key, const char *match, size_t count)
+{
+    memset(scan, 0, sizeof(picoredis_scan_t));
+    scan->ctx   = ctx;
+    scan->type  = type;
+    scan->key   = key;
+    scan->match = match;
+    scan->count = count;
+    strcpy(scan->cursor, "0");
+}
+
+static int picoredis_scan_request(picoredis_scan_t *scan)
+{
+    char count_value[32] = {0};
+    const char *values[6];
+    size_t nargs = 0;
+    if (scan->type != PICOREDIS_SCAN) {
+        values[nargs++] = scan->key;
+    }
+    values[nargs++] = scan->cursor;
+    if (scan->match) {
+        values[nargs++] = "MATCH";
+        values[nargs++] = scan->match;
+    }
+    if (scan->count > 0) {
+        picoredis_format_uint(count_value, scan->count);
+        values[nargs++] = "COUNT";
+        values[nargs++] = count_value;
+    }
+    if (picoredis_append_command_argv(scan->ctx, scan->type, nargs, values, NULL) < 0) return -1;
+    if (picoredis_flush(scan->ctx) < 0) return -1;
+
+    scan->requested = 1;
+    return 0;
+}
+
+// reads the cursor and the array header of the requested batch and sends the
+// request for the batch after it
+static int picoredis_scan_open(picoredis_scan_t *scan)
+{
+    picoredis_t *ctx = scan->ctx;
+    scan->requested = 0;
+    if (picoredis_iterator_begin(ctx, &scan->iter) <= 0) {
+        if (!ctx->error) {
+            ctx->error = "unexpected reply type";
+        }
+        return -1;
+    }
+    picoredis_reply_view_t cursor;
+    if (picoredis_iterator_next(&scan->iter, &cursor) <= 0 || cursor.type != PICOREDIS_REPLY_BULK ||
+        cursor.is_nil || cursor.value.length == 0 || cursor.value.length >= sizeof(scan->cursor)) {
+        if (!ctx->error) {
+            ctx->error = "protocol error";
+        }
+        return -1;
+    }
+    memcpy(scan->cursor, cursor.value.ptr, cursor.value.length);
+    scan->cursor[cursor.value.length] = '\0';
+    if (strcmp(scan->cursor, "0") != 0 && picoredis_scan_request(scan) < 0) return -1;
+
+    picoredis_reply_view_t elements;
+    if (picoredis_iterator_next(&scan->iter, &elements) <= 0 || elements.type != PICOREDIS_REPLY_MULTI_BULK) {
+        if (!ctx->error) {
+            ctx->error = "protocol error";
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static int picoredis_scan_start(picoredis_scan_t *scan)
+{
+    scan->started = 1;
+    scan->ctx->error = NULL;
+    if (scan->ctx->pending_replies > 0) {
+        scan->ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    return picoredis_scan_request(scan);
+}
+
+// returns 1 with the next element, 0 when the whole collection was visited and -1 on error.
+// HSCAN and ZSCAN return field and value (member and score) as two elements.
+static int picoredis_scan_next(picoredis_scan_t *scan, picoredis_reply_view_t *element)
+{
+    if (!scan->started && picoredis_scan_start(scan) < 0) return -1;
+    for (;;) {
+        if (scan->iter.depth > 0) return picoredis_iterator_next(&scan->iter, element);
+        if (!scan->requested) return 0;
+        if (picoredis_scan_open(scan) < 0) return -1;
+    }
+}
+
+// passes the elements of the next batch to callback.
+// returns 1 while batches remain, 0 when the scan is complete and -1 on error or stop.
+static int picoredis_scan_batch(picoredis_scan_t *scan, picoredis_scan_callback_t callback, void *privdata)
+{
+    if (!scan->started && picoredis_scan_start(scan) < 0) return -1;
+    if (!scan->requested) return 0;
+    if (picoredis_scan_open(scan) < 0) return -1;
+
+    picoredis_reply_view_t element;
+    while (scan->iter.depth > 0) {
+        if (picoredis_iterator_next(&scan->iter, &element) < 0) return -1;
+        if (callback(scan->ctx, &element.value, privdata) != 0) {
+            picoredis_scan_close(scan);
+            scan->ctx->error = "scan stopped by callback";
+            return -1;
+        }
+    }
+    return scan->requested;
+}
+
+// reads what is left of the current batch and the reply of a request in flight
+static void picoredis_scan_close(picoredis_scan_t *scan)
+{
+    picoredis_iterator_close(&scan->iter);
+    if (scan->requested) {
+        picoredis_reply_view_t view;
+        picoredis_get_reply_view(scan->ctx, &view);
+        scan->requested = 0;
+    }
+}
+
+// runs one SCAN cursor per connection, e.g. one per shard. every connection
+// keeps its next request in flight while the batches of the others are
+// handed to callback, so the servers are scanned side by side.
+static int picoredis_scan_parallel(picoredis_t **ctxs, size_t ctx_num, const char *match, size_t count, picoredis_scan_callback_t callback, void *privdata)
+{
+    picoredis_scan_t *scans = (picoredis_scan_t *)malloc(sizeof(picoredis_scan_t) * (ctx_num + 1));
+    size_t i = 0;
+    for (; i < ctx_num; ++i) {
+        picoredis_scan_init(&scans[i], ctxs[i], PICOREDIS_SCAN, NULL, match, count);
+    }
+    int ret = 0;
+    for (i = 0; i < ctx_num && ret == 0; ++i) {
+        ret = picoredis_scan_start(&scans[i]);
+    }
+    size_t active = ctx_num;
+    while (ret == 0 && active > 0) {
+        active = 0;
+        for (i = 0; i < ctx_num && ret == 0; ++i) {
+            if (!scans[i].requested) continue;
+            int batch = picoredis_scan_batch(&scans[i], callback, privdata);
+            if (batch < 0) {
+                ret = -1;
+            }
+            active += (batch > 0);
+        }
+    }
+    for (i = 0; i < ctx_num; ++i) {
+        picoredis_scan_close(&scans[i]);
+    }
+    free(scans);
+    return ret;
+}
+
+// Pub/Sub
+
+static long long picoredis_exec_publish(picoredis_t *ctx, const char *channel, const char *message)
+{
+    picoredis_reply_view_t *reply = picoredis_send_and_reply2(ctx, PICOREDIS_PUBLISH, channel, message);
+    return reply ? reply->integer : 0;
+}
+
+// publishes every message in one flush and returns the sum of the receivers
+static long long picoredis_exec_publish_batch(picoredis_t *ctx, size_t num, const picoredis_view_t *channels, const picoredis_view_t *messages)
+{
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return 0;
+    }
+    size_t i = 0;
+    for (; i < num; ++i) {
+        const char *values[] = { channels[i].ptr, messages[i].ptr };
+        size_t lengths[]     = { channels[i].length, messages[i].length };
+        if (picoredis_append_command_argv(ctx, PICOREDIS_PUBLISH, 2, values, lengths) < 0) break;
+    }
+    if (i < num) {
+        // nothing was written yet
+        ctx->send_length     = 0;
+        ctx->pending_replies = 0;
+        return 0;
+    }
+    long long receivers = 0;
+    for (i = 0; i < num; ++i) {
+        picoredis_reply_view_t view;
+        if (picoredis_get_reply_view(ctx, &view) < 0) break;
+        receivers += view.integer;
+    }
+    return receivers;
+}
+
+static picoredis_subscriber_t *picoredis_subscriber_connect(const char *host, int port)
+{
+    picoredis_t *ctx = picoredis_connect(host, port);
+    if (ctx->sock < 0) {
+        picoredis_free(ctx);
+        return NULL;
+    }
+    picoredis_subscriber_t *sub = (picoredis_subscriber_t *)malloc(sizeof(picoredis_subscriber_t));
+    memset(sub, 0, sizeof(picoredis_subscriber_t));
+    sub->ctx = ctx;
+    return sub;
+}
+
+static void picoredis_subscriber_free(picoredis_subscriber_t *sub)
+{
+    if (!sub) return;
+
+    size_t i = 0;
+    for (; i < sub->num; ++i) {
+        free(sub->subscriptions[i].name);
+    }
+    free(sub->subscriptions);
+    free(sub->table);
+    picoredis_free(sub->ctx);
+    free(sub);
+}
+
+// returns the index of the subscription or sub->num when there is none
+static size_t picoredis_subscriber_find(picoredis_subscriber_t *sub, const char *name, size_t length, int is_pattern)
+{
+    if (sub->table_size == 0) return sub->num;
+
+    size_t mask = sub->table_size - 1;
+    size_t pos  = picoredis_murmur3_32(name, length, is_pattern) & mask;
+    for (; sub->table[pos] != 0; pos = (pos + 1) & mask) {
+        picoredis_subscription_t *entry = &sub->subscriptions[sub->table[pos] - 1];
+        if (entry->length == length && entry->is_pattern == is_pattern && memcmp(entry->name, name, length) == 0) {
+            return sub->table[pos] - 1;
+        }
+    }
+    return sub->num;
+}
+
+static int picoredis_subscriber_rebuild(picoredis_subscriber_t *sub, size_t table_size)
+{
+    size_t *table = (size_t *)calloc(table_size, sizeof(size_t));
+    if (!table) return -1;
+
+    size_t i = 0;
+    for (; i < sub->num; ++i) {
+        picoredis_subscription_t *entry = &sub->subscriptions[i];
+        size_t pos = picoredis_murmur3_32(entry->name, entry->length, entry->is_pattern) & (table_size - 1);
+        for (; table[pos] != 0; pos = (pos + 1) & (table_size - 1)) {}
+        table[pos] = i + 1;
+    }
+    free(sub->table);
+    sub->table      = table;
+    sub->table_size = table_size;
+    return 0;
+}
+
+// the subscription is used as soon as it is sent, the confirmation from the
+// server is read by the dispatch loop like any other message
+static int picoredis_subscriber_add(picoredis_subscriber_t *sub, picoredis_command_type type, const char *name, picoredis_message_callback_t callback, void *privdata)
+{
+    picoredis_t *ctx = sub->ctx;
+    ctx->error = NULL;
+    int is_pattern = (type == PICOREDIS_PSUBSCRIBE);
+    size_t length  = strlen(name);
+    size_t index   = picoredis_subscriber_find(sub, name, length, is_pattern);
+    if (index < sub->num) {
+        sub->subscriptions[index].callback = callback;
+        sub->subscriptions[index].privdata = privdata;
+        return 0;
+    }
+    if (sub->num == sub->capacity) {
+        size_t new_capacity = sub->capacity ? sub->capacity * 2 : 8;
+        picoredis_subscription_t *new_subscriptions = (picoredis_subscription_t *)realloc(sub->subscriptions, sizeof(picoredis_subscription_t) * new_capacity);
+        if (!new_subscriptions) {
+            ctx->error = "cannot allocate subscription";
+            return -1;
+        }
+        sub->subscriptions = new_subscriptions;
+        sub->capacity      = new_capacity;
+    }
+    if ((sub->num + 1) * 2 > sub->table_size && picoredis_subscriber_rebuild(sub, sub->table_size ? sub->table_size * 2 : 16) < 0) {
+        ctx->error = "cannot allocate subscription";
+        return -1;
+    }
+    picoredis_subscription_t *entry = &sub->subscriptions[sub->num];
+    entry->name       = picoredis_reply_copy_string(name, length);
+    entry->length     = length;
+    entry->is_pattern = is_pattern;
+    entry->callback   = callback;
+    entry->privdata   = privdata;
+    size_t pos = picoredis_murmur3_32(name, length, is_pattern) & (sub->table_size - 1);
+    for (; sub->table[pos] != 0; pos = (pos + 1) & (sub->table_size - 1)) {}
+    sub->table[pos] = ++sub->num;
+
+    const char *values[] = { name };
+    size_t lengths[]     = { length };
+    if (picoredis_command_encode(ctx, type, 1, values, lengths) < 0) return -1;
+    return picoredis_flush(ctx);
+}
+
+static int picoredis_subscriber_remove(picoredis_subscriber_t *sub, picoredis_command_type type, const char *name)
+{
+    picoredis_t *ctx = sub->ctx;
+    ctx->error = NULL;
+    size_t length = strlen(name);
+    size_t index  = picoredis_subscriber_find(sub, name, length, type == PICOREDIS_PUNSUBSCRIBE);
+    if (index < sub->num) {
+        free(sub->subscriptions[index].name);
+        sub->subscriptions[index] = sub->subscriptions[--sub->num];
+        if (picoredis_subscriber_rebuild(sub, sub->table_size) < 0) {
+            ctx->error = "cannot allocate subscription";
+            return -1;
+        }
+    }
+    const char *values[] = { name };
+    size_t lengths[]     = { length };
+    if (picoredis_command_encode(ctx, type, 1, values, lengths) < 0) return -1;
+    return picoredis_flush(ctx);
+}
+
+static int picoredis_subscriber_subscribe(picoredis_subscriber_t *sub, const char *channel, picoredis_message_callback_t callback, void *privdata)
+{
+    return picoredis_subscriber_add(sub, PICOREDIS_SUBSCRIBE, channel, callback, privdata);
+}
+
+static int picoredis_subscriber_psubscribe(picoredis_subscriber_t *sub, const char *pattern, picoredis_message_callback_t callback, void *privdata)
+{
+    return picoredis_subscriber_add(sub, PICOREDIS_PSUBSCRIBE, pattern, callback, privdata);
+}
+
+static int picoredis_subscriber_unsubscribe(picoredis_subscriber_t *sub, const char *channel)
+{
+    return picoredis_subscriber_remove(sub, PICOREDIS_UNSUBSCRIBE, channel);
+}
+
+static int picoredis_subscriber_punsubscribe(picoredis_subscriber_t *sub, const char *pattern)
+{
+    return picoredis_subscriber_remove(sub, PICOREDIS_PUNSUBSCRIBE, pattern);
+}
+
+// dispatches the push message in reader->tokens. returns 1 for a delivered message.
+static int picoredis_subscriber_handle(picoredis_subscriber_t *sub)
+{
+    picoredis_t *ctx           = sub->ctx;
+    picoredis_reader_t *reader = &ctx->reader;
+    const char *base           = ctx->receive_buf + ctx->receive_begin;
+    picoredis_token_t *tokens  = reader->tokens;
+    if (tokens[0].type != PICOREDIS_REPLY_MULTI_BULK || tokens[0].length < 3 || reader->token_num < 4) return 0;
+
+    picoredis_view_t kind = { base + tokens[1].offset, (size_t)tokens[1].length };
+    if (kind.length == 7 && memcmp(kind.ptr, "message", 7) == 0) {
+        picoredis_view_t channel = { base + tokens[2].offset, (size_t)tokens[2].length };
+        picoredis_view_t message = { base + tokens[3].offset, (size_t)tokens[3].length };
+        size_t index = picoredis_subscriber_find(sub, channel.ptr, channel.length, 0);
+        if (index == sub->num) return 0;
+
+        picoredis_subscription_t *entry = &sub->subscriptions[index];
+        entry->callback(&channel, &message, NULL, entry->privdata);
+        return 1;
+    }
+    if (kind.length == 8 && memcmp(kind.ptr, "pmessage", 8) == 0 && reader->token_num >= 5) {
+        picoredis_view_t pattern = { base + tokens[2].offset, (size_t)tokens[2].length };
+        picoredis_view_t channel = { base + tokens[3].offset, (size_t)tokens[3].length };
+        picoredis_view_t message = { base + tokens[4].offset, (size_t)tokens[4].length };
+        size_t index = picoredis_subscriber_find(sub, pattern.ptr, pattern.length, 1);
+        if (index == sub->num) return 0;
+
+        picoredis_subscription_t *entry = &sub->subscriptions[index];
+        entry->callback(&channel, &message, &pattern, entry->privdata);
+        return 1;
+    }
+    // subscribe / unsubscribe confirmations carry the number of subscriptions left
+    if (tokens[3].type == PICOREDIS_REPLY_NUM) {
+        sub->server_count = tokens[3].integer;
+    }
+    return 0;
+}
+
+// waits up to timeout_ms (-1 for ever) for data, then dispatches every message
+// of the read. returns the number of delivered messages and -1 on error.
+static int picoredis_subscriber_dispatch(picoredis_subscriber_t *sub, int timeout_ms)
+{
+    picoredis_t *ctx = sub->ctx;
+    ctx->error = NULL;
+    if (ctx->sock < 0) {
+        // poll() ignores a negative fd and would just time out
+        ctx->error = "not connected";
+        return -1;
+    }
+    struct pollfd pfd = { ctx->sock, POLLIN, 0 };
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+        ctx->error = strerror(errno);
+        return -1;
+    }
+    if (ready <= 0) return 0;
+    if (picoredis_receive_more(ctx) < 0) return -1;
+
+    int delivered = 0;
+    for (;;) {
+        int parse_result = picoredis_reader_parse(ctx);
+        if (parse_result == 0) break;
+        if (parse_result < 0) {
+            picoredis_disconnect(ctx, "protocol error");
+            return -1;
+        }
+        delivered += picoredis_subscriber_handle(sub);
+        picoredis_reader_consume(ctx);
+    }
+    return delivered;
+}
+
+// dispatches until the server confirms that no subscription is left
+static int picoredis_subscriber_run(picoredis_subscriber_t *sub)
+{
+    do {
+        if (picoredis_subscriber_dispatch(sub, -1) < 0) return -1;
+    } while (sub->server_count > 0);
+    return 0;
+}
+
+// Work queues
+
+static picoredis_queue_t *picoredis_queue_connect(const char *host, int port, size_t list_num, const char **lists, size_t batch_size, int timeout)
+{
+    if (list_num == 0) return NULL;
+
+    picoredis_t *ctx = picoredis_connect(host, port);
+    if (ctx->sock < 0) {
+        picoredis_free(ctx);
+        return NULL;
+    }
+    picoredis_queue_t *queue = (picoredis_queue_t *)malloc(sizeof(picoredis_queue_t));
+    memset(queue, 0, sizeof(picoredis_queue_t));
+    queue->ctx        = ctx;
+    queue->lists      = (char **)malloc(sizeof(char *) * list_num);
+    queue->list_num   = list_num;
+    queue->batch_size = batch_size ? batch_size : 1;
+    queue->timeout    = timeout;
+    size_t i = 0;
+    for (; i < list_num; ++i) {
+        queue->lists[i] = picoredis_reply_copy_string(lists[i], strlen(lists[i]));
+    }
+    return queue;
+}
+
+// makes the queue reliable: every item is moved to the processing list by
+// RPOPLPUSH and removed from it only when the callback acknowledges it.
+// RPOPLPUSH takes a single source, so a reliable queue consumes one list.
+static int picoredis_queue_set_processing(picoredis_queue_t *queue, const char *processing)
+{
+    queue->ctx->error = NULL;
+    if (queue->list_num != 1) {
+        queue->ctx->error = "reliable queue requires a single list";
+        return -1;
+    }
+    free(queue->processing);
+    queue->processing = processing ? picoredis_reply_copy_string(processing, strlen(processing)) : NULL;
+    return 0;
+}
+
+static void picoredis_queue_free(picoredis_queue_t *queue)
+{
+    if (!queue) return;
+
+    size_t i = 0;
+    for (; i < queue->list_num; ++i) {
+        free(queue->lists[i]);
+    }
+    free(queue->lists);
+    free(queue->processing);
+    picoredis_free(queue->ctx);
+    free(queue);
+}
+
+// passes one item to the callback. the acknowledgement is appended while the
+// item view is still valid and its reply is read after the batch.
+static int picoredis_queue_handle(picoredis_queue_t *queue, const picoredis_view_t *list, const picoredis_view_t *item, picoredis_queue_callback_t callback, void *privdata)
+{
+    if (callback(list, item, privdata) != 0 || !queue->processing) return 0;
+
+    const char *values[] = { queue->processing, "-1", item->ptr };
+    size_t lengths[]     = { strlen(queue->processing), 2, item->length };
+    return picoredis_append_command_argv(queue->ctx, PICOREDIS_LREM, 3, values, lengths);
+}
+
+// blocks up to queue->timeout for an item, then drains up to batch_size - 1
+// more from the same list in one pipelined round trip.
+// returns the number of items handled, 0 on timeout and -1 on error.
+static int picoredis_queue_poll(picoredis_queue_t *queue, picoredis_queue_callback_t callback, void *privdata)
+{
+    picoredis_t *ctx = queue->ctx;
+    ctx->error = NULL;
+    if (ctx->pending_replies > 0) {
+        ctx->error = "cannot execute command while pipelined replies are pending";
+        return -1;
+    }
+    char timeout_value[64] = {0};
+    picoredis_format_int(timeout_value, queue->timeout);
+
+    picoredis_reply_view_t view;
+    size_t list_index = 0;
+    picoredis_view_t item = { NULL, 0 };
+    if (queue->processing) {
+        const char *values[] = { queue->lists[0], queue->processing, timeout_value };
+        if (picoredis_exec_argv_view(ctx, PICOREDIS_BRPOPLPUSH, 3, values, NULL, &view) < 0) return -1;
+        item = view.value;
+    } else {
+        const char *values[queue->list_num + 1];
+        memcpy(values, queue->lists, sizeof(char *) * queue->list_num);
+        values[queue->list_num] = timeout_value;
+        if (picoredis_exec_argv_view(ctx, PICOREDIS_BRPOP, queue->list_num + 1, values, NULL, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_MULTI_BULK && view.num == 2) {
+            // the key in the reply is only valid until the next read, keep ours
+            for (; list_index < queue->list_num; ++list_index) {
+                if (strlen(queue->lists[list_index]) == view.elements[0].length &&
+                    memcmp(queue->lists[list_index], view.elements[0].ptr, view.elements[0].length) == 0) break;
+            }
+            item = view.elements[1];
+        }
+    }
+    if (view.type == PICOREDIS_REPLY_ERROR) {
+        ctx->error = "cannot pop from queue";
+        return -1;
+    }
+    if (view.is_nil) return 0;
+    if (list_index == queue->list_num || (!queue->processing && view.type != PICOREDIS_REPLY_MULTI_BULK) ||
+        (queue->processing && view.type != PICOREDIS_REPLY_BULK)) {
+        ctx->error = "protocol error";
+        return -1;
+    }
+
+    const char *source = queue->lists[list_index];
+    picoredis_view_t list = { source, strlen(source) };
+    if (picoredis_queue_handle(queue, &list, &item, callback, privdata) < 0) return -1;
+    int handled = 1;
+    size_t first_ack = ctx->pending_replies;
+
+    size_t drain_num = queue->batch_size - 1;
+    size_t i = 0;
+    for (; i < drain_num; ++i) {
+        const char *values[] = { source, queue->processing };
+        if (queue->processing) {
+            if (picoredis_append_command_argv(ctx, PICOREDIS_RPOPLPUSH, 2, values, NULL) < 0) return -1;
+        } else {
+            if (picoredis_append_command_argv(ctx, PICOREDIS_RPOP, 1, values, NULL) < 0) return -1;
+        }
+    }
+    if (first_ack > 0 && picoredis_get_reply_view(ctx, &view) < 0) return -1;
+
+    // the replies to pops come first, the acknowledgements appended meanwhile follow
+    const char *error = NULL;
+    for (i = 0; i < drain_num; ++i) {
+        if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            error = "cannot pop from queue";
+            continue;
+        }
+        if (view.is_nil) continue;
+        if (picoredis_queue_handle(queue, &list, &view.value, callback, privdata) < 0) return -1;
+        handled++;
+    }
+    while (ctx->pending_replies > 0) {
+        if (picoredis_get_reply_view(ctx, &view) < 0) return -1;
+    }
+    if (error) {
+        ctx->error = error;
+        return -1;
+    }
+    return handled;
+}
+
+// moves the items a crashed consumer left in the processing list back to the
+// list, so that they are handed out again. returns the number of items moved.
+static long long picoredis_queue_requeue(picoredis_queue_t *queue)
+{
+    picoredis_t *ctx = queue->ctx;
+    if (!queue->processing) return 0;
+
+    long long moved = 0;
+    for (;;) {
+        const char *values[] = { queue->processing, queue->lists[0] };
+        picoredis_reply_view_t view;
+        if (picoredis_exec_argv_view(ctx, PICOREDIS_RPOPLPUSH, 2, values, NULL, &view) < 0) return -1;
+        if (view.type == PICOREDIS_REPLY_ERROR) {
+            ctx->error = "cannot requeue";
+            return -1;
+        }
+        if (view.is_nil) break;
+        moved++;
+    }
+    return moved;
+}
+
+// Lua scripting
+
+static void picoredis_sha1(const void *data, size_t length, unsigned char digest[20])
+{
+    unsigned h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long bit_length = (unsigned long long)length * 8;
+    size_t padded = ((length + 8) / 64 + 1) * 64;
+    size_t offset = 0;
+    for (; offset < padded; offset += 64) {
+        unsigned char block[64];
+        size_t i = 0;
+        for (; i < 64; ++i) {
+            size_t pos = offset + i;
+            if (pos < length) {
+                block[i] = bytes[pos];
+            } else if (pos == length) {
+                block[i] = 0x80;
+            } else if (pos >= padded - 8) {
+                block[i] = (unsigned char)(bit_length >> ((padded - 1 - pos) * 8));
+            } else {
+                block[i] = 0;
+            }
+        }
+        unsigned w[80];
+        for (i = 0; i < 16; ++i) {
+            w[i] = (unsigned)block[i * 4] << 24 | (unsigned)block[i * 4 + 1] << 16 | (unsigned)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        }
+        for (; i < 80; ++i) {
+            unsigned x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+        unsigned a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (i = 0; i < 80; ++i) {
+            unsigned f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            unsigned temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    size_t i = 0;
+    for (; i < 20; ++i) {
+        digest[i] = (unsigned char)(h[i / 4] >> ((3 - i % 4) * 8));
+    }
+}
+
+// body must outlive the script
+static void picoredis_script_init(picoredis_script_t *script, const char *body)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned char digest[20];
+    script->body   = body;
+    script->length = strlen(body);
+    picoredis_sha1(body, script->length, digest);
+    size_t i = 0;
+    for (; i < 20; ++i) {
+        script->sha1[i * 2]     = hex[digest[i] >> 4];
+        script->sha1[i * 2 + 1] = hex[digest[i] & 15];
+    }
+    script->sha1[40] = '\0';
+}
+
+static int picoredis_script_is_loaded(picoredis_t *ctx, const char *sha1)
+{
+    size_t i = 0;
+    for (; i < ctx->script_num; ++i) {
+        if (memcmp(ctx->scripts[i], sha1, 40) == 0) return 1;
+    }
+    return 0;
+}
+
+static void picoredis_script_set_loaded(picoredis_t *ctx, const char *sha1, int loaded)
+{
+    size_t i = 0;
+    for (; i < ctx->script_num; ++i) {
+        if (memcmp(ctx->scripts[i], sha1, 40) == 0) break;
+    }
+    if (!loaded) {
+        if (i < ctx->script_num) {
+            memcpy(ctx->scripts[i], ctx->scripts[--ctx->script_num], 41);
+        }
+        return;
+    }
+    if (i < ctx->script_num) return;
+    if (ctx->script_num == ctx->script_capacity) {
+        size_t new_capacity = ctx->script_capacity ? ctx->script_capacity * 2 : 8;
+        char (*new_scripts)[41] = (char (*)[41])realloc(ctx->scripts, 41 * new_capacity);
+        if (!new_scripts) return; // EVAL is used again next time
+        ctx->scripts         = new_scripts;
+        ctx->script_capacity = new_capacity;
+    }
+    memcpy(ctx->scripts[ctx->script_num++], sha1, 41);
+}
+
+// sends the body with SCRIPT LOAD. returns 1 when loaded and -1 on error.
+static int picoredis_script_load(picoredis_t *ctx, picoredis_script_t *script)
+{
+    const char *values[] = { "LOAD", script->body };
+    size_t lengths[]     = { 4, script->length };
+    picoredis_reply_view_t view;
+    if (picoredis_exec_argv_view(ctx, PICOREDIS_SCRIPT, 2, values, lengths, &view) < 0) return -1;
+    if (view.type != PICOREDIS_REPLY_BULK || view.value.length != 40 || memcmp(view.value.ptr, script->sha1, 40) != 0) {
+        ctx->error = "cannot load script";
+        return -1;
+    }
+    picoredis_script_set_loaded(ctx, script->sha1, 1);
+    return 1;
+}
+
+// runs the script with EVALSHA once it is known to be loaded on the server, so
+// its body is sent only once per connection. a NOSCRIPT error (after SCRIPT FLUSH
+// or a failover) falls back to EVAL, which loads it again.
+// returns the reply owned by the caller, an error raised by the script included.
+static picoredis_reply_tree_t *picoredis_exec_script(picoredis_t *ctx, picoredis_script_t *script, size_t key_num, const char **keys, size_t arg_num, const char **args)
+{
+    char key_num_value[32];
+    size_t nargs = 2 + key_num + arg_num;
+    const char *values[nargs];
+    size_t lengths[nargs];
+    lengths[1] = picoredis_format_uint(key_num_value, key_num);
+    values[1]  = key_num_value;
+    size_t i = 0;
+    for (; i < key_num; ++i) {
+        values[2 + i]  = keys[i];
+        lengths[2 + i] = strlen(keys[i]);
+    }
+    for (i = 0; i < arg_num; ++i) {
+        values[2 + key_num + i]  = args[i];
+        lengths[2 + key_num + i] = strlen(args[i]);
+    }
+    if (picoredis_script_is_loaded(ctx, script->sha1)) {
+        values[0]  = script->sha1;
+        lengths[0] = 40;
+        picoredis_reply_tree_t *reply = picoredis_exec_argv_tree(ctx, PICOREDIS_EVALSHA, nargs, values, lengths);
+        if (!reply) return NULL;
+        if (reply->type != PICOREDIS_REPLY_ERROR || strncmp(reply->value.ptr, "NOSCRIPT", 8) != 0) return reply;
+
+        picoredis_reply_tree_free(reply);
+        picoredis_script_set_loaded(ctx, script->sha1, 0);
+    }
+    values[0]  = script->body;
+    lengths[0] = script->length;
+    picoredis_reply_tree_t *reply = picoredis_exec_argv_tree(ctx, PICOREDIS_EVAL, nargs, values, lengths);
+    if (reply && reply->type != PICOREDIS_REPLY_ERROR) {
+        picoredis_script_set_loaded(ctx, script->sha1, 1);
+    }
+    return reply;
+}
+
+// SCRIPT FLUSH, which also forgets the scripts known to be loaded
+static int picoredis_exec_script_flush(picoredis_t *ctx)
 {
-    picoredis_reply_t *reply = picoredis_send_and_reply0(ctx, PICOREDIS_INFO);
-    return reply ? reply->v.svalue : NULL;
+    const char *values[] = { "FLUSH" };
+    picoredis_reply_view_t view;
+    if (picoredis_exec_argv_view(ctx, PICOREDIS_SCRIPT, 1, values, NULL, &view) < 0) return 0;
+    ctx->script_num = 0;
+    return view.type == PICOREDIS_REPLY_ERROR ? 0 : 1;
 }
 
 static void picoredis_error(picoredis_t *ctx)
@@ -249,6 +249,7 @@ static void test_command_setnx(picoredis_t *ctx)
 static void test_command_setex(picoredis_t *ctx)
 {
     ASSERT_NUMEQ("setex if not exists", picoredis_exec_setex(ctx, key, 10, value), 1);
+    ASSERT_NUMEQ("setex negative expire", picoredis_exec_setex(ctx, key, -1, value), 0);
 }
 
 static void test_command_mset(picoredis_t *ctx)
@@ -419,6 +420,1258 @@ static void test_command_info(picoredis_t *ctx)
     ASSERT_PTRNEQ("info", picoredis_exec_info(ctx), NULL);
 }
 
+static void test_large_reply(picoredis_t *ctx)
+{
+    static const size_t large_size = 256 * 1024;
+    char *large_value = (char *)malloc(large_size + 1);
+    memset(large_value, 'x', large_size);
+    large_value[large_size] = '\0';
+    picoredis_exec_set(ctx, "large_key", large_value);
+    char *reply_value = picoredis_exec_get(ctx, "large_key");
+    ASSERT_NUMEQ("get large value", reply_value && strcmp(reply_value, large_value) == 0, 1);
+    free(reply_value);
+    free(large_value);
+
+    picoredis_exec_del(ctx, 1, "large_list");
+    size_t i = 0;
+    for (; i < 2000; ++i) {
+        picoredis_exec_rpush(ctx, "large_list", "large_list_element");
+    }
+    picoredis_array_t *array = picoredis_exec_lrange(ctx, "large_list", 0, -1);
+    ASSERT_NUMEQ("lrange large list", array ? picoredis_array_num(array) : 0, 2000);
+    ASSERT_STREQ("last element of large list", picoredis_array_get(array, 1999), "large_list_element");
+}
+
+static int parse_buffered(picoredis_t *ctx, const char *input)
+{
+    size_t length = strlen(input);
+    memcpy(ctx->receive_buf, input, length);
+    ctx->receive_begin = 0;
+    ctx->receive_end   = length;
+    return picoredis_receive_reply(ctx);
+}
+
+static void test_reader_protocol_error(picoredis_t *ctx)
+{
+    (void)ctx;
+    picoredis_t *offline = picoredis_alloc();
+    ASSERT_NUMEQ("reader negative integer", parse_buffered(offline, ":-5\r\n"), 0);
+    ASSERT_NUMEQ("reader negative integer value", offline->reader.tokens[0].integer, -5);
+    picoredis_reader_consume(offline);
+    ASSERT_NUMEQ("reader sign without digits", parse_buffered(offline, ":-\r\n"), -1);
+    ASSERT_STREQ("reader protocol error", offline->error, "protocol error");
+    ASSERT_NUMEQ("reader reset after error", offline->receive_end + offline->reader.pos + offline->reader.token_num, 0);
+    ASSERT_NUMEQ("reader integer without digits", parse_buffered(offline, ":\r\n"), -1);
+    ASSERT_NUMEQ("reader length without digits", parse_buffered(offline, "$\r\n"), -1);
+    ASSERT_NUMEQ("reader sign inside number", parse_buffered(offline, ":1-2\r\n"), -1);
+    ASSERT_NUMEQ("reader smallest integer", parse_buffered(offline, ":-9223372036854775808\r\n"), 0);
+    ASSERT_NUMEQ("reader smallest integer value", offline->reader.tokens[0].integer == LLONG_MIN, 1);
+    picoredis_reader_consume(offline);
+    ASSERT_NUMEQ("reader integer overflow", parse_buffered(offline, ":9223372036854775808\r\n"), -1);
+    ASSERT_NUMEQ("reader long integer overflow", parse_buffered(offline, ":99999999999999999999\r\n"), -1);
+    ASSERT_NUMEQ("reader huge bulk length", parse_buffered(offline, "$9223372036854775807\r\n"), -1);
+    ASSERT_NUMEQ("reader bulk over proto-max-bulk-len", parse_buffered(offline, "$536870913\r\n"), -1);
+    ASSERT_NUMEQ("reader huge array length", parse_buffered(offline, "*2147483648\r\n"), -1);
+    picoredis_free(offline);
+}
+
+// status wrappers report 0 instead of touching a NULL reply
+static void test_dropped_connection(picoredis_t *ctx)
+{
+    (void)ctx;
+    picoredis_t *dropped = picoredis_connect("127.0.0.1", 6379);
+    shutdown(dropped->sock, SHUT_RDWR);
+    picoredis_view_t field = { "field", 5 };
+    ASSERT_NUMEQ("dropped rename", picoredis_exec_rename(dropped, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped flushdb", picoredis_exec_flushdb(dropped), 0);
+    ASSERT_NUMEQ("dropped flushall", picoredis_exec_flushall(dropped), 0);
+    ASSERT_NUMEQ("dropped watch", picoredis_exec_watch(dropped, 1, "a"), 0);
+    ASSERT_NUMEQ("dropped unwatch", picoredis_exec_unwatch(dropped), 0);
+    ASSERT_NUMEQ("dropped multi", picoredis_exec_multi(dropped), 0);
+    ASSERT_NUMEQ("dropped exec", picoredis_exec_exec(dropped), 0);
+    ASSERT_NUMEQ("dropped discard", picoredis_exec_discard(dropped), 0);
+    ASSERT_NUMEQ("dropped setex", picoredis_exec_setex(dropped, "a", 10, "b"), 0);
+    ASSERT_NUMEQ("dropped mset", picoredis_exec_mset(dropped, 2, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped msetnx", picoredis_exec_msetnx(dropped, 2, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped ltrim", picoredis_exec_ltrim(dropped, "a", 0, 1), 0);
+    ASSERT_NUMEQ("dropped lset", picoredis_exec_lset(dropped, "a", 0, "b"), 0);
+    ASSERT_NUMEQ("dropped sinterstore", picoredis_exec_sinterstore(dropped, 2, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped sunionstore", picoredis_exec_sunionstore(dropped, 2, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped sdiffstore", picoredis_exec_sdiffstore(dropped, 2, "a", "b"), 0);
+    ASSERT_NUMEQ("dropped hmset", picoredis_exec_hmset(dropped, "a", 1, &field, &field), 0);
+    ASSERT_NUMEQ("dropped save", picoredis_exec_save(dropped), 0);
+    ASSERT_NUMEQ("dropped bgsave", picoredis_exec_bgsave(dropped), 0);
+    ASSERT_NUMEQ("dropped bgrewriteaof", picoredis_exec_bgrewriteaof(dropped), 0);
+    picoredis_free(dropped);
+}
+
+// the iterator reads the reply off the buffer as if it had just been received
+static int iterate_buffered(picoredis_t *ctx, const char *input, size_t *elements)
+{
+    size_t length = strlen(input);
+    memcpy(ctx->receive_buf, input, length);
+    ctx->receive_begin   = 0;
+    ctx->receive_end     = length;
+    ctx->pending_replies = 1;
+    *elements = 0;
+
+    picoredis_iterator_t iter;
+    picoredis_reply_view_t element;
+    int ret = picoredis_iterator_begin(ctx, &iter);
+    if (ret <= 0) return ret;
+    while ((ret = picoredis_iterator_next(&iter, &element)) > 0) {
+        (*elements)++;
+    }
+    return ret;
+}
+
+static void test_iterator_protocol_error(picoredis_t *ctx)
+{
+    (void)ctx;
+    picoredis_t *offline = picoredis_alloc();
+    size_t elements;
+    ASSERT_NUMEQ("iterator buffered reply", iterate_buffered(offline, "*2\r\n$1\r\na\r\n:-3\r\n", &elements), 0);
+    ASSERT_NUMEQ("iterator buffered elements", elements, 2);
+    ASSERT_NUMEQ("iterator buffered reply done", offline->pending_replies, 0);
+    ASSERT_NUMEQ("iterator length without digits", iterate_buffered(offline, "*1\r\n$abc\r\n", &elements), -1);
+    ASSERT_STREQ("iterator protocol error", offline->error, "protocol error");
+    ASSERT_NUMEQ("iterator protocol error drops reply", offline->pending_replies + offline->receive_end, 0);
+    ASSERT_NUMEQ("iterator empty length", iterate_buffered(offline, "*1\r\n$\r\n", &elements), -1);
+    ASSERT_NUMEQ("iterator huge bulk length", iterate_buffered(offline, "*1\r\n$9223372036854775807\r\n", &elements), -1);
+    ASSERT_NUMEQ("iterator integer overflow", iterate_buffered(offline, "*1\r\n:99999999999999999999\r\n", &elements), -1);
+    ASSERT_NUMEQ("iterator huge array length", iterate_buffered(offline, "*2147483648\r\n", &elements), -1);
+    ASSERT_NUMEQ("iterator bad terminator", iterate_buffered(offline, "*1\r\n$1\r\naXY", &elements), -1);
+    picoredis_free(offline);
+}
+
+static void test_pipeline(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 1, "pipeline_counter");
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        picoredis_append_command(ctx, PICOREDIS_INCR, 1, "pipeline_counter");
+    }
+    picoredis_append_command(ctx, PICOREDIS_SET, 2, "pipeline_key", value);
+    picoredis_append_command(ctx, PICOREDIS_GET, 1, "pipeline_key");
+    ASSERT_NUMEQ("pending replies", picoredis_pending_replies(ctx), 102);
+    ASSERT_NUMEQ("flush pipeline", picoredis_flush(ctx), 0);
+
+    size_t is_ok = 1;
+    for (i = 0; i < 100; ++i) {
+        picoredis_reply_t *reply = picoredis_get_reply(ctx);
+        if (!reply || reply->type != PICOREDIS_REPLY_NUM || reply->v.ivalue != (int)i + 1) {
+            is_ok = 0;
+        }
+        picoredis_reply_free(reply);
+    }
+    ASSERT_NUMEQ("pipelined incr replies in order", is_ok, 1);
+    picoredis_reply_t *reply = picoredis_get_reply(ctx);
+    ASSERT_NUMEQ("pipelined set", reply->type, PICOREDIS_REPLY_SINGLE_LINE);
+    picoredis_reply_free(reply);
+    reply = picoredis_get_reply(ctx);
+    ASSERT_STREQ("pipelined get", reply->v.svalue, value);
+    picoredis_reply_free(reply);
+    ASSERT_PTREQ("no more replies", picoredis_get_reply(ctx), NULL);
+
+    // a failed flush must not leave a torn request or phantom replies behind
+    picoredis_t *broken = picoredis_connect("127.0.0.1", 6379);
+    picoredis_append_command(broken, PICOREDIS_INCR, 1, "pipeline_counter");
+    close(broken->sock);
+    ASSERT_NUMEQ("flush on closed socket", picoredis_flush(broken), -1);
+    ASSERT_NUMEQ("flush failure closes", broken->sock, -1);
+    ASSERT_NUMEQ("flush failure resets", broken->pending_replies + broken->send_length, 0);
+    picoredis_free(broken);
+}
+
+static void test_binary_value(picoredis_t *ctx)
+{
+    static const char binary_key[]   = "binary\0key";
+    static const char binary_value[] = "\0\r\n$-1\r\n\0value";
+    size_t key_length   = sizeof(binary_key) - 1;
+    size_t value_length = sizeof(binary_value) - 1;
+    picoredis_exec_set_binary(ctx, binary_key, key_length, binary_value, value_length);
+
+    size_t length = 0;
+    char *reply_value = picoredis_exec_get_binary(ctx, binary_key, key_length, &length);
+    ASSERT_NUMEQ("get binary value length", length, value_length);
+    ASSERT_NUMEQ("get binary value", reply_value && memcmp(reply_value, binary_value, value_length) == 0, 1);
+
+    picoredis_exec_del(ctx, 1, "binary_list");
+    picoredis_exec_rpush_binary(ctx, "binary_list", strlen("binary_list"), binary_value, value_length);
+    picoredis_array_t *array = picoredis_exec_lrange(ctx, "binary_list", 0, -1);
+    ASSERT_NUMEQ("binary list element length", picoredis_array_get_length(array, 0), value_length);
+    ASSERT_NUMEQ("binary list element", memcmp(picoredis_array_get(array, 0), binary_value, value_length), 0);
+}
+
+static void test_reply_view(picoredis_t *ctx)
+{
+    picoredis_exec_set(ctx, key, value);
+    picoredis_view_t view;
+    ASSERT_NUMEQ("get view", picoredis_exec_get_view(ctx, key, strlen(key), &view), 1);
+    ASSERT_NUMEQ("get view length", view.length, strlen(value));
+    ASSERT_NUMEQ("get view value", memcmp(view.ptr, value, view.length), 0);
+    ASSERT_NUMEQ("get view of not exists key", picoredis_exec_get_view(ctx, "not_key", strlen("not_key"), &view), 0);
+
+    char buf[4] = {0};
+    ASSERT_NUMEQ("get into small buffer", picoredis_exec_get_into(ctx, key, strlen(key), buf, sizeof(buf)), strlen(value));
+    ASSERT_NUMEQ("get into copies prefix", memcmp(buf, value, sizeof(buf)), 0);
+    ASSERT_NUMEQ("get into not exists key", picoredis_exec_get_into(ctx, "not_key", strlen("not_key"), buf, sizeof(buf)), -1);
+
+    picoredis_exec_del(ctx, 1, "view_set");
+    picoredis_exec_sadd(ctx, "view_set", "member1");
+    picoredis_exec_sadd(ctx, "view_set", "member2");
+    picoredis_reply_view_t reply_view;
+    ASSERT_NUMEQ("smembers view", picoredis_exec_smembers_view(ctx, "view_set", strlen("view_set"), &reply_view), 0);
+    ASSERT_NUMEQ("smembers view num", reply_view.num, 2);
+    ASSERT_NUMEQ("smembers view element", memcmp(reply_view.elements[0].ptr, "member", strlen("member")), 0);
+}
+
+static void test_reply_arena(picoredis_t *ctx)
+{
+    picoredis_exec_set(ctx, key, value);
+    picoredis_append_command(ctx, PICOREDIS_GET, 1, key);
+    picoredis_append_command(ctx, PICOREDIS_GET, 1, key);
+    picoredis_reply_t *reply1 = picoredis_get_reply(ctx);
+    picoredis_reply_t *reply2 = picoredis_get_reply(ctx);
+    ASSERT_STREQ("arena reply1", reply1->v.svalue, value);
+    ASSERT_STREQ("arena reply2", reply2->v.svalue, value);
+    picoredis_reply_free(reply1);
+    ASSERT_NUMEQ("arena keeps live reply", ctx->arena.live_replies, 1);
+    ASSERT_STREQ("arena reply2 after free", reply2->v.svalue, value);
+    picoredis_reply_free(reply2);
+    ASSERT_NUMEQ("arena rewound", ctx->arena.live_replies, 0);
+
+    picoredis_exec_del(ctx, 1, "arena_list");
+    picoredis_exec_rpush(ctx, "arena_list", "value1");
+    picoredis_exec_rpush(ctx, "arena_list", "value2");
+    picoredis_array_t *array = picoredis_exec_lrange(ctx, "arena_list", 0, -1);
+    ASSERT_NUMEQ("arena lrange num", picoredis_array_num(array), 2);
+    ASSERT_STREQ("arena lrange value", picoredis_array_get(array, 1), "value2");
+    picoredis_array_free(array);
+}
+
+#ifdef __linux__
+static void async_incr_callback(picoredis_t *ctx, picoredis_reply_view_t *reply, void *privdata)
+{
+    (void)ctx;
+    size_t *completed = (size_t *)privdata;
+    if (reply && reply->type == PICOREDIS_REPLY_NUM) {
+        (*completed)++;
+    }
+}
+
+// frees its own connection on the first reply, later callbacks see a NULL reply
+static void async_free_callback(picoredis_t *ctx, picoredis_reply_view_t *reply, void *privdata)
+{
+    size_t *results = (size_t *)privdata;
+    if (reply) {
+        results[0]++;
+        picoredis_free(ctx);
+    } else {
+        results[1]++;
+    }
+}
+
+static void test_async(picoredis_t *ctx)
+{
+    static const size_t connection_num = 4;
+    static const size_t command_num    = 1000;
+    picoredis_exec_del(ctx, 1, "async_counter");
+
+    picoredis_event_loop_t *loop = picoredis_event_loop_create();
+    picoredis_t *connections[connection_num];
+    size_t completed = 0;
+    size_t i = 0;
+    for (; i < connection_num; ++i) {
+        connections[i] = picoredis_async_connect("127.0.0.1", 6379);
+        picoredis_event_loop_add(loop, connections[i]);
+    }
+    for (i = 0; i < command_num; ++i) {
+        picoredis_async_command(connections[i % connection_num], async_incr_callback, &completed, PICOREDIS_INCR, 1, "async_counter");
+    }
+    ASSERT_NUMEQ("async commands are queued", picoredis_pending_replies(connections[0]), command_num / connection_num);
+    size_t rounds = 0;
+    for (; completed < command_num && rounds < 10000; ++rounds) {
+        picoredis_event_loop_run_once(loop, 100);
+    }
+    ASSERT_NUMEQ("async callbacks", completed, command_num);
+    ASSERT_STREQ("async result", picoredis_exec_get(ctx, "async_counter"), "1000");
+    ASSERT_NUMEQ("blocking call on async context", picoredis_get_reply_view(connections[0], &connections[0]->reply_view), -1);
+
+    for (i = 0; i < connection_num; ++i) {
+        picoredis_event_loop_remove(loop, connections[i]);
+        picoredis_free(connections[i]);
+    }
+
+    picoredis_t *freed_ctx = picoredis_async_connect("127.0.0.1", 6379);
+    picoredis_event_loop_add(loop, freed_ctx);
+    size_t results[2] = {0};
+    picoredis_async_command(freed_ctx, async_free_callback, results, PICOREDIS_GET, 1, "async_counter");
+    picoredis_async_command(freed_ctx, async_free_callback, results, PICOREDIS_GET, 1, "async_counter");
+    for (rounds = 0; results[0] + results[1] < 2 && rounds < 100; ++rounds) {
+        picoredis_event_loop_run_once(loop, 100);
+    }
+    ASSERT_NUMEQ("async free in callback reply", results[0], 1);
+    ASSERT_NUMEQ("async free in callback drops the rest", results[1], 1);
+    ASSERT_NUMEQ("async free in callback leaves the loop", loop->num, 0);
+    picoredis_event_loop_free(loop);
+}
+#endif
+
+static void test_io_uring(picoredis_t *ctx)
+{
+    picoredis_t *uring_ctx = picoredis_connect_with_transport("127.0.0.1", 6379, PICOREDIS_TRANSPORT_IO_URING);
+    if (picoredis_get_transport(uring_ctx) != PICOREDIS_TRANSPORT_IO_URING) {
+        fprintf(stderr, "io_uring is not available, the blocking transport is used\n");
+    }
+    size_t value_length = 100 * 1024;
+    char *large_value   = (char *)malloc(value_length + 1);
+    memset(large_value, 'u', value_length);
+    large_value[value_length] = '\0';
+    picoredis_exec_set(uring_ctx, "uring_key", large_value);
+    ASSERT_STREQ("io_uring large value", picoredis_exec_get(uring_ctx, "uring_key"), large_value);
+
+    picoredis_exec_del(uring_ctx, 1, "uring_counter");
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        picoredis_append_command(uring_ctx, PICOREDIS_INCR, 1, "uring_counter");
+    }
+    picoredis_reply_view_t reply;
+    for (i = 0; i < 100; ++i) {
+        picoredis_get_reply_view(uring_ctx, &reply);
+    }
+    ASSERT_NUMEQ("io_uring pipeline", reply.integer, 100);
+    ASSERT_STREQ("io_uring pipeline is visible to others", picoredis_exec_get(ctx, "uring_counter"), "100");
+    free(large_value);
+    picoredis_free(uring_ctx);
+}
+
+static void *pool_worker(void *arg)
+{
+    picoredis_pool_t *pool = (picoredis_pool_t *)arg;
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        picoredis_pool_exec_incr(pool, "pool_counter");
+    }
+    return NULL;
+}
+
+static void test_pool(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 1, "pool_counter");
+    picoredis_pool_t *pool = picoredis_pool_create("127.0.0.1", 6379, 2, 8);
+    ASSERT_NUMEQ("pool min size", picoredis_pool_size(pool), 2);
+
+    pthread_t threads[64];
+    size_t i = 0;
+    for (; i < 64; ++i) {
+        pthread_create(&threads[i], NULL, pool_worker, pool);
+    }
+    for (i = 0; i < 64; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_STREQ("pool shared counter", picoredis_exec_get(ctx, "pool_counter"), "6400");
+    ASSERT_NUMEQ("pool max size", picoredis_pool_size(pool) <= 8, 1);
+
+    picoredis_t *conn = picoredis_pool_checkout(pool);
+    picoredis_exec_select(conn, 1);
+    picoredis_pool_checkin(pool, conn);
+    conn = picoredis_pool_checkout(pool);
+    ASSERT_NUMEQ("pool restores selected db", conn->db, 0);
+    picoredis_pool_checkin(pool, conn);
+    picoredis_pool_free(pool);
+}
+
+static void *mux_worker(void *arg)
+{
+    picoredis_mux_t *mux = (picoredis_mux_t *)arg;
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        picoredis_mux_exec_incr(mux, "mux_counter");
+    }
+    return NULL;
+}
+
+static void test_mux(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 1, "mux_counter");
+    picoredis_mux_t *mux = picoredis_mux_connect("127.0.0.1", 6379);
+    ASSERT_NUMEQ("mux set", picoredis_mux_exec_set(mux, "mux_key", value), 1);
+    char *mux_value = picoredis_mux_exec_get(mux, "mux_key");
+    ASSERT_STREQ("mux get", mux_value, value);
+    free(mux_value);
+
+    pthread_t threads[100];
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        pthread_create(&threads[i], NULL, mux_worker, mux);
+    }
+    for (i = 0; i < 100; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_STREQ("mux shared counter", picoredis_exec_get(ctx, "mux_counter"), "10000");
+    picoredis_mux_free(mux);
+}
+
+static void test_cluster(picoredis_t *ctx)
+{
+    (void)ctx;
+    ASSERT_NUMEQ("keyslot", picoredis_cluster_keyslot("foo", 3), 12182);
+    ASSERT_NUMEQ("keyslot hashtag", picoredis_cluster_keyslot("{user1000}.following", 20), picoredis_cluster_keyslot("user1000", 8));
+    ASSERT_NUMEQ("keyslot empty hashtag", picoredis_cluster_keyslot("foo{}bar", 8), picoredis_crc16("foo{}bar", 8) & 16383);
+
+    picoredis_cluster_t *cluster = picoredis_cluster_connect("127.0.0.1", 7000);
+    if (picoredis_cluster_has_error(cluster)) {
+        fprintf(stderr, "no cluster on 127.0.0.1:7000, cluster tests are skipped\n");
+        picoredis_cluster_free(cluster);
+        return;
+    }
+    picoredis_cluster_exec_set(cluster, "foo", value);
+    ASSERT_STREQ("cluster get", picoredis_cluster_exec_get(cluster, "foo"), value);
+    picoredis_cluster_exec_set(cluster, "askkey", value);
+    ASSERT_STREQ("cluster get askkey", picoredis_cluster_exec_get(cluster, "askkey"), value);
+    ASSERT_NUMEQ("cluster mset", picoredis_cluster_exec_mset(cluster, 8, "k1", "v1", "k2", "v2", "{k1}a", "v3", "k4", "v4"), 1);
+    ASSERT_STREQ("cluster mset value", picoredis_cluster_exec_get(cluster, "{k1}a"), "v3");
+    ASSERT_NUMEQ("cluster del", picoredis_cluster_exec_del(cluster, 5, "k1", "k2", "{k1}a", "k4", "not_key"), 4);
+    picoredis_cluster_free(cluster);
+}
+
+// CLUSTER NODES and redirect replies recorded from a three master cluster
+static void test_cluster_offline(picoredis_t *ctx)
+{
+    (void)ctx;
+    static const char *nodes =
+        "07c37dfeb235213a872192d90877d0cd55635b91 127.0.0.1:7000@17000 myself,master - 0 0 1 connected 0-5460\n"
+        "67ed2db8d677e59ec4a4cefb06858cf2a1a89fa1 127.0.0.1:7001@17001 master - 0 1426238316232 2 connected 5461-10922 [5461->-e7d1eecce10fd6bb5eb35b9f99a514335d9ba9ca]\n"
+        "292f8b365bb7edb5e285caf0b7e6ddc7265d2f4f 127.0.0.1:7002@17002 master - 0 1426238318243 3 connected 10923-16383\n"
+        "6ec23923021cf3ffec47632106199cb7f496ce01 127.0.0.1:7005@17005 master,fail - 1426238316232 1426238316232 0 disconnected\n";
+    picoredis_cluster_t *cluster = (picoredis_cluster_t *)malloc(sizeof(picoredis_cluster_t));
+    memset(cluster, 0, sizeof(picoredis_cluster_t));
+    memset(cluster->slots, 0xff, sizeof(cluster->slots));
+    picoredis_cluster_node_add(cluster, "127.0.0.1", 9, 7000);
+    ASSERT_NUMEQ("cluster nodes parse", picoredis_cluster_parse_nodes(cluster, 0, nodes, strlen(nodes)), 0);
+    ASSERT_NUMEQ("cluster nodes skip failed", cluster->node_num, 3);
+    ASSERT_NUMEQ("cluster nodes first slot", cluster->slots[0], 0);
+    ASSERT_NUMEQ("cluster nodes range end", cluster->slots[5460], 0);
+    ASSERT_NUMEQ("cluster nodes migrating slot", cluster->slots[5461], 1);
+    ASSERT_NUMEQ("cluster nodes last slot", cluster->slots[16383], 2);
+
+    picoredis_t *offline = picoredis_alloc();
+    picoredis_reply_view_t view;
+    unsigned slot = 0;
+    int node      = -1;
+    parse_buffered(offline, "-MOVED 3999 127.0.0.1:7002\r\n");
+    picoredis_reply_view_create(offline, &view);
+    ASSERT_NUMEQ("cluster moved", picoredis_cluster_redirect(cluster, &view, &slot, &node), 1);
+    ASSERT_NUMEQ("cluster moved slot", slot, 3999);
+    ASSERT_NUMEQ("cluster moved node", node, 2);
+    ASSERT_NUMEQ("cluster moved updates slot map", cluster->slots[3999], 2);
+    picoredis_reader_consume(offline);
+
+    parse_buffered(offline, "-ASK 12182 127.0.0.1:7003\r\n");
+    picoredis_reply_view_create(offline, &view);
+    ASSERT_NUMEQ("cluster ask", picoredis_cluster_redirect(cluster, &view, &slot, &node), 2);
+    ASSERT_NUMEQ("cluster ask adds node", node, 3);
+    ASSERT_NUMEQ("cluster ask keeps slot map", cluster->slots[12182], 2);
+    picoredis_reader_consume(offline);
+
+    parse_buffered(offline, "-ERR unknown command 'FOO'\r\n");
+    picoredis_reply_view_create(offline, &view);
+    ASSERT_NUMEQ("cluster plain error", picoredis_cluster_redirect(cluster, &view, &slot, &node), 0);
+    picoredis_reader_consume(offline);
+
+    parse_buffered(offline, "-MOVED 3999\r\n");
+    picoredis_reply_view_create(offline, &view);
+    ASSERT_NUMEQ("cluster moved without address", picoredis_cluster_redirect(cluster, &view, &slot, &node), 0);
+    picoredis_reader_consume(offline);
+    picoredis_free(offline);
+    picoredis_cluster_free(cluster);
+}
+
+static void test_shard(picoredis_t *ctx)
+{
+    (void)ctx;
+    picoredis_shard_t *shard = picoredis_shard_create();
+    picoredis_shard_add_node(shard, "shard1", "127.0.0.1", 6379, 1);
+    picoredis_shard_add_node(shard, "shard2", "127.0.0.1", 6379, 1);
+    picoredis_shard_add_node(shard, "shard3", "127.0.0.1", 6379, 2);
+
+    char key_buf[1000][16];
+    const char *keys[1000];
+    int nodes[1000];
+    size_t counts[3] = {0};
+    size_t i = 0;
+    for (; i < 1000; ++i) {
+        snprintf(key_buf[i], sizeof(key_buf[i]), "shard_key%zu", i);
+        keys[i]  = key_buf[i];
+        nodes[i] = picoredis_shard_get_node(shard, keys[i], strlen(keys[i]));
+        counts[nodes[i]]++;
+    }
+    ASSERT_NUMEQ("shard weight", counts[2] > counts[0] && counts[2] > counts[1], 1);
+
+    picoredis_shard_add_node(shard, "shard4", "127.0.0.1", 6379, 1);
+    size_t moved = 0;
+    size_t misplaced = 0;
+    for (i = 0; i < 1000; ++i) {
+        int node = picoredis_shard_get_node(shard, keys[i], strlen(keys[i]));
+        if (node != nodes[i]) {
+            moved++;
+            misplaced += (node != 3);
+        }
+    }
+    ASSERT_NUMEQ("shard keys only move to the new node", misplaced, 0);
+    ASSERT_NUMEQ("shard minimal remapping", moved < 400, 1);
+
+    picoredis_shard_exec_del(shard, 3, "shard_a", "shard_b", "shard_c");
+    ASSERT_NUMEQ("shard mset", picoredis_shard_exec_mset(shard, 4, "shard_a", "1", "shard_c", "3"), 1);
+    picoredis_array_t *array = picoredis_shard_exec_mget(shard, 3, "shard_a", "shard_b", "shard_c");
+    ASSERT_STREQ("shard mget first", picoredis_array_get(array, 0), "1");
+    ASSERT_PTREQ("shard mget missing", (void *)picoredis_array_get(array, 1), NULL);
+    ASSERT_STREQ("shard mget last", picoredis_array_get(array, 2), "3");
+    picoredis_array_free(array);
+    ASSERT_NUMEQ("shard del", picoredis_shard_exec_del(shard, 3, "shard_a", "shard_b", "shard_c"), 2);
+    picoredis_shard_free(shard);
+
+    picoredis_shard_t *empty = picoredis_shard_create();
+    array = picoredis_shard_exec_mget(empty, 2, "shard_a", "shard_b");
+    ASSERT_PTREQ("shard mget without nodes", (void *)picoredis_array_get(array, 0), NULL);
+    ASSERT_PTREQ("shard mget without nodes last", (void *)picoredis_array_get(array, 1), NULL);
+    picoredis_array_free(array);
+    picoredis_shard_free(empty);
+}
+
+static void test_batch(picoredis_t *ctx)
+{
+    // more keys than PICOREDIS_BATCH_CHUNK_SIZE so that several chunks are sent
+    static char key_buf[3000][16];
+    static char value_buf[3000][16];
+    static picoredis_view_t keys[3001];
+    static picoredis_view_t values[3000];
+    size_t i = 0;
+    for (; i < 3000; ++i) {
+        keys[i].length   = snprintf(key_buf[i], sizeof(key_buf[i]), "batch_key%zu", i);
+        keys[i].ptr      = key_buf[i];
+        values[i].length = snprintf(value_buf[i], sizeof(value_buf[i]), "value%zu", i);
+        values[i].ptr    = value_buf[i];
+    }
+    keys[3000].ptr    = "batch_missing";
+    keys[3000].length = strlen(keys[3000].ptr);
+    picoredis_exec_del(ctx, 1, "batch_missing");
+
+    ASSERT_NUMEQ("mset batch", picoredis_exec_mset_batch(ctx, 3000, keys, values), 1);
+    ASSERT_NUMEQ("exists batch", picoredis_exec_exists_batch(ctx, 3001, keys), 3000);
+    picoredis_array_t *array = picoredis_exec_mget_batch(ctx, 3001, keys);
+    ASSERT_NUMEQ("mget batch num", array->num, 3001);
+    ASSERT_STREQ("mget batch first", picoredis_array_get(array, 0), "value0");
+    ASSERT_STREQ("mget batch chunk boundary", picoredis_array_get(array, PICOREDIS_BATCH_CHUNK_SIZE), value_buf[PICOREDIS_BATCH_CHUNK_SIZE]);
+    ASSERT_STREQ("mget batch last", picoredis_array_get(array, 2999), "value2999");
+    ASSERT_PTREQ("mget batch missing", (void *)picoredis_array_get(array, 3000), NULL);
+    picoredis_array_free(array);
+
+    array = picoredis_exec_mget(ctx, 2, "batch_key1", "batch_missing");
+    ASSERT_STREQ("mget first", picoredis_array_get(array, 0), "value1");
+    ASSERT_PTREQ("mget missing", (void *)picoredis_array_get(array, 1), NULL);
+    picoredis_array_free(array);
+
+    ASSERT_NUMEQ("del batch", picoredis_exec_del_batch(ctx, 3001, keys), 3000);
+    ASSERT_NUMEQ("exists batch after del", picoredis_exec_exists_batch(ctx, 3000, keys), 0);
+}
+
+typedef struct {
+    size_t length;
+    size_t calls;
+    unsigned long long sum;
+    size_t stop_after;
+} stream_state_t;
+
+static int stream_callback(const char *data, size_t length, size_t value_length, void *privdata)
+{
+    (void)value_length;
+    stream_state_t *state = (stream_state_t *)privdata;
+    size_t i = 0;
+    for (; i < length; ++i) {
+        state->sum += (unsigned char)data[i];
+    }
+    state->length += length;
+    state->calls++;
+    return state->stop_after && state->calls >= state->stop_after;
+}
+
+// streams a GET whose reply is already waiting on the other end of a socket pair
+static int stream_replayed(picoredis_t *ctx, const char *reply)
+{
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    write(fds[1], reply, strlen(reply));
+    ctx->sock = fds[0];
+    stream_state_t state = {0};
+    int ret = picoredis_exec_get_stream(ctx, "stream_key", 10, stream_callback, &state);
+    close(fds[1]);
+    return ret;
+}
+
+static void test_stream_protocol_error(picoredis_t *ctx)
+{
+    (void)ctx;
+    picoredis_t *offline = picoredis_alloc();
+    ASSERT_NUMEQ("stream replayed", stream_replayed(offline, "$3\r\nabc\r\n"), 1);
+    ASSERT_NUMEQ("stream replayed done", offline->pending_replies, 0);
+    close(offline->sock);
+    ASSERT_NUMEQ("stream empty length", stream_replayed(offline, "$\r\n"), -1);
+    ASSERT_STREQ("stream protocol error", offline->error, "protocol error");
+    ASSERT_NUMEQ("stream protocol error drops connection", offline->sock, -1);
+    ASSERT_NUMEQ("stream protocol error drops reply", offline->pending_replies + offline->receive_end, 0);
+    ASSERT_NUMEQ("stream length without digits", stream_replayed(offline, "$abc\r\n"), -1);
+    ASSERT_NUMEQ("stream huge length", stream_replayed(offline, "$9223372036854775807\r\n"), -1);
+    ASSERT_NUMEQ("stream bad terminator", stream_replayed(offline, "$3\r\nabcXY"), -1);
+    ASSERT_NUMEQ("stream bad terminator drops connection", offline->sock + (int)offline->pending_replies, -1);
+    picoredis_free(offline);
+}
+
+static void test_stream(picoredis_t *ctx)
+{
+    size_t value_length = 3 * 1024 * 1024;
+    char *value = (char *)malloc(value_length);
+    unsigned long long sum = 0;
+    size_t i = 0;
+    for (; i < value_length; ++i) {
+        value[i] = (char)(i * 31);
+        sum += (unsigned char)value[i];
+    }
+    picoredis_exec_set_binary(ctx, "stream_key", 10, value, value_length);
+    picoredis_exec_del(ctx, 1, "stream_missing");
+
+    stream_state_t state = {0};
+    ASSERT_NUMEQ("get stream", picoredis_exec_get_stream(ctx, "stream_key", 10, stream_callback, &state), 1);
+    ASSERT_NUMEQ("get stream length", state.length, value_length);
+    ASSERT_NUMEQ("get stream sum", state.sum == sum, 1);
+    ASSERT_NUMEQ("get stream chunked", state.calls > 1, 1);
+    ASSERT_NUMEQ("get stream missing", picoredis_exec_get_stream(ctx, "stream_missing", 14, stream_callback, &state), 0);
+
+    stream_state_t stop = {0};
+    stop.stop_after = 1;
+    ASSERT_NUMEQ("get stream stopped", picoredis_exec_get_stream(ctx, "stream_key", 10, stream_callback, &stop), -1);
+    ASSERT_NUMEQ("get stream stopped once", stop.calls, 1);
+    ASSERT_NUMEQ("get stream after stop", picoredis_exec_incr(ctx, "stream_counter") > 0, 1);
+
+    FILE *file = tmpfile();
+    size_t written = 0;
+    ASSERT_NUMEQ("get to fd", picoredis_exec_get_to_fd(ctx, "stream_key", 10, fileno(file), &written), 1);
+    ASSERT_NUMEQ("get to fd length", written, value_length);
+    char *copy = (char *)malloc(value_length);
+    rewind(file);
+    ASSERT_NUMEQ("get to fd content", fread(copy, 1, value_length, file) == value_length && memcmp(copy, value, value_length) == 0, 1);
+    fclose(file);
+    ASSERT_NUMEQ("get to fd missing", picoredis_exec_get_to_fd(ctx, "stream_missing", 14, 1, NULL), 0);
+
+    int pipe_fds[2];
+    pipe(pipe_fds);
+    picoredis_exec_set(ctx, "stream_small", "small value");
+    ASSERT_NUMEQ("get to pipe", picoredis_exec_get_to_fd(ctx, "stream_small", 12, pipe_fds[1], NULL), 1);
+    char buf[32] = {0};
+    read(pipe_fds[0], buf, sizeof(buf) - 1);
+    ASSERT_STREQ("get to pipe content", buf, "small value");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    picoredis_exec_del(ctx, 3, "stream_key", "stream_small", "stream_counter");
+    free(copy);
+    free(value);
+}
+
+static void test_zero_copy_set(picoredis_t *ctx)
+{
+    size_t value_length = 1024 * 1024;
+    char *value = (char *)malloc(value_length);
+    size_t i = 0;
+    for (; i < value_length; ++i) {
+        value[i] = (char)(i * 7);
+    }
+    size_t length = 0;
+    picoredis_exec_set_binary(ctx, "zero_copy_key", 13, value, value_length);
+    ASSERT_NUMEQ("set large value without copy", ctx->send_buf_size < value_length, 1);
+    char *got = picoredis_exec_get_binary(ctx, "zero_copy_key", 13, &length);
+    ASSERT_NUMEQ("set large value", length == value_length && memcmp(got, value, value_length) == 0, 1);
+    free(got);
+
+    struct iovec iov[3] = { { value, 10 }, { value + 100, 200000 }, { (void *)"tail", 4 } };
+    ASSERT_NUMEQ("set iov", picoredis_exec_set_iov(ctx, "zero_copy_key", 13, iov, 3), 1);
+    got = picoredis_exec_get_binary(ctx, "zero_copy_key", 13, &length);
+    ASSERT_NUMEQ("set iov length", length, 200014);
+    ASSERT_NUMEQ("set iov content", memcmp(got, value, 10) == 0 && memcmp(got + 10, value + 100, 200000) == 0 && memcmp(got + 200010, "tail", 4) == 0, 1);
+    free(got);
+
+    FILE *file = tmpfile();
+    fwrite(value, 1, value_length, file);
+    fflush(file);
+    ASSERT_NUMEQ("set file", picoredis_exec_set_file(ctx, "zero_copy_key", 13, fileno(file), 4096, 500000), 1);
+    got = picoredis_exec_get_binary(ctx, "zero_copy_key", 13, &length);
+    ASSERT_NUMEQ("set file content", length == 500000 && memcmp(got, value + 4096, 500000) == 0, 1);
+    free(got);
+    ASSERT_NUMEQ("set file too short", picoredis_exec_set_file(ctx, "zero_copy_key", 13, fileno(file), 4096, value_length), -1);
+    ASSERT_NUMEQ("set file too short keeps connection", picoredis_exec_del(ctx, 1, "zero_copy_key"), 1);
+    fclose(file);
+    free(value);
+}
+
+static void test_iterator(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 2, "iter_list", "iter_set");
+    char value[128];
+    size_t i = 0;
+    for (; i < 20000; ++i) {
+        snprintf(value, sizeof(value), "%0100zu", i);
+        picoredis_append_command(ctx, PICOREDIS_RPUSH, 2, "iter_list", value);
+    }
+    picoredis_flush(ctx);
+    for (i = 0; i < 20000; ++i) {
+        picoredis_reply_free(picoredis_get_reply(ctx));
+    }
+
+    // a fresh connection, the receive buffer of ctx has grown in the tests above
+    picoredis_t *fresh = picoredis_connect("127.0.0.1", 6379);
+    picoredis_iterator_t iter;
+    picoredis_reply_view_t element;
+    ASSERT_NUMEQ("lrange iter", picoredis_exec_lrange_iter(fresh, "iter_list", 0, -1, &iter), 1);
+    size_t count   = 0;
+    size_t ordered = 1;
+    while (picoredis_iterator_next(&iter, &element) > 0) {
+        snprintf(value, sizeof(value), "%0100zu", count++);
+        ordered &= element.value.length == 100 && memcmp(element.value.ptr, value, 100) == 0;
+    }
+    ASSERT_NUMEQ("lrange iter count", count, 20000);
+    ASSERT_NUMEQ("lrange iter order", ordered, 1);
+    ASSERT_NUMEQ("lrange iter bounded buffer", fresh->receive_buf_size, PICOREDIS_RECEIVE_BUFFER_SIZE);
+    picoredis_free(fresh);
+
+    ASSERT_NUMEQ("lrange iter close", picoredis_exec_lrange_iter(ctx, "iter_list", 0, -1, &iter), 1);
+    ASSERT_NUMEQ("lrange iter first", picoredis_iterator_next(&iter, &element), 1);
+    picoredis_iterator_close(&iter);
+    ASSERT_NUMEQ("lrange iter after close", picoredis_exec_llen(ctx, "iter_list"), 20000);
+
+    picoredis_exec_sadd(ctx, "iter_set", "a");
+    picoredis_exec_sadd(ctx, "iter_set", "b");
+    ASSERT_NUMEQ("smembers iter", picoredis_exec_smembers_iter(ctx, "iter_set", &iter), 1);
+    for (count = 0; picoredis_iterator_next(&iter, &element) > 0; ++count) {}
+    ASSERT_NUMEQ("smembers iter count", count, 2);
+    ASSERT_NUMEQ("keys iter", picoredis_exec_keys_iter(ctx, "iter_no_such_key*", &iter), 1);
+    ASSERT_NUMEQ("keys iter empty", picoredis_iterator_next(&iter, &element), 0);
+    ASSERT_NUMEQ("smembers iter wrong type", picoredis_exec_smembers_iter(ctx, "iter_list", &iter), -1);
+    ASSERT_NUMEQ("iter after error", picoredis_exec_del(ctx, 2, "iter_list", "iter_set"), 2);
+}
+
+static int scan_count_callback(picoredis_t *ctx, const picoredis_view_t *element, void *privdata)
+{
+    (void)ctx;
+    (void)element;
+    size_t *count = (size_t *)privdata;
+    (*count)++;
+    return 0;
+}
+
+static int scan_stop_callback(picoredis_t *ctx, const picoredis_view_t *element, void *privdata)
+{
+    (void)ctx;
+    (void)element;
+    (void)privdata;
+    return 1;
+}
+
+static void test_scan(picoredis_t *ctx)
+{
+    char key[32];
+    size_t i = 0;
+    for (; i < 500; ++i) {
+        snprintf(key, sizeof(key), "scan_key%zu", i);
+        picoredis_append_command(ctx, PICOREDIS_SET, 2, key, "1");
+        picoredis_append_command(ctx, PICOREDIS_SADD, 2, "scan_set", key);
+        picoredis_append_command(ctx, PICOREDIS_HSET, 3, "scan_hash", key, "1");
+        picoredis_append_command(ctx, PICOREDIS_ZADD, 3, "scan_zset", "1", key);
+    }
+    picoredis_flush(ctx);
+    for (i = 0; i < 2000; ++i) {
+        picoredis_reply_free(picoredis_get_reply(ctx));
+    }
+
+    picoredis_scan_t scan;
+    picoredis_reply_view_t element;
+    size_t count = 0;
+    picoredis_scan_init(&scan, ctx, PICOREDIS_SCAN, NULL, "scan_key*", 50);
+    while (picoredis_scan_next(&scan, &element) > 0) {
+        count += (element.value.length > 8 && memcmp(element.value.ptr, "scan_key", 8) == 0);
+    }
+    ASSERT_NUMEQ("scan", count, 500);
+
+    picoredis_command_type types[] = { PICOREDIS_SSCAN, PICOREDIS_HSCAN, PICOREDIS_ZSCAN };
+    size_t expected[] = { 500, 1000, 1000 };
+    size_t t = 0;
+    for (; t < 3; ++t) {
+        const char *keys[] = { "scan_set", "scan_hash", "scan_zset" };
+        picoredis_scan_init(&scan, ctx, types[t], keys[t], NULL, 100);
+        for (count = 0; picoredis_scan_next(&scan, &element) > 0; ++count) {}
+        ASSERT_NUMEQ("scan collection", count, expected[t]);
+    }
+
+    picoredis_scan_init(&scan, ctx, PICOREDIS_SCAN, NULL, "scan_key*", 10);
+    ASSERT_NUMEQ("scan early stop", picoredis_scan_next(&scan, &element), 1);
+    picoredis_scan_close(&scan);
+    ASSERT_NUMEQ("scan after close", picoredis_exec_exists(ctx, "scan_key0"), 1);
+
+    picoredis_t *ctxs[] = { ctx, picoredis_connect("127.0.0.1", 6379), picoredis_connect("127.0.0.1", 6379) };
+    count = 0;
+    ASSERT_NUMEQ("scan parallel", picoredis_scan_parallel(ctxs, 3, "scan_key*", 100, scan_count_callback, &count), 0);
+    ASSERT_NUMEQ("scan parallel count", count, 1500);
+    ASSERT_NUMEQ("scan parallel stop", picoredis_scan_parallel(ctxs, 3, "scan_key*", 100, scan_stop_callback, NULL), -1);
+    ASSERT_NUMEQ("scan parallel after stop", picoredis_exec_exists(ctxs[1], "scan_key0"), 1);
+    picoredis_free(ctxs[1]);
+    picoredis_free(ctxs[2]);
+
+    picoredis_shard_t *shard = picoredis_shard_create();
+    picoredis_shard_add_node(shard, "scan1", "127.0.0.1", 6379, 1);
+    picoredis_shard_add_node(shard, "scan2", "127.0.0.1", 6379, 1);
+    count = 0;
+    ASSERT_NUMEQ("shard scan", picoredis_shard_scan(shard, "scan_key*", 100, scan_count_callback, &count), 0);
+    ASSERT_NUMEQ("shard scan count", count, 1000);
+    picoredis_shard_free(shard);
+
+    static char key_buf[500][16];
+    picoredis_view_t keys[500];
+    for (i = 0; i < 500; ++i) {
+        keys[i].length = snprintf(key_buf[i], sizeof(key_buf[i]), "scan_key%zu", i);
+        keys[i].ptr    = key_buf[i];
+    }
+    picoredis_exec_del_batch(ctx, 500, keys);
+    picoredis_exec_del(ctx, 3, "scan_set", "scan_hash", "scan_zset");
+    ASSERT_NUMEQ("scan cleanup", picoredis_exec_exists(ctx, "scan_key0"), 0);
+}
+
+typedef struct {
+    picoredis_t *other;
+    size_t attempts;
+} watch_state_t;
+
+static int watch_increment(picoredis_t *ctx, picoredis_transaction_t *tx, void *privdata)
+{
+    watch_state_t *state = (watch_state_t *)privdata;
+    char *value = picoredis_exec_get(ctx, "tx_watched");
+    char next[32];
+    snprintf(next, sizeof(next), "%d", atoi(value) + 1);
+    free(value);
+    if (state->attempts++ == 0) {
+        // a concurrent writer makes the first attempt fail
+        picoredis_exec_set(state->other, "tx_watched", "100");
+    }
+    return picoredis_transaction_append(tx, PICOREDIS_SET, 2, "tx_watched", next);
+}
+
+static void test_transaction(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 3, "tx_counter", "tx_list", "tx_watched");
+    picoredis_transaction_t tx;
+    picoredis_reply_tree_t *replies;
+    picoredis_transaction_begin(&tx, ctx);
+    picoredis_transaction_append(&tx, PICOREDIS_SET, 2, "tx_counter", "10");
+    picoredis_transaction_append(&tx, PICOREDIS_INCR, 1, "tx_counter");
+    picoredis_transaction_append(&tx, PICOREDIS_RPUSH, 2, "tx_list", "a");
+    picoredis_transaction_append(&tx, PICOREDIS_RPUSH, 2, "tx_list", "b");
+    picoredis_transaction_append(&tx, PICOREDIS_LRANGE, 3, "tx_list", "0", "-1");
+    picoredis_transaction_append(&tx, PICOREDIS_GET, 1, "tx_missing");
+    ASSERT_NUMEQ("transaction exec", picoredis_transaction_exec(&tx, &replies), 1);
+    ASSERT_NUMEQ("transaction replies", replies->num, 6);
+    ASSERT_STREQ("transaction set", replies->elements[0].value.ptr, "OK");
+    ASSERT_NUMEQ("transaction incr", replies->elements[1].integer, 11);
+    ASSERT_NUMEQ("transaction nested", replies->elements[4].num, 2);
+    ASSERT_STREQ("transaction nested element", replies->elements[4].elements[1].value.ptr, "b");
+    ASSERT_NUMEQ("transaction nil", replies->elements[5].is_nil, 1);
+    picoredis_reply_tree_free(replies);
+
+    picoredis_transaction_begin(&tx, ctx);
+    picoredis_transaction_append(&tx, PICOREDIS_INCR, 1, "tx_counter");
+    picoredis_transaction_discard(&tx);
+    ASSERT_NUMEQ("transaction discard", picoredis_exec_incr(ctx, "tx_counter"), 12);
+
+    // as if the second append had failed half way
+    picoredis_transaction_begin(&tx, ctx);
+    picoredis_transaction_append(&tx, PICOREDIS_INCR, 1, "tx_counter");
+    tx.failed = 1;
+    picoredis_transaction_discard(&tx);
+    ASSERT_NUMEQ("transaction discard after failure", ctx->send_length + ctx->pending_replies, 0);
+    ASSERT_NUMEQ("transaction discard after failure not applied", picoredis_exec_incr(ctx, "tx_counter"), 13);
+
+    picoredis_transaction_begin(&tx, ctx);
+    picoredis_transaction_append(&tx, PICOREDIS_INCR, 1, "tx_counter");
+    picoredis_transaction_append(&tx, PICOREDIS_SET, 1, "tx_counter");
+    ASSERT_NUMEQ("transaction rejected", picoredis_transaction_exec(&tx, &replies), -1);
+    ASSERT_NUMEQ("transaction rejected not applied", picoredis_exec_incr(ctx, "tx_counter"), 14);
+
+    picoredis_exec_set(ctx, "tx_watched", "1");
+    watch_state_t state = { picoredis_connect("127.0.0.1", 6379), 0 };
+    const char *keys[] = { "tx_watched" };
+    ASSERT_NUMEQ("transaction watch", picoredis_transaction_watch(ctx, 1, keys, 5, watch_increment, &state, &replies), 1);
+    ASSERT_NUMEQ("transaction watch retried", state.attempts, 2);
+    char *value = picoredis_exec_get(ctx, "tx_watched");
+    ASSERT_STREQ("transaction watch result", value, "101");
+    free(value);
+    picoredis_reply_tree_free(replies);
+    picoredis_free(state.other);
+    picoredis_exec_del(ctx, 3, "tx_counter", "tx_list", "tx_watched");
+}
+
+static void test_script(picoredis_t *ctx)
+{
+    unsigned char digest[20];
+    picoredis_sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, digest);
+    ASSERT_NUMEQ("sha1", memcmp(digest, "\x84\x98\x3e\x44\x1c\x3b\xd2\x6e\xba\xae\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1", 20), 0);
+    picoredis_script_t one;
+    picoredis_script_init(&one, "return 1");
+    ASSERT_STREQ("script sha1", one.sha1, "e0e1f9fabfc9d4800c877a703b823ac0578ff8db");
+
+    picoredis_script_t script;
+    picoredis_script_init(&script, "redis.call('INCRBY', KEYS[1], ARGV[1]) return {redis.call('GET', KEYS[1]), 'done'}");
+    picoredis_exec_del(ctx, 1, "script_counter");
+    const char *keys[] = { "script_counter" };
+    const char *args[] = { "5" };
+    picoredis_reply_tree_t *reply = picoredis_exec_script(ctx, &script, 1, keys, 1, args);
+    ASSERT_NUMEQ("script eval", reply->num, 2);
+    ASSERT_STREQ("script eval result", reply->elements[0].value.ptr, "5");
+    ASSERT_STREQ("script eval nested", reply->elements[1].value.ptr, "done");
+    picoredis_reply_tree_free(reply);
+    ASSERT_NUMEQ("script registered", ctx->script_num, 1);
+
+    reply = picoredis_exec_script(ctx, &script, 1, keys, 1, args);
+    ASSERT_STREQ("script evalsha", reply->elements[0].value.ptr, "10");
+    picoredis_reply_tree_free(reply);
+
+    // flushed behind the back of ctx, EVALSHA gets NOSCRIPT and EVAL is used again
+    picoredis_t *other = picoredis_connect("127.0.0.1", 6379);
+    picoredis_exec_script_flush(other);
+    picoredis_free(other);
+    reply = picoredis_exec_script(ctx, &script, 1, keys, 1, args);
+    ASSERT_STREQ("script noscript fallback", reply->elements[0].value.ptr, "15");
+    picoredis_reply_tree_free(reply);
+    ASSERT_NUMEQ("script registered again", ctx->script_num, 1);
+
+    picoredis_exec_script_flush(ctx);
+    ASSERT_NUMEQ("script load", picoredis_script_load(ctx, &one), 1);
+    reply = picoredis_exec_script(ctx, &one, 0, NULL, 0, NULL);
+    ASSERT_NUMEQ("script evalsha after load", reply->integer, 1);
+    picoredis_reply_tree_free(reply);
+    picoredis_exec_del(ctx, 1, "script_counter");
+}
+
+typedef struct {
+    size_t channel_count;
+    size_t pattern_count;
+    size_t bytes;
+    int bad_pattern;
+} pubsub_counts_t;
+
+static void on_channel_message(const picoredis_view_t *channel, const picoredis_view_t *message, const picoredis_view_t *pattern, void *privdata)
+{
+    (void)channel;
+    pubsub_counts_t *counts = (pubsub_counts_t *)privdata;
+    counts->channel_count++;
+    counts->bytes += message->length;
+    if (pattern) counts->bad_pattern = 1;
+}
+
+static void on_pattern_message(const picoredis_view_t *channel, const picoredis_view_t *message, const picoredis_view_t *pattern, void *privdata)
+{
+    (void)channel;
+    (void)message;
+    pubsub_counts_t *counts = (pubsub_counts_t *)privdata;
+    counts->pattern_count++;
+    if (!pattern || pattern->length != 7 || memcmp(pattern->ptr, "ps_pat*", 7) != 0) counts->bad_pattern = 1;
+}
+
+static void test_pubsub(picoredis_t *ctx)
+{
+    static const size_t message_num = 1000;
+    pubsub_counts_t counts;
+    memset(&counts, 0, sizeof(counts));
+    ASSERT_PTREQ("pubsub connect refused", picoredis_subscriber_connect("127.0.0.1", 1), NULL);
+    picoredis_subscriber_t *sub = picoredis_subscriber_connect("127.0.0.1", 6379);
+    ASSERT_NUMEQ("pubsub subscribe", picoredis_subscriber_subscribe(sub, "ps_chan", on_channel_message, &counts), 0);
+    ASSERT_NUMEQ("pubsub psubscribe", picoredis_subscriber_psubscribe(sub, "ps_pat*", on_pattern_message, &counts), 0);
+    ASSERT_NUMEQ("pubsub subscriptions", sub->num, 2);
+    // wait for both confirmations so that no message is published too early
+    int i = 0;
+    for (; i < 100 && sub->server_count < 2; ++i) {
+        picoredis_subscriber_dispatch(sub, 100);
+    }
+    ASSERT_NUMEQ("pubsub server count", sub->server_count, 2);
+
+    picoredis_view_t channels[message_num];
+    picoredis_view_t messages[message_num];
+    size_t j = 0;
+    for (; j < message_num; ++j) {
+        channels[j].ptr    = (j % 10 == 9) ? "ps_pat1" : "ps_chan";
+        channels[j].length = 7;
+        messages[j].ptr    = "payload";
+        messages[j].length = 7;
+    }
+    ASSERT_NUMEQ("pubsub publish batch", picoredis_exec_publish_batch(ctx, message_num, channels, messages), message_num);
+    ASSERT_NUMEQ("pubsub publish", picoredis_exec_publish(ctx, "ps_chan", "last"), 1);
+    ASSERT_NUMEQ("pubsub publish nobody", picoredis_exec_publish(ctx, "ps_nobody", "x"), 0);
+
+    for (i = 0; i < 100 && counts.channel_count + counts.pattern_count < message_num + 1; ++i) {
+        if (picoredis_subscriber_dispatch(sub, 100) < 0) break;
+    }
+    ASSERT_NUMEQ("pubsub channel messages", counts.channel_count, message_num - message_num / 10 + 1);
+    ASSERT_NUMEQ("pubsub pattern messages", counts.pattern_count, message_num / 10);
+    ASSERT_NUMEQ("pubsub message bytes", counts.bytes, (message_num - message_num / 10) * 7 + 4);
+    ASSERT_NUMEQ("pubsub pattern views", counts.bad_pattern, 0);
+
+    picoredis_subscriber_unsubscribe(sub, "ps_chan");
+    picoredis_subscriber_punsubscribe(sub, "ps_pat*");
+    ASSERT_NUMEQ("pubsub unsubscribe", sub->num, 0);
+    ASSERT_NUMEQ("pubsub run", picoredis_subscriber_run(sub), 0);
+    ASSERT_NUMEQ("pubsub server count after", sub->server_count, 0);
+    picoredis_subscriber_free(sub);
+}
+
+typedef struct {
+    size_t count;
+    char last[32];
+    int out_of_order;
+    const char *reject;
+} queue_worker_t;
+
+static int on_queue_item(const picoredis_view_t *list, const picoredis_view_t *item, void *privdata)
+{
+    queue_worker_t *worker = (queue_worker_t *)privdata;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "job%zu", worker->count++);
+    if (item->length != strlen(expected) || memcmp(item->ptr, expected, item->length) != 0) worker->out_of_order = 1;
+    if (list->length != 7 || memcmp(list->ptr, "queue_b", 7) != 0) worker->out_of_order = 1;
+    return (worker->reject && item->length == strlen(worker->reject) && memcmp(item->ptr, worker->reject, item->length) == 0);
+}
+
+static void test_queue(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 3, "queue_a", "queue_b", "queue_b:processing");
+    char value[32];
+    size_t i = 0;
+    for (; i < 25; ++i) {
+        snprintf(value, sizeof(value), "job%zu", i);
+        picoredis_exec_lpush(ctx, "queue_b", value);
+    }
+    const char *lists[] = { "queue_a", "queue_b" };
+    ASSERT_PTREQ("queue connect refused", picoredis_queue_connect("127.0.0.1", 1, 2, lists, 10, 1), NULL);
+    picoredis_queue_t *queue = picoredis_queue_connect("127.0.0.1", 6379, 2, lists, 10, 1);
+    queue_worker_t worker;
+    memset(&worker, 0, sizeof(worker));
+    ASSERT_NUMEQ("queue reliable needs one list", picoredis_queue_set_processing(queue, "queue_b:processing"), -1);
+    ASSERT_NUMEQ("queue poll batch", picoredis_queue_poll(queue, on_queue_item, &worker), 10);
+    ASSERT_NUMEQ("queue poll batch 2", picoredis_queue_poll(queue, on_queue_item, &worker), 10);
+    ASSERT_NUMEQ("queue poll rest", picoredis_queue_poll(queue, on_queue_item, &worker), 5);
+    ASSERT_NUMEQ("queue fifo", worker.out_of_order, 0);
+    ASSERT_NUMEQ("queue poll timeout", picoredis_queue_poll(queue, on_queue_item, &worker), 0);
+    picoredis_queue_free(queue);
+
+    for (i = 0; i < 5; ++i) {
+        snprintf(value, sizeof(value), "job%zu", i);
+        picoredis_exec_lpush(ctx, "queue_b", value);
+    }
+    const char *reliable_lists[] = { "queue_b" };
+    queue = picoredis_queue_connect("127.0.0.1", 6379, 1, reliable_lists, 3, 1);
+    ASSERT_NUMEQ("queue set processing", picoredis_queue_set_processing(queue, "queue_b:processing"), 0);
+    memset(&worker, 0, sizeof(worker));
+    worker.reject = "job1";
+    ASSERT_NUMEQ("queue reliable poll", picoredis_queue_poll(queue, on_queue_item, &worker), 3);
+    ASSERT_NUMEQ("queue reliable poll rest", picoredis_queue_poll(queue, on_queue_item, &worker), 2);
+    ASSERT_NUMEQ("queue reliable fifo", worker.out_of_order, 0);
+    ASSERT_NUMEQ("queue unacknowledged", picoredis_exec_llen(ctx, "queue_b:processing"), 1);
+    ASSERT_NUMEQ("queue requeue", picoredis_queue_requeue(queue), 1);
+    ASSERT_NUMEQ("queue requeued", picoredis_exec_llen(ctx, "queue_b"), 1);
+    picoredis_queue_free(queue);
+    picoredis_exec_del(ctx, 3, "queue_a", "queue_b", "queue_b:processing");
+}
+
+static void test_hash(picoredis_t *ctx)
+{
+    picoredis_exec_del(ctx, 1, "hash_profile");
+    ASSERT_NUMEQ("hset", picoredis_exec_hset(ctx, "hash_profile", "name", "alice"), 1);
+    ASSERT_NUMEQ("hset update", picoredis_exec_hset(ctx, "hash_profile", "name", "bob"), 0);
+    char *value = picoredis_exec_hget(ctx, "hash_profile", "name");
+    ASSERT_STREQ("hget", value, "bob");
+    free(value);
+    ASSERT_NUMEQ("hget missing", picoredis_exec_hget(ctx, "hash_profile", "nothing") == NULL, 1);
+
+    picoredis_view_t fields[100];
+    picoredis_view_t values[100];
+    char names[100][16];
+    size_t i = 0;
+    for (; i < 100; ++i) {
+        fields[i].length = snprintf(names[i], sizeof(names[i]), "field%zu", i);
+        fields[i].ptr    = names[i];
+        values[i]        = fields[i];
+    }
+    ASSERT_NUMEQ("hmset", picoredis_exec_hmset(ctx, "hash_profile", 100, fields, values), 1);
+    ASSERT_NUMEQ("hlen", picoredis_exec_hlen(ctx, "hash_profile"), 101);
+    picoredis_view_t query[] = { { "field7", 6 }, { "missing", 7 }, { "name", 4 } };
+    picoredis_array_t *array = picoredis_exec_hmget(ctx, "hash_profile", 3, query);
+    ASSERT_NUMEQ("hmget num", picoredis_array_num(array), 3);
+    ASSERT_STREQ("hmget value", picoredis_array_get(array, 0), "field7");
+    ASSERT_NUMEQ("hmget missing", picoredis_array_get(array, 1) == NULL, 1);
+    ASSERT_STREQ("hmget name", picoredis_array_get(array, 2), "bob");
+    picoredis_array_free(array);
+
+    ASSERT_NUMEQ("hincrby", picoredis_exec_hincrby(ctx, "hash_profile", "visits", 3), 3);
+    ASSERT_NUMEQ("hincrby again", picoredis_exec_hincrby(ctx, "hash_profile", "visits", -1), 2);
+    ASSERT_NUMEQ("hexists", picoredis_exec_hexists(ctx, "hash_profile", "visits"), 1);
+    ASSERT_NUMEQ("hdel", picoredis_exec_hdel(ctx, "hash_profile", "visits"), 1);
+    ASSERT_NUMEQ("hexists deleted", picoredis_exec_hexists(ctx, "hash_profile", "visits"), 0);
+    array = picoredis_exec_hkeys(ctx, "hash_profile");
+    ASSERT_NUMEQ("hkeys", picoredis_array_num(array), 101);
+    picoredis_array_free(array);
+    array = picoredis_exec_hvals(ctx, "hash_profile");
+    ASSERT_NUMEQ("hvals", picoredis_array_num(array), 101);
+    picoredis_array_free(array);
+
+    picoredis_hash_t *hash = picoredis_exec_hgetall(ctx, "hash_profile");
+    ASSERT_NUMEQ("hgetall num", picoredis_hash_num(hash), 101);
+    int found = 0;
+    for (i = 0; i < 100; ++i) {
+        const picoredis_view_t *field_value = picoredis_hash_get(hash, names[i]);
+        found += (field_value && field_value->length == fields[i].length && strcmp(field_value->ptr, names[i]) == 0);
+    }
+    ASSERT_NUMEQ("hgetall lookup", found, 100);
+    ASSERT_STREQ("hgetall name", picoredis_hash_get(hash, "name")->ptr, "bob");
+    ASSERT_NUMEQ("hgetall missing", picoredis_hash_get(hash, "missing") == NULL, 1);
+    picoredis_hash_free(hash);
+
+    picoredis_exec_del(ctx, 1, "hash_profile");
+    hash = picoredis_exec_hgetall(ctx, "hash_profile");
+    ASSERT_NUMEQ("hgetall empty", picoredis_hash_num(hash), 0);
+    ASSERT_NUMEQ("hgetall empty lookup", picoredis_hash_get(hash, "name") == NULL, 1);
+    picoredis_hash_free(hash);
+}
+
+static void test_bulk(picoredis_t *ctx)
+{
+    static const size_t member_num = 5000;
+    picoredis_exec_del(ctx, 4, "bulk_set", "bulk_zset", "bulk_list", "bulk_hash");
+    picoredis_view_t *members = (picoredis_view_t *)malloc(sizeof(picoredis_view_t) * member_num);
+    double *scores            = (double *)malloc(sizeof(double) * member_num);
+    char (*names)[16]         = (char (*)[16])malloc(16 * member_num);
+    size_t i = 0;
+    for (; i < member_num; ++i) {
+        members[i].length = snprintf(names[i], 16, "member%zu", i);
+        members[i].ptr    = names[i];
+        scores[i]         = i * 0.5;
+    }
+    ASSERT_NUMEQ("sadd bulk", picoredis_exec_sadd_bulk(ctx, "bulk_set", member_num, members), member_num);
+    ASSERT_NUMEQ("sadd bulk variadic", ctx->variadic, 1);
+    ASSERT_NUMEQ("sadd bulk again", picoredis_exec_sadd_bulk(ctx, "bulk_set", 10, members), 0);
+    ASSERT_NUMEQ("scard bulk", picoredis_exec_scard(ctx, "bulk_set"), member_num);
+    ASSERT_NUMEQ("zadd bulk", picoredis_exec_zadd_bulk(ctx, "bulk_zset", member_num, scores, members), member_num);
+    ASSERT_NUMEQ("zcard bulk", picoredis_exec_zcard(ctx, "bulk_zset"), member_num);
+    char *score = picoredis_exec_zscore(ctx, "bulk_zset", "member4999");
+    ASSERT_STREQ("zscore bulk", score, "2499.5");
+    free(score);
+    ASSERT_NUMEQ("rpush bulk", picoredis_exec_rpush_bulk(ctx, "bulk_list", member_num, members), member_num);
+    ASSERT_NUMEQ("lpush bulk", picoredis_exec_lpush_bulk(ctx, "bulk_list", 2, members), member_num + 2);
+    char *value = picoredis_exec_lindex(ctx, "bulk_list", member_num + 1);
+    ASSERT_STREQ("rpush bulk order", value, "member4999");
+    free(value);
+    ASSERT_NUMEQ("hset bulk", picoredis_exec_hset_bulk(ctx, "bulk_hash", member_num, members, members), 1);
+    ASSERT_NUMEQ("hlen bulk", picoredis_exec_hlen(ctx, "bulk_hash"), member_num);
+
+    // a server without multi-member commands gets one command per element
+    picoredis_exec_del(ctx, 2, "bulk_set", "bulk_list");
+    ctx->variadic = -1;
+    ASSERT_NUMEQ("sadd bulk single", picoredis_exec_sadd_bulk(ctx, "bulk_set", member_num, members), member_num);
+    ASSERT_NUMEQ("rpush bulk single", picoredis_exec_rpush_bulk(ctx, "bulk_list", member_num, members), member_num);
+    value = picoredis_exec_lindex(ctx, "bulk_list", 0);
+    ASSERT_STREQ("rpush bulk single order", value, "member0");
+    free(value);
+    ctx->variadic = 0;
+
+    // large members are split by size
+    size_t large_num = 8;
+    size_t large_size = PICOREDIS_BULK_CHUNK_BYTES / 2;
+    char *large = (char *)malloc(large_size * large_num);
+    picoredis_view_t large_values[8];
+    for (i = 0; i < large_num; ++i) {
+        memset(large + i * large_size, 'a' + i, large_size);
+        large_values[i].ptr    = large + i * large_size;
+        large_values[i].length = large_size;
+    }
+    ASSERT_NUMEQ("bulk chunk by size", picoredis_bulk_chunk(large_values, 1, 0, large_num), 2);
+    picoredis_exec_del(ctx, 1, "bulk_list");
+    ASSERT_NUMEQ("rpush bulk large", picoredis_exec_rpush_bulk(ctx, "bulk_list", large_num, large_values), large_num);
+    free(large);
+
+    picoredis_exec_del(ctx, 4, "bulk_set", "bulk_zset", "bulk_list", "bulk_hash");
+    free(members);
+    free(scores);
+    free(names);
+}
+
+static void test_numeric(picoredis_t *ctx)
+{
+    char buf[PICOREDIS_DOUBLE_BUFFER_SIZE];
+    picoredis_format_double(buf, 2499.5);
+    ASSERT_STREQ("format double decimal", buf, "2499.5");
+    picoredis_format_double(buf, -0.125);
+    ASSERT_STREQ("format double negative", buf, "-0.125");
+    picoredis_format_double(buf, 1e-7);
+    ASSERT_STREQ("format double small", buf, "0.0000001");
+    picoredis_format_double(buf, 42);
+    ASSERT_STREQ("format double integer", buf, "42");
+    picoredis_format_double(buf, 0.1);
+    ASSERT_STREQ("format double shortest", buf, "0.1");
+    picoredis_format_double(buf, -1.0 / 0.0);
+    ASSERT_STREQ("format double inf", buf, "-inf");
+    const double samples[] = { 1.0 / 3, 1e300, -5e-324, 123456789.123456789, 0.30000000000000004, 1e-7, 9007199254740993.0 };
+    int round_trip = 0;
+    size_t i = 0;
+    for (; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+        double parsed = 0;
+        size_t length = picoredis_format_double(buf, samples[i]);
+        round_trip += (picoredis_parse_double(buf, length, &parsed) == 0 && parsed == samples[i] && strtod(buf, NULL) == samples[i]);
+    }
+    ASSERT_NUMEQ("format double round trip", round_trip, sizeof(samples) / sizeof(samples[0]));
+    double parsed = 0;
+    ASSERT_NUMEQ("parse double fast", picoredis_parse_double("-12.75", 6, &parsed), 0);
+    ASSERT_NUMEQ("parse double fast value", parsed == -12.75, 1);
+    ASSERT_NUMEQ("parse double exponent", picoredis_parse_double("1.5e3", 5, &parsed), 0);
+    ASSERT_NUMEQ("parse double exponent value", parsed == 1500, 1);
+    ASSERT_NUMEQ("parse double garbage", picoredis_parse_double("1.5x", 4, &parsed), -1);
+
+    size_t length = picoredis_format_int(buf, INT64_MIN);
+    buf[length] = '\0';
+    ASSERT_STREQ("format int min", buf, "-9223372036854775808");
+    int64_t integer = 0;
+    ASSERT_NUMEQ("parse int64 min", picoredis_parse_int64("-9223372036854775808", 20, &integer), 0);
+    ASSERT_NUMEQ("parse int64 min value", integer == INT64_MIN, 1);
+    ASSERT_NUMEQ("parse int64 overflow", picoredis_parse_int64("9223372036854775808", 19, &integer), -1);
+    ASSERT_NUMEQ("parse int64 garbage", picoredis_parse_int64("12a", 3, &integer), -1);
+
+    picoredis_exec_del(ctx, 3, "num_counter", "num_zset", "num_float");
+    ASSERT_NUMEQ("incrby int64", picoredis_exec_incrby_int64(ctx, "num_counter", 5000000000LL) == 5000000000LL, 1);
+    ASSERT_NUMEQ("incr int64", picoredis_exec_incr_int64(ctx, "num_counter") == 5000000001LL, 1);
+    ASSERT_NUMEQ("decrby int64", picoredis_exec_decrby_int64(ctx, "num_counter", 1LL << 32) == 5000000001LL - (1LL << 32), 1);
+    ASSERT_NUMEQ("get int64", picoredis_exec_get_int64(ctx, "num_counter", &integer), 1);
+    ASSERT_NUMEQ("get int64 value", integer == 5000000001LL - (1LL << 32), 1);
+    ASSERT_NUMEQ("get int64 missing", picoredis_exec_get_int64(ctx, "num_missing", &integer), 0);
+
+    picoredis_exec_zadd(ctx, "num_zset", 1e-7, "tiny");
+    double score = 0;
+    ASSERT_NUMEQ("zscore double", picoredis_exec_zscore_double(ctx, "num_zset", "tiny", &score), 1);
+    ASSERT_NUMEQ("zscore double exact", score == 1e-7, 1);
+    ASSERT_NUMEQ("zscore double missing", picoredis_exec_zscore_double(ctx, "num_zset", "none", &score), 0);
+    ASSERT_NUMEQ("zincrby double", picoredis_exec_zincrby_double(ctx, "num_zset", 0.25, "tiny", &score), 1);
+    ASSERT_NUMEQ("zincrby double exact", score == 1e-7 + 0.25, 1);
+
+    picoredis_exec_set(ctx, "num_float", "3.25");
+    ASSERT_NUMEQ("get double", picoredis_exec_get_double(ctx, "num_float", &score), 1);
+    ASSERT_NUMEQ("get double value", score == 3.25, 1);
+    ASSERT_NUMEQ("get int64 not integer", picoredis_exec_get_int64(ctx, "num_float", &integer), -1);
+    picoredis_exec_del(ctx, 3, "num_counter", "num_zset", "num_float");
+}
+
 int main(int argc, char **argv)
 {
     picoredis_t *ctx = picoredis_connect("127.0.0.1", 6379);
@@ -473,5 +1726,35 @@ int main(int argc, char **argv)
     test_command_bgrewriteaof(ctx);
     test_command_lastsave(ctx);
     test_command_info(ctx);
+    test_large_reply(ctx);
+    test_reader_protocol_error(ctx);
+    test_pipeline(ctx);
+    test_dropped_connection(ctx);
+    test_iterator_protocol_error(ctx);
+    test_binary_value(ctx);
+    test_reply_view(ctx);
+    test_reply_arena(ctx);
+    test_io_uring(ctx);
+    test_pool(ctx);
+    test_mux(ctx);
+    test_cluster_offline(ctx);
+    test_cluster(ctx);
+    test_shard(ctx);
+    test_batch(ctx);
+    test_stream(ctx);
+    test_stream_protocol_error(ctx);
+    test_zero_copy_set(ctx);
+    test_iterator(ctx);
+    test_scan(ctx);
+    test_transaction(ctx);
+    test_script(ctx);
+    test_pubsub(ctx);
+    test_queue(ctx);
+    test_hash(ctx);
+    test_bulk(ctx);
+    test_numeric(ctx);
+#ifdef __linux__
+    test_async(ctx);
+#endif
     return 0;
 }